@@ -0,0 +1,128 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Admission control.
+        Requests are classified and admitted against the number of requests
+        in progress on the server, counted in the APCu shared memory. Each
+        class may only start while fewer than its share of ADMISSION_SLOTS
+        are in progress, thus under overload the lower priority classes run
+        out of room first while the door taps keep the whole server. A
+        request that can't start waits in its class queue till its deadline
+        then it is shed with 503. Full class queues shed immediately.
+        Size ADMISSION_SLOTS to the number of PHP workers e.g. pm.max_children.
+        A slot is counted in the time bucket of ADMISSION_BUCKET_SEC seconds
+        it was taken in and only the buckets of the last ADMISSION_SLOT_TTL
+        seconds are summed, thus the slot of a killed worker or one lost to
+        an APCu reset is freed once its bucket ages out. Set it to at least
+        max_execution_time.
+    * ------------------------------------------------------------- */
+
+    define ("ADMISSION_SLOTS", 32);
+    define ("ADMISSION_POLL_US", 1000);
+    define ("ADMISSION_SLOT_TTL", 30);
+    define ("ADMISSION_BUCKET_SEC", 5);
+
+	// $admissionClasses lists the classes in priority order as
+    // name => (share of the slots in %, queue length, deadline in ms).
+	$admissionClasses = array(
+        "verification" => array(100, 64, 2000),  // Secret key requests of the door PCDs.
+        "rotation"     => array(100, 64, 2000),  // Trust key requests completing a tap.
+        "batch"        => array(100, 16, 2000),  // Batched door taps of the aggregating uplinks.
+        "enrollment"   => array(75, 16, 1000),   // Requests of the trust organization PCDs.
+        "telemetry"    => array(50, 4, 250),     // Batched telemetry uploads.
+        "history"      => array(25, 0, 0),       // History page and export.
+    );
+
+	// slotKeys returns the keys of the buckets counting the slots of the
+    // counter taken in the last ADMISSION_SLOT_TTL seconds, the current first.
+	function slotKeys($counter) {
+        $bucket = intdiv(time(), ADMISSION_BUCKET_SEC);
+        $keys = array();
+        for ($i = 0; $i <= intdiv(ADMISSION_SLOT_TTL, ADMISSION_BUCKET_SEC); ++$i) {
+            $keys[] = $counter.":".($bucket - $i);
+        }
+        return $keys;
+    }
+
+	// countSlots returns the number of slots of the counter held now.
+	function countSlots($counter) {
+        $count = 0;
+        foreach (apcu_fetch(slotKeys($counter)) as $value) {
+            $count += max(0, $value);
+        }
+        return $count;
+    }
+
+	// takeSlot adds a slot to the counter and returns the number of slots held
+    // including it. $slot is set to the key releasing it.
+	function takeSlot($counter, &$slot) {
+        $slot = slotKeys($counter)[0];
+        apcu_add($slot, 0, ADMISSION_SLOT_TTL + ADMISSION_BUCKET_SEC);
+        apcu_inc($slot);
+        return countSlots($counter);
+    }
+
+	// releaseSlot frees the slot unless its bucket already expired.
+	function releaseSlot($slot) {
+        if (apcu_exists($slot)) {
+            apcu_dec($slot);
+        }
+    }
+
+	// admitRequest returns true once the request of the class may start or
+    // false if it was shed. The slot is released when the request completes.
+	function admitRequest($class) {
+        global $admissionClasses;
+
+        if (!isCacheEnabled()) {
+            return true;
+        }
+
+        list($share, $queue_length, $deadline_ms) = $admissionClasses[$class];
+        $limit = intdiv(ADMISSION_SLOTS * $share, 100);
+        $deadline = hrtime(true) + $deadline_ms * 1000000;
+
+        $queued = null;
+        for (;;) {
+            if (takeSlot("adm:running", $slot) <= $limit) {
+                break;
+            }
+            releaseSlot($slot);
+
+            if ($queued === null) {
+                // Join the class queue if it has room.
+                if (takeSlot("adm:queued:".$class, $queued) > $queue_length) {
+                    releaseSlot($queued);
+                    countMetric("admission_shed_".$class);
+                    return false;
+                }
+            }
+
+            if (hrtime(true) >= $deadline) {
+                releaseSlot($queued);
+                countMetric("admission_shed_".$class);
+                return false;
+            }
+            usleep(ADMISSION_POLL_US);
+        }
+
+        if ($queued !== null) {
+            releaseSlot($queued);
+            countMetric("admission_queued_".$class);
+        }
+        countMetric("admission_admitted_".$class);
+
+        // Shutdown functions run even if the request ends with a fatal error.
+        register_shutdown_function(function () use ($slot) {
+            releaseSlot($slot);
+        });
+        return true;
+    }
+
+	// shedRequest sets the response status of a request that wasn't admitted
+    // and returns its response body.
+	function shedRequest() {
+        http_response_code(503);
+        header("Retry-After: 1");
+        return "Server busy!-09";
+    }
+?>
@@ -0,0 +1,261 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Batch verification.
+        Aggregating uplinks such as the rfid-gateway forward the requests of
+        many PCDs in a single POST index.php?batch. The body holds upto
+        BATCH_MAX_RECORDS records, each a 1 byte length followed by a 35, 67
+        or 88 bytes request as sent by a PCD. The response holds a result
+        per record in the same order, each a 1 byte length followed by the
+        response the single request would have received.
+        The PCDs are looked up in the device registry, see registry.php,
+        the cards of each shard node in a single query and the rotations of
+        each shard node are committed in a single transaction. All the
+        records are validated against the state before the batch thus a card
+        rotates at most once per batch. The rotations follow the same policy
+        as the single requests, see rotation.php.
+    * ------------------------------------------------------------- */
+
+    define ("BATCH_MAX_RECORDS", 64);
+
+	// parseBatch splits the body into its records. Returns false if it is malformed.
+	function parseBatch($body) {
+        global $frameFormats;
+
+        $records = array();
+        for ($offset = 0; $offset < strlen($body); $offset += 1 + $size) {
+            $size = ord($body[$offset]);
+            if (!isset($frameFormats[$size]) || $offset + 1 + $size > strlen($body) ||
+                count($records) == BATCH_MAX_RECORDS) {
+                return false;
+            }
+            $records[] = substr($body, $offset + 1, $size);
+        }
+        return empty($records) ? false : $records;
+    }
+
+	// fetchCards returns the secret key and the latest rolling password of the
+    // cards enrolled on the shard node by hashed tag UID.
+	function fetchCards($shardCon, $hashed_tag_uids) {
+        $cards = array();
+        $query = "SELECT s.hashed_tag_uid, s.id, s.secret_key, r.id, r.hashed_blockdata, r.rolling_pass ".
+                "FROM `secretKeysTable` AS s LEFT JOIN `rollingPasswordTable` AS r ON r.id = s.latest_rolling_id ".
+                "WHERE s.hashed_tag_uid IN (X'%s')";
+        $result = dbQuery($shardCon, sprintf($query, implode("', X'", $hashed_tag_uids)));
+
+        while ($result && ($row = dbFetchRow($result))) {
+            $cards[bin2hex($row[0])] = array(
+                "id" => $row[1],
+                "secret_key" => $row[2],
+                "rolling_pass_id" => $row[3],
+                "hashed_blockdata" => ($row[3] === null) ? "" : bin2hex($row[4]),
+                "rolling_pass" => ($row[3] === null) ? "" : bin2hex($row[5]),
+            );
+        }
+
+        dbFreeResult($result);
+        return $cards;
+    }
+
+	// enrollCards inserts the secret keys and the default trust keys of the new
+    // cards on the shard node then returns the cards.
+	function enrollCards($shardName, $hashed_tag_uids) {
+        $shardCon = shardConnection($shardName);
+
+        $values = array();
+        foreach ($hashed_tag_uids as $hashed_tag_uid) {
+            $secret_key = substr(md5hash(random_bytes(8).$hashed_tag_uid), 0, 12);
+            $values[] = sprintf("(X'%s', X'%s')", $hashed_tag_uid, $secret_key);
+        }
+
+        // Cards concurrently enrolled by another request are skipped.
+        $sql = dbInsertIgnore($shardCon)." INTO `secretKeysTable` (hashed_tag_uid, secret_key) VALUES ";
+        dbQuery($shardCon, $sql . implode(", ", $values));
+
+        $cards = fetchCards($shardCon, $hashed_tag_uids);
+
+        $entries = array();
+        foreach ($cards as $hashed_tag_uid => $card) {
+            if ($card["rolling_pass_id"] === null) {
+                $entries[] = array(defaultBlock2Data($hashed_tag_uid), defaultTrustKey($hashed_tag_uid), $card["id"], $shardName);
+                cacheSecretKey($hashed_tag_uid, $card["id"], bin2hex($card["secret_key"]));
+            }
+        }
+
+        if (!empty($entries) && commitTrustKeys($shardCon, $entries)) {
+            $cards = fetchCards($shardCon, $hashed_tag_uids);
+        }
+        return $cards;
+    }
+
+	// serveBatch serves the records and returns the batch response.
+	function serveBatch($records) {
+        countMetric("batch_requests");
+        countMetric("batch_records", count($records));
+
+        // Data packing, the same as the single requests. The digests of all
+        // the records are computed together.
+        $frames = array_map("decodeFrame", $records);
+        $hashed_tag_uids = digestAll("md5", array_map(function ($frame) {
+            return bin2hex($frame["uid"]);
+        }, $frames));
+        $hashed_block2datas = digestAll("md5", array_map(function ($frame) {
+            return bin2hex($frame["block2data"]);
+        }, $frames));
+
+        $requests = array();
+        $deviceUids = array();
+        foreach ($frames as $index => $frame) {
+            $request = array(
+                "frame" => $frame,
+                "PCD_uid" => bin2hex($frame["device_id"]),
+                "hashed_tag_uid" => $hashed_tag_uids[$index],
+                "hashed_block2data" => $hashed_block2datas[$index],
+                "session" => false,
+                "response" => "",
+            );
+
+            if (isset($frame["session_token"])) {
+                $request["session"] = verifySessionToken($frame["session_token"], $request["PCD_uid"], $request["hashed_tag_uid"]);
+            }
+            if ($request["session"] === false) {
+                $deviceUids[$request["PCD_uid"]] = true;
+            }
+            $requests[$index] = $request;
+        }
+
+        $shards = array();
+        try {
+            $devices = empty($deviceUids) ? array() : findDevices(array_keys($deviceUids));
+
+            foreach ($requests as $index => &$request) {
+                if ($request["session"] !== false) {
+                    $request["isTrustOrg"] = ($request["session"]["flags"] & TOKEN_FLAG_TRUST_ORG) != 0;
+                    $request["riskLevel"] = ($request["session"]["flags"] >> TOKEN_RISK_SHIFT) & 3;
+                } elseif (isset($devices[$request["PCD_uid"]])) {
+                    list($request["isTrustOrg"], $request["riskLevel"]) = $devices[$request["PCD_uid"]];
+                } else {
+                    // PCD provided doesn't exist terminate further progress.
+                    $request["response"] = "Hacking Attempt!";
+                    continue;
+                }
+                $shards[locateShard($request["hashed_tag_uid"])][] = $index;
+            }
+            unset($request);
+        } catch (Exception $e) {
+            //echo $e;
+        }
+
+        foreach ($shards as $shardName => $indexes) {
+            unset($request); // Left referenced if the previous shard node threw.
+            try {
+                $shardCon = shardConnection($shardName);
+
+                $hashed_tag_uids = array();
+                foreach ($indexes as $index) {
+                    $hashed_tag_uids[$requests[$index]["hashed_tag_uid"]] = true;
+                }
+                $cards = fetchCards($shardCon, array_keys($hashed_tag_uids));
+                prepareDefaultDigests(array_keys($hashed_tag_uids));
+
+                // New cards tapped on the trust organization PCDs are enrolled first.
+                $new_cards = array();
+                foreach ($indexes as $index) {
+                    $hashed_tag_uid = $requests[$index]["hashed_tag_uid"];
+                    if (!isset($requests[$index]["frame"]["trustkey"]) && $requests[$index]["isTrustOrg"] && !isset($cards[$hashed_tag_uid])) {
+                        $new_cards[$hashed_tag_uid] = true;
+                    }
+                }
+                if (!empty($new_cards)) {
+                    $cards = enrollCards($shardName, array_keys($new_cards)) + $cards;
+                }
+
+                $entries = array();
+                $credentials = array();
+                $rotated = array();
+                foreach ($indexes as $index) {
+                    $request = &$requests[$index];
+                    $hashed_tag_uid = $request["hashed_tag_uid"];
+                    $card = $cards[$hashed_tag_uid] ?? null;
+
+                    if (!isset($request["frame"]["trustkey"])) {
+                        if ($card === null) {
+                            // The secret key doesn't exist.
+                            $request["response"] = "Malformed request!-05";
+                        } elseif ($card["rolling_pass_id"] !== null) {
+                            // Only the card's latest rolling password is valid.
+                            $isDefaultKey = isDefaultBlock2Data($card["hashed_blockdata"], $hashed_tag_uid);
+
+                            if ($isDefaultKey || $card["hashed_blockdata"] == $request["hashed_block2data"]) {
+                                $flags = ($request["isTrustOrg"] ? TOKEN_FLAG_TRUST_ORG : 0) | ($isDefaultKey ? TOKEN_FLAG_DEFAULT_KEY : 0) |
+                                    ($request["riskLevel"] << TOKEN_RISK_SHIFT);
+                                $request["response"] = $card["secret_key"] .
+                                    issueSessionToken($card["id"], $card["rolling_pass_id"], $flags, $request["PCD_uid"], $hashed_tag_uid);
+                            }
+                        }
+                        continue;
+                    }
+
+                    // Validate if the full trust key matches the card's latest one.
+                    $old_trustkey = presentedTrustKey($request["frame"]);
+                    $old_block2data = $request["hashed_block2data"];
+
+                    $isValid = false;
+                    if ($card !== null && $card["rolling_pass_id"] !== null && !isset($rotated[$hashed_tag_uid])) {
+                        $session = $request["session"];
+                        $isDefaultKey = isDefaultTrustKey($card["rolling_pass"], $hashed_tag_uid);
+
+                        if ($session !== false && $session["secret_key_id"] == $card["id"] &&
+                            $session["rolling_pass_id"] == $card["rolling_pass_id"]) {
+                            $isValid = (($session["flags"] & TOKEN_FLAG_DEFAULT_KEY) != 0 && $isDefaultKey) ||
+                                ($card["rolling_pass"] == $old_trustkey && $card["hashed_blockdata"] == $old_block2data);
+                        }
+
+                        $isValid = $isValid || (($isDefaultKey || $card["rolling_pass"] == $old_trustkey) &&
+                            ($card["hashed_blockdata"] == $old_block2data || isDefaultBlock2Data($card["hashed_blockdata"], $hashed_tag_uid)));
+
+                        // A trust organization PCD overwrites the trust key of an enrolled
+                        // card whatever it currently holds.
+                        $isValid = $isValid || $request["isTrustOrg"];
+                    }
+
+                    if ($isValid && !isRotationDue($request["frame"], $hashed_tag_uid, $request["riskLevel"], $request["isTrustOrg"], $isDefaultKey)) {
+                        $request["response"] = verifiedResponse($request["PCD_uid"]);
+                    } elseif ($isValid) {
+                        $rotated[$hashed_tag_uid] = true;
+                        list($new_block2data, $new_trustkey, $credentials[$index]) =
+                            newCredential($old_trustkey, $request["PCD_uid"], $request["frame"]["is_compact"]);
+                        $entries[$index] = array($new_block2data, $new_trustkey, $card["id"], $shardName);
+                    } else {
+                        $request["response"] = "Malformed request!-06";
+                    }
+                }
+                unset($request);
+
+                if (empty($entries)) {
+                    continue;
+                }
+
+                // All the rotations on the shard node are committed together. A single
+                // failing rotation mustn't fail the rest of the batch.
+                $isCommitted = commitTrustKeys($shardCon, $entries);
+                foreach ($entries as $index => $entry) {
+                    if ($isCommitted || commitTrustKeys($shardCon, array($entry))) {
+                        // new Trust Key Will be:
+                        $requests[$index]["response"] = $credentials[$index];
+                        recordRotation($requests[$index]["hashed_tag_uid"], $requests[$index]["riskLevel"]);
+                    } else {
+                        $requests[$index]["response"] = "Malformed request!-06";
+                    }
+                }
+            } catch (Exception $e) {
+                //echo $e;
+            }
+        }
+
+        $bin_response = "";
+        foreach ($requests as $request) {
+            $bin_response .= chr(strlen($request["response"])) . $request["response"];
+        }
+        return $bin_response;
+    }
+?>
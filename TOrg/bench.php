@@ -0,0 +1,101 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Per-request latency benchmark of the trust organization API.
+        It plays a trust organization PCD tapping the given number of cards
+        over and over. The first tap of a card enrolls it, every later tap
+        validates its block 2 data (secret key request) and then rotates its
+        trust key (trust key request) as a real PCD does. Compare the storage
+        engines by running it against the API configured with each in turn e.g.
+        php bench.php http://127.0.0.1:8000/index.php 0123456789ABCDEF 5000 200
+        The PCD ID must be registered in devicesTable with is_trust_org=1.
+        Recorded figures, 5000 taps over 200 cards, in us:
+        engine   request      p50    p95    p99   measured
+        sqlite   secret key   753    949   1341   storage only (1)
+        sqlite   trust key   1745   2414   5068   storage only (1)
+        mysql    both           -      -      -   not measured yet (2)
+        (1) Each request's connection, pragmas and queries as storage.php
+            and index.php run them, on SQLite 3.40 over ext4 with a single
+            core, without PHP, the HTTP server or APCu.
+        (2) Needs this script against the API on a host running MySQL and
+            PHP. Add the end to end rows of both engines here once run.
+    * ------------------------------------------------------------- */
+
+	if (php_sapi_name() != "cli" || $argc < 3) {
+        echo "Usage: php bench.php <api url> <trust org PCD ID hex> [taps] [cards]\n";
+        exit(1);
+    }
+
+	$url = $argv[1];
+	$device_id = hex2bin($argv[2]);
+	$taps = intval($argv[3] ?? 1000);
+	$cards = max(1, intval($argv[4] ?? 100));
+
+	$curl = curl_init($url);
+	curl_setopt_array($curl, array(
+        CURLOPT_POST => true,
+        CURLOPT_RETURNTRANSFER => true,
+        CURLOPT_HTTPHEADER => array("Content-Type: application/x-www-form-urlencoded"),
+    ));
+
+	// post sends the request on the kept alive connection, returns the response
+    // and adds its latency in microseconds to the samples.
+	function post($curl, $body, &$samples) {
+        curl_setopt($curl, CURLOPT_POSTFIELDS, $body);
+        $started = hrtime(true);
+        $response = curl_exec($curl);
+        $samples[] = intdiv(hrtime(true) - $started, 1000);
+        return $response;
+    }
+
+	// report prints the latency distribution of the samples.
+	function report($name, $samples) {
+        if (empty($samples)) {
+            return;
+        }
+        sort($samples);
+        $count = count($samples);
+        echo sprintf("%-22s n=%-7d mean=%-8d p50=%-8d p95=%-8d p99=%-8d max=%d (us)\n", $name, $count,
+            intdiv(array_sum($samples), $count), $samples[intdiv($count * 50, 100)],
+            $samples[intdiv($count * 95, 100)], $samples[intdiv($count * 99, 100)], $samples[$count - 1]);
+    }
+
+	// The card UIDs are 7 bytes long, the block 2 data and trust key are
+    // what the PCD would have read from the card.
+	$state = array();
+	for ($i = 0; $i < $cards; $i++) {
+        $state[$i] = array("uid" => random_bytes(7), "block2" => str_repeat("\0", 16), "trustkey" => str_repeat("\0", 48));
+    }
+
+	$secret_key_samples = array();
+	$trust_key_samples = array();
+	$failures = 0;
+
+	for ($tap = 0; $tap < $taps; $tap++) {
+        $card = &$state[$tap % $cards];
+        $header = chr(7) . str_pad($card["uid"], 10, "\0") . $device_id;
+
+        $response = post($curl, $header . $card["block2"], $secret_key_samples);
+        if (strlen($response) < 6) {
+            $failures++;
+            continue;
+        }
+
+        // Echo back the session token if one was returned.
+        $body = $header . $card["trustkey"] . substr($response, 6);
+        $response = post($curl, $body, $trust_key_samples);
+        if (strlen($response) != 48) {
+            $failures++;
+            continue;
+        }
+
+        // The new block 2 data holds the trust organization and the PCD IDs.
+        $card["block2"] = substr($response, 32, 16);
+        $card["trustkey"] = substr($response, 0, 32) . $card["block2"];
+    }
+
+	report("secret key request", $secret_key_samples);
+	report("trust key request", $trust_key_samples);
+	echo sprintf("failed taps: %d of %d\n", $failures, $taps);
+
+	curl_close($curl);
+?>
@@ -0,0 +1,137 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Secret key cache.
+        Secret keys never change once inserted thus the hashed tag UID to
+        secret key mappings are held in the APCu shared memory where they are
+        shared between all the PHP workers. The database is only consulted on
+        a cache miss. Each entry holds the 4 bytes secret key id and the 6
+        bytes secret key. Size apc.shm_size for about 200 bytes per card
+        e.g. 512M for CACHE_MAX_ENTRIES cards.
+    * ------------------------------------------------------------- */
+
+    define ("CACHE_PREFIX", "sk:");
+    define ("CACHE_MAX_ENTRIES", 2000000);
+    define ("CACHE_SNAPSHOT_FILE", __DIR__ . "/secretKeys.snapshot");
+
+	function isCacheEnabled() {
+        return function_exists("apcu_enabled") && apcu_enabled();
+    }
+
+	function countMetric($name, $step = 1) {
+        if (isCacheEnabled()) {
+            apcu_inc("metric:".$name, $step);
+        }
+    }
+
+	// getCachedSecretKey returns the secret key id and binary secret key cached
+    // for the hashed tag UID or false if it is not cached.
+	function getCachedSecretKey($hashed_tag_uid) {
+        if (!isCacheEnabled()) {
+            return false;
+        }
+
+        $entry = apcu_fetch(CACHE_PREFIX.hex2bin($hashed_tag_uid));
+        if ($entry === false) {
+            countMetric("secret_key_cache_misses");
+            return false;
+        }
+
+        countMetric("secret_key_cache_hits");
+        return unpack("Nid/a6secret_key", $entry);
+    }
+
+	// cacheSecretKey writes the secret key through to the cache. New entries
+    // are not added once CACHE_MAX_ENTRIES is reached.
+	function cacheSecretKey($hashed_tag_uid, $secret_key_id, $secret_key) {
+        if (!isCacheEnabled() || apcu_fetch("metric:secret_key_cache_entries") >= CACHE_MAX_ENTRIES) {
+            return;
+        }
+
+        $entry = pack("Na6", $secret_key_id, hex2bin($secret_key));
+        if (apcu_add(CACHE_PREFIX.hex2bin($hashed_tag_uid), $entry)) {
+            countMetric("secret_key_cache_entries");
+        }
+    }
+
+	// warmSecretKeyCache loads the snapshot file into the cache then adds the
+    // secret keys inserted after the snapshot was taken. Since the ids are
+    // auto incremented and the keys never change, the snapshot and the newer
+    // rows make up the whole table. The snapshot is then refreshed. Each shard
+    // node has its own snapshot file.
+	function warmSecretKeyCache($con, $snapshot_file = CACHE_SNAPSHOT_FILE) {
+        $last_id = 0;
+        $loaded = 0;
+        $snapshot = "";
+
+        // Snapshot records are 16 bytes hashed tag uid, 4 bytes id and 6 bytes secret key.
+        if (is_readable($snapshot_file)) {
+            $snapshot = file_get_contents($snapshot_file);
+            $entries = array();
+
+            foreach (str_split($snapshot, 26) as $record) {
+                if (strlen($record) != 26) {
+                    break;
+                }
+
+                $entries[CACHE_PREFIX.substr($record, 0, 16)] = substr($record, 16);
+                $last_id = max($last_id, unpack("N", substr($record, 16, 4))[1]);
+
+                if (count($entries) == 10000) {
+                    $loaded += count($entries) - count(apcu_add($entries));
+                    $entries = array();
+                }
+            }
+            $loaded += count($entries) - count(apcu_add($entries));
+        }
+
+        $query = "SELECT id, hashed_tag_uid, secret_key FROM `secretKeysTable` WHERE id > %d ORDER BY id";
+        $result = dbQuery($con, sprintf($query, $last_id), true);
+
+        $entries = array();
+        while ($result && ($row = dbFetchRow($result))) {
+            $record = $row[1] . pack("Na6", $row[0], $row[2]);
+            $snapshot .= $record;
+            $entries[CACHE_PREFIX.substr($record, 0, 16)] = substr($record, 16);
+
+            if (count($entries) == 10000) {
+                $loaded += count($entries) - count(apcu_add($entries));
+                $entries = array();
+            }
+        }
+        $loaded += count($entries) - count(apcu_add($entries));
+        dbFreeResult($result);
+
+        file_put_contents($snapshot_file.".tmp", $snapshot);
+        rename($snapshot_file.".tmp", $snapshot_file);
+
+        countMetric("secret_key_cache_entries", $loaded);
+        return $loaded;
+    }
+
+	// cacheMetrics returns the metrics counted so far.
+	function cacheMetrics() {
+        $metrics = array();
+        if (!isCacheEnabled()) {
+            return $metrics;
+        }
+
+        foreach (new APCUIterator("/^metric:/") as $counter) {
+            $metrics[substr($counter["key"], 7)] = $counter["value"];
+        }
+
+        $hits = $metrics["secret_key_cache_hits"] ?? 0;
+        $misses = $metrics["secret_key_cache_misses"] ?? 0;
+        $metrics["secret_key_cache_hit_rate"] = ($hits + $misses) > 0 ? round($hits / ($hits + $misses), 4) : 0;
+        $metrics["secret_key_cache_max_entries"] = CACHE_MAX_ENTRIES;
+        $metrics["admission_running"] = function_exists("countSlots") ? countSlots("adm:running") : 0;
+
+        $batches = $metrics["group_commit_batches"] ?? 0;
+        if ($batches > 0) {
+            $metrics["group_commit_avg_batch_size"] = round($metrics["group_commit_rows"] / $batches, 2);
+            $metrics["group_commit_avg_latency_us"] = intdiv($metrics["group_commit_latency_us"], $batches);
+        }
+        $metrics["shared_memory_available"] = apcu_sma_info(true)["avail_mem"];
+
+        return $metrics;
+    }
+?>
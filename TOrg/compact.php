@@ -0,0 +1,82 @@
+<?php
+	require 'db.php';
+	require 'cache.php';
+	require 'shards.php';
+
+	/* ------------------------------------------------------------- *
+        Compacts the rollingPasswordTable.
+        Every tap appends a rolling password yet only the latest one per
+        card is ever validated. All but the last ROLLING_PASS_RETENTION rows
+        of every secret key are moved into rollingPasswordArchiveTable.
+        The secret keys are compacted in ranges of COMPACT_BATCH_KEYS each
+        in its own short transaction so that the taps are never held back.
+        Run it from the command line e.g. a nightly cron entry
+        0 3 * * * php /var/www/html/rfid-based-auth/compact.php
+    * ------------------------------------------------------------- */
+
+    define ("ROLLING_PASS_RETENTION", 5);
+    define ("COMPACT_BATCH_KEYS", 1000);
+
+	if (php_sapi_name() != "cli") {
+        http_response_code(403);
+        die();
+    }
+
+	// compactSecretKeys archives the expired rolling passwords of the secret
+    // keys with ids in the range [$first_id, $last_id]. The latest rolling
+    // password is never archived as it is the first row per secret key.
+	function compactSecretKeys($con, $first_id, $last_id) {
+        $query = "SELECT id FROM (".
+                    "SELECT id, ROW_NUMBER() OVER (PARTITION BY secret_key_id ORDER BY id DESC) AS n ".
+                    "FROM `rollingPasswordTable` WHERE secret_key_id BETWEEN %d AND %d".
+                ") AS t WHERE t.n > %d";
+        $result = dbQuery($con, sprintf($query, $first_id, $last_id, ROLLING_PASS_RETENTION));
+
+        $ids = array();
+        while ($row = dbFetchRow($result)) {
+            $ids[] = (int)$row[0];
+        }
+        dbFreeResult($result);
+
+        if (empty($ids)) {
+            return 0;
+        }
+
+        $ids = implode(",", $ids);
+        try {
+            dbBegin($con);
+
+            $sql = "%s INTO `rollingPasswordArchiveTable` ".
+                        "(id, hashed_blockdata, rolling_pass, created_on, updated_on, secret_key_id) ".
+                    "SELECT id, hashed_blockdata, rolling_pass, created_on, updated_on, secret_key_id ".
+                        "FROM `rollingPasswordTable` WHERE id IN (%s)";
+            dbQuery($con, sprintf($sql, dbInsertIgnore($con), $ids));
+            dbQuery($con, sprintf("DELETE FROM `rollingPasswordTable` WHERE id IN (%s)", $ids));
+
+            $archived = dbAffectedRows($con);
+            dbCommit($con);
+            return $archived;
+        } catch (Exception $e) {
+            dbRollback($con);
+            echo $e->getMessage() . "\n";
+        }
+        return 0;
+    }
+
+	$archived = 0;
+	foreach (array_keys($shardNodes) as $name) {
+        $shard = shardConnection($name);
+
+        $result = dbQuery($shard, "SELECT MAX(id) FROM `secretKeysTable`");
+        $max_id = (int)dbFetchRow($result)[0];
+        dbFreeResult($result);
+
+        for ($first_id = 1; $first_id <= $max_id; $first_id += COMPACT_BATCH_KEYS) {
+            $archived += compactSecretKeys($shard, $first_id, $first_id + COMPACT_BATCH_KEYS - 1);
+        }
+    }
+
+	echo "Archived rolling passwords: " . $archived . "\n";
+
+	dbClose($con);
+?>
@@ -5,13 +5,44 @@
 
         define ("DBNAME", "------");
 
-		mysqli_report(MYSQLI_REPORT_ERROR | MYSQLI_REPORT_STRICT);
+        // STORAGE_ENGINE selects the database engine, either "mysql" or "sqlite".
+        // SQLITE_FILE is the database file used by the sqlite engine. The web
+        // server user must be able to write to its directory.
+        define ("STORAGE_ENGINE", "mysql");
+        define ("SQLITE_FILE", __DIR__ . "/trustorg.sqlite");
+
+        require_once 'storage.php';
+
+        // SESSION_TOKEN_KEY signs the session tokens linking the secret key and
+        // the trust key requests. Use a long random value.
+        define ("SESSION_TOKEN_KEY", "------");
+
+        // $shardNodes lists the nodes holding the secret keys and the rolling
+        // passwords as name => (server, user, password, database). The node
+        // names place the nodes on the hash ring, never rename a node.
+        // The devices and the telemetry stay in the database above.
+        $shardNodes = array(
+            "shard-0" => array(SERVERNAME, USERNAME, PASSWORD, DBNAME),
+        );
+
+        // $previousShardNodes holds the nodes before resharding till reshard.php completes.
+        $previousShardNodes = array();
+
+        // Local test mode, TRUST_ORG_LOCAL_SHARDS=N runs N shard nodes as the
+        // databases DBNAME_0 ... DBNAME_N-1 of the server above. See localshards.sh
+        $localShards = intval(getenv("TRUST_ORG_LOCAL_SHARDS"));
+        if ($localShards > 0) {
+            $shardNodes = array();
+            for ($i = 0; $i < $localShards; $i++) {
+                $shardNodes["shard-".$i] = array(SERVERNAME, USERNAME, PASSWORD, DBNAME."_".$i);
+            }
+        }
+
         // Create connection
-        $con = mysqli_connect(SERVERNAME, USERNAME, PASSWORD, DBNAME);
-        
-		// Check connection
-        if (mysqli_connect_errno()){
- 			echo "Failed to connect to MySQL: " . mysqli_connect_error();
+        try {
+            $con = dbConnect(SERVERNAME, USERNAME, PASSWORD, DBNAME);
+        } catch (Exception $e) {
+ 			echo "Failed to connect to the database: " . $e->getMessage();
  			die();
  		}
 ?>
\ No newline at end of file
@@ -1,27 +1,46 @@
 CREATE TABLE `devicesTable` (
     `id` int NOT NULL AUTO_INCREMENT,
-    `device_id` varchar(16) NOT NULL,
+    `device_id` binary(8) NOT NULL,
     `is_trust_org` tinyint(1) NOT NULL DEFAULT '0',
+    `risk_level` tinyint NOT NULL DEFAULT '1',
     `created_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
     `updated_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
     PRIMARY KEY (`id`),
-    UNIQUE KEY `device_id` (`device_id`)
+    UNIQUE KEY `device_id` (`device_id`),
+    KEY `device_lookup` (`device_id`, `is_trust_org`, `risk_level`)
 ) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
 
+CREATE TABLE `devicesGenerationTable` (
+    `id` tinyint NOT NULL,
+    `generation` int unsigned NOT NULL DEFAULT '0',
+    PRIMARY KEY (`id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
+
+INSERT INTO `devicesGenerationTable` (`id`, `generation`) VALUES (1, 0);
+
+CREATE TRIGGER `devices_inserted` AFTER INSERT ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
+CREATE TRIGGER `devices_updated` AFTER UPDATE ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
+CREATE TRIGGER `devices_deleted` AFTER DELETE ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
+
 CREATE TABLE `secretKeysTable` (
     `id` int unsigned NOT NULL AUTO_INCREMENT,
-    `hashed_tag_uid` varchar(32) NOT NULL,
-    `secret_key` varchar(12) NOT NULL,
+    `hashed_tag_uid` binary(16) NOT NULL,
+    `secret_key` binary(6) NOT NULL,
+    `latest_rolling_id` int unsigned DEFAULT NULL,
     `created_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
     `updated_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
     PRIMARY KEY (`id`),
-    UNIQUE KEY `hashed_tag_uid` (`hashed_tag_uid`)
+    UNIQUE KEY `hashed_tag_uid` (`hashed_tag_uid`),
+    KEY `tag_lookup` (`hashed_tag_uid`, `secret_key`, `latest_rolling_id`)
 ) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
 
 CREATE TABLE `rollingPasswordTable` (
     `id` int unsigned NOT NULL AUTO_INCREMENT,
-    `hashed_blockdata` varchar(32) DEFAULT NULL,
-    `rolling_pass` varchar(64) DEFAULT NULL,
+    `hashed_blockdata` binary(16) DEFAULT NULL,
+    `rolling_pass` binary(32) DEFAULT NULL,
     `created_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
     `updated_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
     `secret_key_id` int unsigned NOT NULL,
@@ -30,3 +49,32 @@ CREATE TABLE `rollingPasswordTable` (
     KEY `created_on` (`created_on`),
     CONSTRAINT `fk_constraint` FOREIGN KEY (`secret_key_id`) REFERENCES `secretKeysTable` (`id`) ON DELETE RESTRICT ON UPDATE RESTRICT
 ) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
+
+CREATE TABLE `rollingPasswordArchiveTable` (
+    `id` int unsigned NOT NULL,
+    `hashed_blockdata` binary(16) DEFAULT NULL,
+    `rolling_pass` binary(32) DEFAULT NULL,
+    `created_on` datetime NOT NULL,
+    `updated_on` datetime NOT NULL,
+    `secret_key_id` int unsigned NOT NULL,
+    `archived_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (`id`),
+    KEY `secret_key_id` (`secret_key_id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
+
+
+CREATE TABLE `tapTelemetryTable` (
+    `id` int unsigned NOT NULL AUTO_INCREMENT,
+    `device_id` binary(8) NOT NULL,
+    `sequence` smallint unsigned NOT NULL,
+    `outcome` tinyint unsigned NOT NULL,
+    `retries` tinyint unsigned NOT NULL,
+    `status_code` tinyint unsigned NOT NULL,
+    `read_ms` smallint unsigned NOT NULL,
+    `network_ms` smallint unsigned NOT NULL,
+    `write_ms` smallint unsigned NOT NULL,
+    `total_ms` smallint unsigned NOT NULL,
+    `created_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (`id`),
+    KEY `device_created_on` (`device_id`, `created_on`)
+) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
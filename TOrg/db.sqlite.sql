@@ -0,0 +1,75 @@
+-- SQLite schema of the tables in db.sql used by the sqlite storage engine.
+-- Hashes and ids are stored as blobs of the same sizes as the binary columns.
+
+CREATE TABLE IF NOT EXISTS `devicesTable` (
+    `id` INTEGER PRIMARY KEY,
+    `device_id` BLOB NOT NULL UNIQUE,
+    `is_trust_org` INTEGER NOT NULL DEFAULT 0,
+    `risk_level` INTEGER NOT NULL DEFAULT 1,
+    `created_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    `updated_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+-- Every change to devicesTable bumps the generation read by registry.php.
+CREATE TABLE IF NOT EXISTS `devicesGenerationTable` (
+    `id` INTEGER PRIMARY KEY,
+    `generation` INTEGER NOT NULL DEFAULT 0
+);
+
+INSERT OR IGNORE INTO `devicesGenerationTable` (`id`, `generation`) VALUES (1, 0);
+
+CREATE TRIGGER IF NOT EXISTS `devices_inserted` AFTER INSERT ON `devicesTable`
+    BEGIN UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1; END;
+CREATE TRIGGER IF NOT EXISTS `devices_updated` AFTER UPDATE ON `devicesTable`
+    BEGIN UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1; END;
+CREATE TRIGGER IF NOT EXISTS `devices_deleted` AFTER DELETE ON `devicesTable`
+    BEGIN UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1; END;
+
+CREATE TABLE IF NOT EXISTS `secretKeysTable` (
+    `id` INTEGER PRIMARY KEY AUTOINCREMENT,
+    `hashed_tag_uid` BLOB NOT NULL UNIQUE,
+    `secret_key` BLOB NOT NULL,
+    `latest_rolling_id` INTEGER DEFAULT NULL,
+    `created_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    `updated_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE TABLE IF NOT EXISTS `rollingPasswordTable` (
+    `id` INTEGER PRIMARY KEY AUTOINCREMENT,
+    `hashed_blockdata` BLOB DEFAULT NULL,
+    `rolling_pass` BLOB DEFAULT NULL,
+    `created_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    `updated_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    `secret_key_id` INTEGER NOT NULL REFERENCES `secretKeysTable` (`id`) ON DELETE RESTRICT ON UPDATE RESTRICT
+);
+
+CREATE INDEX IF NOT EXISTS `fk_constraint` ON `rollingPasswordTable` (`secret_key_id`);
+CREATE INDEX IF NOT EXISTS `created_on` ON `rollingPasswordTable` (`created_on`);
+
+CREATE TABLE IF NOT EXISTS `rollingPasswordArchiveTable` (
+    `id` INTEGER PRIMARY KEY,
+    `hashed_blockdata` BLOB DEFAULT NULL,
+    `rolling_pass` BLOB DEFAULT NULL,
+    `created_on` TEXT NOT NULL,
+    `updated_on` TEXT NOT NULL,
+    `secret_key_id` INTEGER NOT NULL,
+    `archived_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE INDEX IF NOT EXISTS `archive_secret_key_id` ON `rollingPasswordArchiveTable` (`secret_key_id`);
+
+CREATE TABLE IF NOT EXISTS `tapTelemetryTable` (
+    `id` INTEGER PRIMARY KEY,
+    `device_id` BLOB NOT NULL,
+    `sequence` INTEGER NOT NULL,
+    `outcome` INTEGER NOT NULL,
+    `retries` INTEGER NOT NULL,
+    `status_code` INTEGER NOT NULL,
+    `read_ms` INTEGER NOT NULL,
+    `network_ms` INTEGER NOT NULL,
+    `write_ms` INTEGER NOT NULL,
+    `total_ms` INTEGER NOT NULL,
+    `created_on` TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE INDEX IF NOT EXISTS `device_created_on` ON `tapTelemetryTable` (`device_id`, `created_on`);
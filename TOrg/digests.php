@@ -0,0 +1,174 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Digests.
+        The single requests hash with PHP's hash extension. A batch request
+        gathers the digests of all its records and computes them together
+        with the multi-digest library, see multi-digest/multidigest.h, loaded
+        through the FFI extension. It hashes a message per SIMD lane i.e. 8
+        with AVX2 and 16 with AVX-512, the kernel being picked at runtime
+        from the CPU features with a scalar fallback. Run make
+        bench.multidigest and hashbench.php on the server to compare them.
+        Without FFI or the library built the batches hash with PHP's hash
+        extension as well. Set ffi.enable=preload and load digests.php in
+        opcache.preload so that the library isn't loaded on every request.
+        The per card default digests are derived at most once per request
+        and only when they are needed.
+        The default digests of the previous salts are accepted as well till
+        the rekey tool has migrated the cards, see rekey/rekey.cpp.
+    * ------------------------------------------------------------- */
+
+    define ("DIGEST_LIBRARY", __DIR__ . "/../multi-digest/build/libmultidigest.so");
+    define ("DIGEST_LIBRARY_MIN_MESSAGES", 8);
+
+	function md5hash($data) {
+        return hash("md5", strtoupper($data));
+    }
+
+	function sha256hash($data) {
+        return hash("sha256", strtoupper($data));
+    }
+
+	// digestLibrary returns the multi-digest library or null if it can't be
+    // loaded. It is loaded at most once per request.
+	function digestLibrary() {
+        static $library = false;
+
+        if ($library === false) {
+            $library = null;
+            if (class_exists("FFI") && is_file(DIGEST_LIBRARY)) {
+                try {
+                    $library = FFI::cdef("
+                        void multidigest_md5(const char* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+                        void multidigest_sha256(const char* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);",
+                        DIGEST_LIBRARY);
+                } catch (FFI\Exception $e) {
+                    //echo $e;
+                }
+            }
+        }
+        return $library;
+    }
+
+	// digestAll returns the md5 or sha256 digests of the messages, as md5hash
+    // and sha256hash would, with the same keys. From DIGEST_LIBRARY_MIN_MESSAGES
+    // messages they are computed together by the multi-digest library.
+	function digestAll($algorithm, $messages) {
+        $messages = array_map("strtoupper", $messages);
+        $count = count($messages);
+        $library = ($count >= DIGEST_LIBRARY_MIN_MESSAGES) ? digestLibrary() : null;
+
+        if ($library === null) {
+            return array_map(function ($message) use ($algorithm) {
+                return hash($algorithm, $message);
+            }, $messages);
+        }
+
+        $digestSize = ($algorithm == "md5") ? 16 : 32;
+        $sizes = $library->new("uint32_t[$count]");
+        $i = 0;
+        foreach ($messages as $message) {
+            $sizes[$i++] = strlen($message);
+        }
+
+        $digests = $library->new("uint8_t[" . $count * $digestSize . "]");
+        $library->{"multidigest_" . $algorithm}(implode("", $messages), $sizes, $count, $digests);
+
+        countMetric("multi_digest_calls");
+        countMetric("multi_digest_messages", $count);
+        return array_combine(array_keys($messages),
+            str_split(bin2hex(FFI::string($digests, $count * $digestSize)), 2 * $digestSize));
+    }
+
+	// defaultDigestCache returns the default digests of the given kind derived
+    // so far in this request by hashed tag UID.
+	function &defaultDigestCache($kind) {
+        static $cache = array();
+
+        $cache[$kind] ??= array();
+        return $cache[$kind];
+    }
+
+	// prepareDefaultDigests derives the default digests of the cards together,
+    // the batch requests call it before validating their records.
+	function prepareDefaultDigests($hashed_tag_uids) {
+        global $default_block2data_salt, $default_trustkey_salt;
+        global $previous_block2data_salt, $previous_trustkey_salt;
+
+        $kinds = array(
+            "block2data" => array("md5", $default_block2data_salt),
+            "trustkey" => array("sha256", $default_trustkey_salt),
+            "previous_block2data" => array("md5", $previous_block2data_salt),
+            "previous_trustkey" => array("sha256", $previous_trustkey_salt),
+        );
+
+        foreach ($kinds as $kind => list($algorithm, $salt)) {
+            if (empty($salt)) {
+                continue;
+            }
+
+            $digests = &defaultDigestCache($kind);
+            $messages = array();
+            foreach ($hashed_tag_uids as $hashed_tag_uid) {
+                if (!isset($digests[$hashed_tag_uid])) {
+                    $messages[$hashed_tag_uid] = $salt.$hashed_tag_uid;
+                }
+            }
+            if (!empty($messages)) {
+                $digests = digestAll($algorithm, $messages) + $digests;
+            }
+            unset($digests);
+        }
+    }
+
+	// defaultBlock2Data returns the hashed block 2 data of a newly enrolled card.
+	function defaultBlock2Data($hashed_tag_uid) {
+        global $default_block2data_salt;
+        $digests = &defaultDigestCache("block2data");
+
+        return $digests[$hashed_tag_uid] ??= md5hash($default_block2data_salt.$hashed_tag_uid);
+    }
+
+	// defaultTrustKey returns the trust key of a newly enrolled card.
+	function defaultTrustKey($hashed_tag_uid) {
+        global $default_trustkey_salt;
+        $digests = &defaultDigestCache("trustkey");
+
+        return $digests[$hashed_tag_uid] ??= sha256hash($default_trustkey_salt.$hashed_tag_uid);
+    }
+
+	// defaultBlock2Datas returns the card's defaultBlock2Data followed, while
+    // rekey migrates the cards to new salts, by the one of the previous salt.
+	function defaultBlock2Datas($hashed_tag_uid) {
+        global $previous_block2data_salt;
+
+        if (empty($previous_block2data_salt)) {
+            return array(defaultBlock2Data($hashed_tag_uid));
+        }
+
+        $digests = &defaultDigestCache("previous_block2data");
+        return array(defaultBlock2Data($hashed_tag_uid),
+            $digests[$hashed_tag_uid] ??= md5hash($previous_block2data_salt.$hashed_tag_uid));
+    }
+
+	// defaultTrustKeys returns the card's defaultTrustKey followed, while rekey
+    // migrates the cards to new salts, by the one of the previous salt.
+	function defaultTrustKeys($hashed_tag_uid) {
+        global $previous_trustkey_salt;
+
+        if (empty($previous_trustkey_salt)) {
+            return array(defaultTrustKey($hashed_tag_uid));
+        }
+
+        $digests = &defaultDigestCache("previous_trustkey");
+        return array(defaultTrustKey($hashed_tag_uid),
+            $digests[$hashed_tag_uid] ??= sha256hash($previous_trustkey_salt.$hashed_tag_uid));
+    }
+
+	function isDefaultBlock2Data($hashed_blockdata, $hashed_tag_uid) {
+        return in_array($hashed_blockdata, defaultBlock2Datas($hashed_tag_uid));
+    }
+
+	function isDefaultTrustKey($trustkey, $hashed_tag_uid) {
+        return in_array($trustkey, defaultTrustKeys($hashed_tag_uid));
+    }
+?>
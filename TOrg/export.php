@@ -0,0 +1,105 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Rotation history export.
+        Streams the rolling passwords as newline delimited JSON in ascending
+        (created_on, shard, id) order. Each shard node streams its rows
+        unbuffered over the created_on index (which holds the id as well) and
+        the rows are merged a row per node at a time thus memory use stays
+        constant whatever the size of the history. Every row carries the
+        cursor to resume the export after it i.e.
+        GET index.php?export&limit=50000&after=<cursor>
+    * ------------------------------------------------------------- */
+
+    define ("EXPORT_DEFAULT_LIMIT", 10000);
+    define ("EXPORT_MAX_LIMIT", 1000000);
+    define ("EXPORT_FLUSH_ROWS", 500);
+
+	// exportCursor returns the opaque cursor of the row.
+	function exportCursor($created_on, $shard, $id) {
+        return rtrim(strtr(base64_encode($created_on."|".$shard."|".$id), "+/", "-_"), "=");
+    }
+
+	// parseExportCursor returns the created_on, shard and id held by the cursor
+    // or false if it is malformed.
+	function parseExportCursor($cursor) {
+        $fields = explode("|", base64_decode(strtr($cursor, "-_", "+/")));
+        if (count($fields) != 3 || !preg_match("/^\d{4}-\d{2}-\d{2} \d{2}:\d{2}:\d{2}$/", $fields[0]) ||
+            !ctype_digit($fields[2])) {
+            return false;
+        }
+        return $fields;
+    }
+
+	// exportQuery opens the unbuffered query of the shard's rows following the cursor.
+	function exportQuery($shard, $after, $limit) {
+        $query = "SELECT id, secret_key_id, hashed_blockdata, rolling_pass, created_on FROM `rollingPasswordTable` ";
+        if ($after !== false) {
+            list($created_on, $after_shard, $after_id) = $after;
+            if ($shard == $after_shard) {
+                $query .= sprintf("WHERE (created_on, id) > ('%s', %d) ", $created_on, $after_id);
+            } else {
+                $query .= sprintf("WHERE created_on %s '%s' ", (strcmp($shard, $after_shard) > 0) ? ">=" : ">", $created_on);
+            }
+        }
+        $query .= "ORDER BY created_on, id LIMIT ".$limit;
+
+        return dbQuery(shardConnection($shard), $query, true);
+    }
+
+	// streamExport writes upto $limit rows following the cursor.
+	function streamExport($shards, $after, $limit) {
+        set_time_limit(0);
+        header("Content-Type:application/x-ndjson");
+        while (ob_get_level() > 0) {
+            ob_end_flush();
+        }
+
+        // $heads holds the next row of every shard node still streaming.
+        $results = array();
+        $heads = array();
+        foreach ($shards as $shard) {
+            $results[$shard] = exportQuery($shard, $after, $limit);
+            if ($row = dbFetchAssoc($results[$shard])) {
+                $heads[$shard] = $row;
+            }
+        }
+
+        for ($count = 0; $count < $limit && !empty($heads); $count++) {
+            // The next row is the smallest head by (created_on, shard, id).
+            $next = null;
+            foreach ($heads as $shard => $row) {
+                if ($next === null || strcmp($row["created_on"], $heads[$next]["created_on"]) < 0 ||
+                    ($row["created_on"] == $heads[$next]["created_on"] && strcmp($shard, $next) < 0)) {
+                    $next = $shard;
+                }
+            }
+
+            $row = $heads[$next];
+            echo json_encode((object)[
+                "shard" => $next,
+                "id" => (int)$row["id"],
+                "secret_key_id" => (int)$row["secret_key_id"],
+                "created_on" => $row["created_on"],
+                "hashed_block2data" => bin2hex($row["hashed_blockdata"]),
+                "rolling_password" => substr(bin2hex($row["rolling_pass"]),0,10)."...".substr(bin2hex($row["rolling_pass"]),-10),
+                "cursor" => exportCursor($row["created_on"], $next, $row["id"]),
+            ]), "\n";
+
+            if ($row = dbFetchAssoc($results[$next])) {
+                $heads[$next] = $row;
+            } else {
+                unset($heads[$next]);
+            }
+
+            if ($count % EXPORT_FLUSH_ROWS == 0) {
+                flush();
+            }
+        }
+
+        // Unread unbuffered rows must be released before the connections are reused.
+        foreach ($results as $result) {
+            dbFreeResult($result);
+        }
+        flush();
+    }
+?>
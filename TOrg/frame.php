@@ -0,0 +1,99 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Request frames.
+        The layout is declared by the RequestHeader, SecretKeyRequest and
+        TrustKeyRequest structs in commonRFID/commonRFID.h, the formats
+        below unpack the same fields in a single call:
+        1 byte   => UID size, either of (4/7/10)
+        10 bytes => card's UID Data
+        8 bytes  => PCD's ID
+        followed by the 16 bytes block 2 data of a secret key request or the
+        48 bytes trust key data of a trust key request i.e. the 32 bytes
+        trust key and its 16 bytes block 2 data, then the session token if any.
+        The PCDs writing compact credentials set COMPACT_CREDENTIAL_FLAG and
+        the ones accepting a verified response set SKIP_ROTATION_FLAG in the
+        UID size byte.
+    * ------------------------------------------------------------- */
+
+    define ("SECRET_KEY_REQUEST_SIZE", 35);
+    define ("TRUST_KEY_REQUEST_SIZE", 67);
+    define ("COMPACT_CREDENTIAL_FLAG", 0x80);
+    define ("SKIP_ROTATION_FLAG", 0x40);
+    define ("UID_SIZE_MASK", 0x0F);
+    define ("NO_ROTATION_MARKER", 0x5A);
+    define ("CREDENTIAL_MAGIC", 0xC7);
+    define ("COMPACT_CREDENTIAL_VERSION", 2);
+    define ("FRAME_HEADER_FORMAT", "Cuid_size/a10uid/a8device_id/");
+
+	$frameFormats = array(
+        SECRET_KEY_REQUEST_SIZE => FRAME_HEADER_FORMAT."a16block2data",
+        TRUST_KEY_REQUEST_SIZE => FRAME_HEADER_FORMAT."a32trustkey/a16block2data",
+        TRUST_KEY_REQUEST_SIZE + SESSION_TOKEN_SIZE => FRAME_HEADER_FORMAT."a32trustkey/a16block2data/a21session_token",
+    );
+
+	// decodeFrame returns the fields of the request frame by name with the UID
+    // trimmed to its size, or false if the frame size matches no request.
+    // is_compact is set if the PCD writes compact credentials and
+    // skips_rotation if it accepts a verified response.
+	function decodeFrame($frame) {
+        global $frameFormats;
+
+        if (!isset($frameFormats[strlen($frame)])) {
+            return false;
+        }
+
+        $fields = unpack($frameFormats[strlen($frame)], $frame);
+        $fields["is_compact"] = ($fields["uid_size"] & COMPACT_CREDENTIAL_FLAG) != 0;
+        $fields["skips_rotation"] = ($fields["uid_size"] & SKIP_ROTATION_FLAG) != 0;
+        $fields["uid_size"] &= UID_SIZE_MASK;
+        $fields["uid"] = substr($fields["uid"], 0, $fields["uid_size"]);
+        return $fields;
+    }
+
+	// presentedTrustKey returns the hex trust key read from the card in the
+    // layout it is stored in. A PCD without COMPACT_CREDENTIAL_FLAG reads the
+    // blocks 0 and 1 of a compact credential as the trust key, its block 0 is
+    // no longer used thus only the rolling key in block 1 is compared i.e.
+    // it is returned zero padded as the compact PCDs send it.
+	function presentedTrustKey($frame) {
+        $reference = unpack("Cmagic/Cversion", $frame["block2data"]);
+        if ($frame["is_compact"] || $reference["magic"] != CREDENTIAL_MAGIC ||
+            $reference["version"] != COMPACT_CREDENTIAL_VERSION) {
+            return bin2hex($frame["trustkey"]);
+        }
+        return bin2hex(substr($frame["trustkey"], 16, 16)) . str_repeat("0", 32);
+    }
+
+	// newCredential returns the hashed block 2 data and the trust key to be
+    // stored for the card's next tap and the trust key response. It follows
+    // the old trust key.
+    // A 48 bytes credential holds the 32 bytes trust key then the trust
+    // organization ID and the PCD ID as its block 2 data. A compact credential
+    // holds a 16 bytes rolling key then its reference block (magic, version,
+    // leading 6 bytes of the trust organization ID, PCD ID) as its block 2
+    // data. The PCD sends its rolling key zero padded thus it is stored so.
+    // The compact response is followed by the IDs to keep the 48 bytes size.
+	function newCredential($old_trustkey, $deviceUid, $isCompact) {
+        global $trustOrgId;
+
+        $trustkey = sha256hash(random_bytes(8) . $old_trustkey);
+        if (!$isCompact) {
+            return array(md5hash($trustOrgId . $deviceUid), $trustkey,
+                hex2bin($trustkey) . hex2bin($trustOrgId) . hex2bin($deviceUid));
+        }
+
+        $rolling_key = substr($trustkey, 0, 32);
+        $reference = sprintf("%02x%02x%s%s", CREDENTIAL_MAGIC, COMPACT_CREDENTIAL_VERSION, substr($trustOrgId, 0, 12), $deviceUid);
+        return array(md5hash($reference), $rolling_key . str_repeat("0", 32),
+            hex2bin($rolling_key . $reference . $trustOrgId . $deviceUid));
+    }
+
+	// verifiedResponse returns the trust key response telling the PCD that the
+    // card was verified and keeps its trust key. It is the first block filled
+    // with NO_ROTATION_MARKER, a zero block then the IDs.
+	function verifiedResponse($deviceUid) {
+        global $trustOrgId;
+
+        return str_repeat(chr(NO_ROTATION_MARKER), 16) . str_repeat("\0", 16) . hex2bin($trustOrgId) . hex2bin($deviceUid);
+    }
+?>
@@ -0,0 +1,174 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Group commit of the rolling password inserts.
+        Every trust key rotation inserts a rolling password and moves the
+        card's latest rolling password pointer. Committed one by one, each
+        rotation pays for its own log flush. Instead the rotations are queued
+        in the APCu shared memory and the first PHP worker to take the leader
+        lock commits all of the queued ones in a single transaction. The
+        leader waits upto GROUP_COMMIT_WAIT_US for more rotations to join the
+        batch unless GROUP_COMMIT_MAX_ROWS are already queued. A rotation is
+        only reported successful once its batch has been committed.
+    * ------------------------------------------------------------- */
+
+    define ("GROUP_COMMIT_WAIT_US", 2000);
+    define ("GROUP_COMMIT_MAX_ROWS", 256);
+    define ("GROUP_COMMIT_TIMEOUT_US", 500000);
+    define ("GROUP_COMMIT_POLL_US", 100);
+    define ("GROUP_COMMIT_QUEUE", "gc:queue");
+    define ("GROUP_COMMIT_LOCKS", sys_get_temp_dir() . "/rfid-group-commit");
+
+	// commitTrustKeys inserts the rolling passwords and moves the latest rolling
+    // password pointers of their secret keys in a single transaction. Each
+    // entry holds the hashed block 2 data, the trust key, the secret key id
+    // and the shard node name.
+	function commitTrustKeys($con, $entries) {
+        $values = array();
+        $secret_key_ids = array();
+        foreach ($entries as $entry) {
+            $values[] = sprintf("(X'%s', X'%s', %d)", $entry[0], $entry[1], $entry[2]);
+            $secret_key_ids[] = (int)$entry[2];
+        }
+
+        try {
+            dbBegin($con);
+
+            $sql = "INSERT INTO `rollingPasswordTable` (hashed_blockdata, rolling_pass, secret_key_id) VALUES ";
+            if (dbQuery($con, $sql . implode(", ", $values))) {
+                // The largest id inserted per secret key is its latest rolling password.
+                $sql = "UPDATE `secretKeysTable` SET latest_rolling_id = (".
+                            "SELECT MAX(r.id) FROM `rollingPasswordTable` AS r ".
+                            "WHERE r.secret_key_id = `secretKeysTable`.id AND r.id >= %d".
+                        ") WHERE id IN (%s)";
+                dbQuery($con, sprintf($sql, dbFirstInsertId($con, count($entries)), implode(",", array_unique($secret_key_ids))));
+
+                return dbCommit($con);
+            }
+            dbRollback($con);
+        } catch (Exception $e) {
+            dbRollback($con);
+            //echo $e;
+        }
+        return false;
+    }
+
+	// withQueueLock runs the callback while holding the queue lock. The lock
+    // is only held to add or take the queued rotations.
+	function withQueueLock($callback) {
+        $lock = fopen(GROUP_COMMIT_LOCKS . ".queue.lock", "c");
+        flock($lock, LOCK_EX);
+        $result = $callback();
+        flock($lock, LOCK_UN);
+        fclose($lock);
+        return $result;
+    }
+
+	// leadGroupCommit commits the queued rotations if the leader lock can be
+    // taken without waiting. Returns false if another worker is the leader.
+	function leadGroupCommit() {
+        $lock = fopen(GROUP_COMMIT_LOCKS . ".leader.lock", "c");
+        if (!flock($lock, LOCK_EX | LOCK_NB)) {
+            fclose($lock);
+            return false;
+        }
+
+        // Wait for more rotations to join the batch unless it is already full.
+        $queued = apcu_fetch(GROUP_COMMIT_QUEUE);
+        if ($queued === false || count($queued) < GROUP_COMMIT_MAX_ROWS) {
+            usleep(GROUP_COMMIT_WAIT_US);
+        }
+
+        $batch = withQueueLock(function () {
+            $queued = apcu_fetch(GROUP_COMMIT_QUEUE) ?: array();
+            apcu_store(GROUP_COMMIT_QUEUE, array_slice($queued, GROUP_COMMIT_MAX_ROWS, null, true));
+            return array_slice($queued, 0, GROUP_COMMIT_MAX_ROWS, true);
+        });
+
+        // The batch is committed per shard node.
+        $shards = array();
+        foreach ($batch as $ticket => $entry) {
+            $shards[$entry[3]][$ticket] = $entry;
+        }
+
+        foreach ($shards as $name => $entries) {
+            $con = shardConnection($name);
+
+            $started = hrtime(true);
+            $isCommitted = commitTrustKeys($con, $entries);
+            $latency = intdiv(hrtime(true) - $started, 1000);
+
+            countMetric("group_commit_batches");
+            countMetric("group_commit_rows", count($entries));
+            countMetric("group_commit_latency_us", $latency);
+
+            foreach ($entries as $ticket => $entry) {
+                if (!$isCommitted) {
+                    // A single failing rotation mustn't fail the rest of the batch.
+                    countMetric("group_commit_failures");
+                    apcu_store("gc:done:".$ticket, commitTrustKeys($con, array($entry)), 60);
+                    continue;
+                }
+                apcu_store("gc:done:".$ticket, true, 60);
+            }
+        }
+
+        flock($lock, LOCK_UN);
+        fclose($lock);
+        return true;
+    }
+
+	// groupCommitTrustKey queues the rotation and returns once the batch that
+    // holds it is committed. Returns true if it was committed successfully.
+	function groupCommitTrustKey($entry) {
+        $ticket = apcu_inc("gc:ticket");
+        if ($ticket === false) {
+            return commitTrustKeys(shardConnection($entry[3]), array($entry));
+        }
+
+        withQueueLock(function () use ($ticket, $entry) {
+            $queued = apcu_fetch(GROUP_COMMIT_QUEUE) ?: array();
+            $queued[$ticket] = $entry;
+            apcu_store(GROUP_COMMIT_QUEUE, $queued);
+        });
+
+        $deadline = hrtime(true) + GROUP_COMMIT_TIMEOUT_US * 1000;
+        do {
+            $isCommitted = apcu_fetch("gc:done:".$ticket, $isDone);
+            if ($isDone) {
+                apcu_delete("gc:done:".$ticket);
+                return $isCommitted;
+            }
+
+            if (!leadGroupCommit()) {
+                usleep(GROUP_COMMIT_POLL_US);
+            }
+        } while (hrtime(true) < $deadline);
+
+        // The bounded wait expired, commit the rotation directly unless a
+        // leader has already taken it.
+        $isQueued = withQueueLock(function () use ($ticket) {
+            $queued = apcu_fetch(GROUP_COMMIT_QUEUE) ?: array();
+            if (!isset($queued[$ticket])) {
+                return false;
+            }
+            unset($queued[$ticket]);
+            apcu_store(GROUP_COMMIT_QUEUE, $queued);
+            return true;
+        });
+
+        countMetric("group_commit_timeouts");
+        if ($isQueued) {
+            return commitTrustKeys(shardConnection($entry[3]), array($entry));
+        }
+
+        // The leader holding it is still committing, its result is awaited.
+        $lock = fopen(GROUP_COMMIT_LOCKS . ".leader.lock", "c");
+        flock($lock, LOCK_EX);
+        flock($lock, LOCK_UN);
+        fclose($lock);
+
+        $isCommitted = apcu_fetch("gc:done:".$ticket, $isDone);
+        apcu_delete("gc:done:".$ticket);
+        return $isDone && $isCommitted;
+    }
+?>
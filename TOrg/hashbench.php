@@ -0,0 +1,76 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Per core throughput of the digests, see digests.php.
+        Each iteration computes the digests of a full batch request of
+        BATCH_MAX_RECORDS taps i.e. a secret key request followed by a trust
+        key request per tap, on inputs of the same sizes. The php backend
+        hashes them one at a time as the single requests do, the
+        multi-digest one gathers them as serveBatch does. Build the library
+        with make multidigest then run it on the server from the command line
+        e.g. php -d ffi.enable=1 hashbench.php 5000
+    * ------------------------------------------------------------- */
+
+	if (php_sapi_name() != "cli") {
+        http_response_code(403);
+        die();
+    }
+
+	require 'cache.php';
+	require 'digests.php';
+
+	$iterations = max(1, intval($argv[1] ?? 5000));
+	$records = 64;  // BATCH_MAX_RECORDS in batch.php.
+
+	$uids = array();
+	$block2s = array();
+	$trustkeys = array();
+	for ($i = 0; $i < $records; $i++) {
+        $uids[] = bin2hex(random_bytes(7));
+        $block2s[] = bin2hex(random_bytes(16));
+        $trustkeys[] = bin2hex(random_bytes(32));
+    }
+	$salt = "The only thing we have to fear is fear itself!🫣";
+
+	$backends = array(
+        "php" => function () use ($uids, $block2s, $trustkeys, $salt) {
+            foreach ($uids as $i => $uid) {
+                $hashed_tag_uid = md5hash($uid);
+                md5hash($salt.$hashed_tag_uid);         // default block 2 data
+                md5hash($block2s[$i]);                  // block 2 data
+                md5hash($block2s[$i]);                  // trust key block 2 data
+                sha256hash($salt.$hashed_tag_uid);      // default trust key
+                sha256hash(random_bytes(8).$trustkeys[$i]); // new trust key
+            }
+        },
+    );
+	if (digestLibrary() !== null) {
+        $backends["multi-digest"] = function () use ($uids, $block2s, $trustkeys, $salt) {
+            $hashed_tag_uids = digestAll("md5", $uids);
+            digestAll("md5", $block2s);                 // block 2 data of both requests
+            digestAll("md5", $block2s);
+            $salted = array();
+            foreach ($hashed_tag_uids as $hashed_tag_uid) {
+                $salted[] = $salt.$hashed_tag_uid;
+            }
+            digestAll("md5", $salted);                  // default block 2 data
+            digestAll("sha256", $salted);               // default trust keys
+            foreach ($trustkeys as $trustkey) {
+                sha256hash(random_bytes(8).$trustkey);  // new trust keys are hashed as they rotate
+            }
+        };
+    } else {
+        echo "multi-digest library not loaded, build it with make multidigest and enable FFI\n";
+    }
+
+	foreach ($backends as $name => $batch) {
+        $started = hrtime(true);
+        for ($i = 0; $i < $iterations; $i++) {
+            $batch();
+        }
+        $elapsed = (hrtime(true) - $started) / 1e9;
+
+        echo sprintf("%-13s %10.0f taps/s %12.0f digests/s %8.3f us/tap\n", $name,
+            $records * $iterations / $elapsed, 6 * $records * $iterations / $elapsed,
+            1e6 * $elapsed / ($records * $iterations));
+    }
+?>
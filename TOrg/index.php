@@ -1,65 +1,129 @@
 <?php
 	require 'db.php';
+	require 'cache.php';
+	require 'token.php';
+	require 'frame.php';
+	require 'rotation.php';
+	require 'groupcommit.php';
+	require 'shards.php';
+	require 'export.php';
+	require 'admission.php';
+	require 'digests.php';
+	require 'registry.php';
+	require 'batch.php';
 
 	// Current trust organization's unique id.
 	$trustOrgId = "123456ABCDEF12A1";
 
 	$bin_response = "";
 	$inTrustOrgMode = false;
+	$riskLevel = RISK_NORMAL;
     $default_block2data_salt = "thayu!🥸";
     $default_trustkey_salt = "The only thing we have to fear is fear itself!🫣";
 
-	function md5hash($data) {
-        return hash("md5", strtoupper($data));
-    }
-
-	function sha256hash($data) {
-        return hash("sha256", strtoupper($data));
-    }
-
-	function insertTrustKey ($new_block2data, $new_trustkey, $deviceUid, $secretKeyId) {
-        try {
-            global $con;
-            global $trustOrgId;
+    // The salts before rekeying till the rekey tool completes, see rekey/rekey.cpp.
+    $previous_block2data_salt = "";
+    $previous_trustkey_salt = "";
 
-            $sql = "INSERT INTO `rollingPasswordTable` (hashed_blockdata, rolling_pass, secret_key_id) ".
-                        "VALUES('%s', '%s', %d)";
-            $sql = sprintf($sql, $new_block2data, $new_trustkey, $secretKeyId);
-            //echo $sql;
+	function insertTrustKey ($new_block2data, $new_trustkey, $secretKeyId) {
+        global $shardName;
 
-            if (mysqli_query($con, $sql)) {
-                // new Trust Key Will be:
-                return  hex2bin($new_trustkey) . hex2bin($trustOrgId) . hex2bin($deviceUid);
-            }
-        } catch (Exception $e) {
-            //echo $e;
+        // Concurrent rotations are group committed when the shared memory is available.
+        $entry = array($new_block2data, $new_trustkey, $secretKeyId, $shardName);
+        if (isCacheEnabled()) {
+            return groupCommitTrustKey($entry);
         }
-        return "";
+        return commitTrustKeys(shardConnection($shardName), array($entry));
     };
 
 	function findDevice($deviceUid) {
         $deviceExists = false;
         try {
-            global $con;
             global $inTrustOrgMode;
+            global $riskLevel;
 
-            $query = "SELECT is_trust_org FROM `devicesTable` WHERE device_id='$deviceUid'";
-            $result = mysqli_query($con, $query);
-
-            $deviceExists = ($result && mysqli_num_rows($result) > 0);
+            // The device registry answers the known and the unknown PCDs alike.
+            $devices = findDevices(array($deviceUid));
+            $deviceExists = isset($devices[$deviceUid]);
 
             if ($deviceExists) {
-                $inTrustOrgMode = (mysqli_fetch_row($result)[0] == 1);
+                list($inTrustOrgMode, $riskLevel) = $devices[$deviceUid];
             }
-
-            mysqli_free_result($result);
         } catch (Exception $e) {
             //echo $e;
         }
         return $deviceExists;
     }
 
-	if ($_SERVER["REQUEST_METHOD"] == "POST") {
+	function insertTelemetry($deviceUid, $records) {
+        // Each telemetry record is 16 bytes long as defined by TelemetryDataSize in commonRFID.h
+        $format = "Cmarker/Coutcome/Cretries/Cstatus/vsequence/vread_ms/vnetwork_ms/vwrite_ms/vtotal_ms/vreserved";
+        $values = array();
+
+        foreach (str_split($records, 16) as $record) {
+            $t = unpack($format, $record);
+            if ($t["marker"] != 0xA7) {
+                continue; // Not a valid telemetry record.
+            }
+
+            array_push($values, sprintf("(X'%s', %d, %d, %d, %d, %d, %d, %d, %d)", $deviceUid,
+                $t["sequence"], $t["outcome"], $t["retries"], $t["status"],
+                $t["read_ms"], $t["network_ms"], $t["write_ms"], $t["total_ms"]));
+        }
+
+        if (empty($values)) {
+            return false;
+        }
+
+        try {
+            global $con;
+
+            // All the records in the batch are inserted in a single statement.
+            $sql = "INSERT INTO `tapTelemetryTable` (device_id, sequence, outcome, retries, status_code, ".
+                        "read_ms, network_ms, write_ms, total_ms) VALUES ".implode(", ", $values);
+            return dbQuery($con, $sql);
+        } catch (Exception $e) {
+            //echo $e;
+        }
+        return false;
+    }
+
+	if ($_SERVER["REQUEST_METHOD"] == "POST" && isset($_GET["telemetry"])) {
+        // Handle batched tap telemetry upload. The body holds the 8 bytes PCD ID
+        // followed by upto 64 records of 16 bytes each.
+        $bin_input = file_get_contents('php://input');
+        $records_size = strlen($bin_input) - 8;
+
+        $isUploaded = false;
+        if (!admitRequest("telemetry")) {
+            echo shedRequest();
+        } else {
+            if ($records_size >= 16 && $records_size <= 64*16 && $records_size % 16 == 0) {
+                $PCD_uid = bin2hex(substr($bin_input, 0, 8));
+                if (findDevice($PCD_uid)) {
+                    $isUploaded = insertTelemetry($PCD_uid, substr($bin_input, 8));
+                }
+            }
+
+            if (!$isUploaded) {
+                http_response_code(400);
+            }
+            echo $isUploaded ? "OK" : "Malformed request!-07";
+        }
+    } elseif ($_SERVER["REQUEST_METHOD"] == "POST" && isset($_GET["batch"])) {
+        // Handle the batched requests of an aggregating uplink, see batch.php
+        $records = parseBatch(file_get_contents('php://input'));
+
+        if ($records === false) {
+            http_response_code(400);
+            echo "Malformed request!-10";
+        } elseif (!admitRequest("batch")) {
+            echo shedRequest();
+        } else {
+            header("Content-Type:application/octet-stream");
+            echo serveBatch($records);
+        }
+    } elseif ($_SERVER["REQUEST_METHOD"] == "POST") {
         // Handle POST request.
 
         $bin_input = file_get_contents('php://input');
@@ -68,18 +132,42 @@
         $PCD_uid = "";
         $hashed_tag_uid = "";
 
-        // Data packing
-        if (strlen($bin_input) >= 19) {
-            $PCD_uid = bin2hex(substr($bin_input, 11, 8));
-            $uid_size = hexdec(bin2hex(substr($bin_input, 0, 1)));
-            $hashed_tag_uid = md5hash(bin2hex(substr($bin_input, 1, $uid_size)));
+        // Data packing, see frame.php
+        $frame = decodeFrame($bin_input);
+        if ($frame !== false) {
+            $PCD_uid = bin2hex($frame["device_id"]);
+            $hashed_tag_uid = md5hash(bin2hex($frame["uid"]));
+        }
+
+        // The card's secret key and rolling passwords live on its shard node.
+        $shardName = locateShard($hashed_tag_uid);
+        $shardCon = shardConnection($shardName);
+
+        // A trust key request carrying a valid session token was authorized by
+        // the preceding secret key request, the PCD lookup isn't repeated.
+        $session = false;
+        if (isset($frame["session_token"])) {
+            $session = verifySessionToken($frame["session_token"], $PCD_uid, $hashed_tag_uid);
+            $bin_input = substr($bin_input, 0, TRUST_KEY_REQUEST_SIZE);
         }
 
         try {
-            if (!findDevice($PCD_uid)) { // PCD provided doesn't exist terminate further progress.
+            if ($session !== false) {
+                $inTrustOrgMode = ($session["flags"] & TOKEN_FLAG_TRUST_ORG) != 0;
+                $riskLevel = ($session["flags"] >> TOKEN_RISK_SHIFT) & 3;
+            } elseif (!findDevice($PCD_uid)) { // PCD provided doesn't exist terminate further progress.
                 $bin_input = "";
                 $bin_response = "Hacking Attempt!";
             }
+
+            // The door taps are admitted ahead of the trust organization PCDs.
+            if (!empty($bin_input)) {
+                $class = $inTrustOrgMode ? "enrollment" : ((strlen($bin_input) == 35) ? "verification" : "rotation");
+                if (!admitRequest($class)) {
+                    $bin_input = "";
+                    $bin_response = shedRequest();
+                }
+            }
             //echo "content length: " . $_SERVER["CONTENT_LENGTH"]. "\n";
             //echo "string length: " . strlen($bin_input). "\n";
 
@@ -88,48 +176,70 @@
             * ------------------------------------------------------------- */
             if ($_SERVER["CONTENT_LENGTH"] >= 35 && strlen($bin_input) == 35) {
 
-                $default_block2data = md5hash($default_block2data_salt.$hashed_tag_uid);
-                $query = "SELECT secret_key FROM `secretKeysTable` WHERE hashed_tag_uid='$hashed_tag_uid'";
-                $result = mysqli_query($con,$query);
+                // The secret key cache is consulted before the database.
+                $secret_key_id = -1;
+                $cached = getCachedSecretKey($hashed_tag_uid);
+                if ($cached !== false) {
+                    $bin_response = $cached["secret_key"];
+                    $secret_key_id = $cached["id"];
+                } else {
+                    $query = "SELECT id, secret_key FROM `secretKeysTable` WHERE hashed_tag_uid=X'$hashed_tag_uid'";
+                    $result = dbQuery($shardCon,$query);
 
-                if (mysqli_num_rows($result) > 0) {
-                    $bin_response = hex2bin(mysqli_fetch_row($result)[0]);
+                    if ($row = dbFetchRow($result)) {
+                        $bin_response = $row[1];
+                        $secret_key_id = $row[0];
+                        cacheSecretKey($hashed_tag_uid, $row[0], bin2hex($row[1]));
+                    }
+                    dbFreeResult($result);
                 }
-                mysqli_free_result($result);
                 //echo " Secret Key: ".bin2hex($bin_response). " \n";
 
                 if (empty($bin_response) && $inTrustOrgMode) { // new card update by trust organization pcd.
                     $secret_key = substr(md5hash(random_bytes(8).$hashed_tag_uid), 0, 12);
-                    $query = "INSERT INTO `secretKeysTable` (hashed_tag_uid, secret_key) VALUES('%s', '%s')";
+                    $query = "INSERT INTO `secretKeysTable` (hashed_tag_uid, secret_key) VALUES(X'%s', X'%s')";
 
                     $query = sprintf($query, $hashed_tag_uid, $secret_key);
-                    if (mysqli_query($con, $query)) {
+                    if (dbQuery($shardCon, $query)) {
                             $bin_response = hex2bin($secret_key);
                     }
 
-                    $secret_key_id = mysqli_insert_id($con);
-                    $default_trustkey = sha256hash($default_trustkey_salt.$hashed_tag_uid);
+                    $secret_key_id = dbInsertId($shardCon);
 
+                    // Write the new secret key through to the cache.
+                    if (!empty($bin_response)) {
+                        cacheSecretKey($hashed_tag_uid, $secret_key_id, $secret_key);
+                    }
                     // Also insert default trust key entry.
-                    insertTrustKey($default_block2data, $default_trustkey, $PCD_uid, $secret_key_id);
+                    insertTrustKey(defaultBlock2Data($hashed_tag_uid), defaultTrustKey($hashed_tag_uid), $secret_key_id);
                 }
 
                 if (!empty($bin_response)) { // Previous entry exists, validate block 2 data now.
 
-                    $hashed_block2data = md5hash(bin2hex(substr($bin_input, 19, 16)));
+                    $hashed_block2data = md5hash(bin2hex($frame["block2data"]));
                     //echo " -block2data :".$hashed_block2data. "\n";
 
-                    $query = "SELECT id FROM `rollingPasswordTable` WHERE hashed_blockdata IN ('%s', '%s') ".
-                            "ORDER BY created_on DESC LIMIT 1";
-                    $query = sprintf($query, $hashed_block2data, $default_block2data);
-                    $result = mysqli_query($con, $query);
+                    // Only the card's latest rolling password is valid. The secret key id is
+                    // read back as the cached one is stale if the card moved between shards.
+                    $query = "SELECT s.id, r.id, r.hashed_blockdata FROM `secretKeysTable` AS s ".
+                            "JOIN `rollingPasswordTable` AS r ON r.id = s.latest_rolling_id ".
+                            "WHERE s.hashed_tag_uid=X'%s' AND r.hashed_blockdata IN (X'%s')";
+                    $query = sprintf($query, $hashed_tag_uid,
+                                implode("', X'", array_merge(array($hashed_block2data), defaultBlock2Datas($hashed_tag_uid))));
+                    $result = dbQuery($shardCon, $query);
                     //echo " Query: ".$query. " \n";
 
-                    if (!$result || mysqli_num_rows($result) != 1){
+                    if (!$result || !($row = dbFetchRow($result))){
                         $bin_response = ""; // Unexpected error occured
+                    } else {
+                        // Append the session token to be echoed back in the trust key request.
+                        $flags = ($inTrustOrgMode ? TOKEN_FLAG_TRUST_ORG : 0) |
+                                    (isDefaultBlock2Data(bin2hex($row[2]), $hashed_tag_uid) ? TOKEN_FLAG_DEFAULT_KEY : 0) |
+                                    ($riskLevel << TOKEN_RISK_SHIFT);
+                        $bin_response .= issueSessionToken($row[0], $row[1], $flags, $PCD_uid, $hashed_tag_uid);
                     }
 
-                    mysqli_free_result($result);
+                    dbFreeResult($result);
                 } else {
                     // An error occured and the secret key couldn't be retrieved or it doesn't exist.
                     $bin_response = "Malformed request!-05";
@@ -141,32 +251,78 @@
             elseif ($_SERVER["CONTENT_LENGTH"] >= 67 && strlen($bin_input) == 67) {
 
                 // Validate if the full trust key matches the stored ones.
-                $old_trustkey = bin2hex(substr($bin_input, 19, 32));
-                $old_block2data  = md5hash(bin2hex(substr($bin_input, 51, 16)));
-                $default_block2data = md5hash($default_block2data_salt.$hashed_tag_uid);
-                $default_trustkey = sha256hash($default_trustkey_salt.$hashed_tag_uid);
+                $old_trustkey = presentedTrustKey($frame);
+                $old_block2data  = md5hash(bin2hex($frame["block2data"]));
                 //echo " --block2data :".$old_block2data. "\n";
 
-                // picks only the most recent trust key insert for authentication.
-                $query = "SELECT t.s FROM (".
-                			"SELECT `secret_key_id` as s, `rolling_pass` as r  from `rollingPasswordTable` as m ".
-                        	"WHERE m.hashed_blockdata IN ('%s', '%s') ORDER BY m.created_on DESC LIMIT 1".
-                        ") as t WHERE t.r IN ('%s', '%s')";
-                $query = sprintf($query, $old_block2data, $default_block2data, $default_trustkey, $old_trustkey);
-                $result = mysqli_query($con, $query);
-                //echo $query . " \n";
-
                 $secret_key_id = -1;
-                if ($result && mysqli_num_rows($result) > 0) {
-                    $secret_key_id = mysqli_fetch_row($result)[0];
+                $isDefaultKey = false;
+                if ($session !== false) {
+                    // The session token names the rolling password resolved by the
+                    // secret key request, it must still be the card's latest one.
+                    $query = "SELECT r.secret_key_id, r.rolling_pass, r.hashed_blockdata FROM `secretKeysTable` AS s ".
+                            "JOIN `rollingPasswordTable` AS r ON r.id = s.latest_rolling_id WHERE s.id=%d AND r.id=%d";
+                    $query = sprintf($query, $session["secret_key_id"], $session["rolling_pass_id"]);
+                    $result = dbQuery($shardCon, $query);
+
+                    if ($result && ($row = dbFetchRow($result))) {
+                        $rolling_pass = bin2hex($row[1]);
+                        $isDefaultKey = ($session["flags"] & TOKEN_FLAG_DEFAULT_KEY) != 0 &&
+                                    isDefaultTrustKey($rolling_pass, $hashed_tag_uid);
+                        if ($isDefaultKey ||
+                            ($rolling_pass == $old_trustkey && bin2hex($row[2]) == $old_block2data)) {
+                            $secret_key_id = $row[0];
+                        }
+                    }
+
+                    dbFreeResult($result);
+                }
+
+                // Without a session token or if the card has since moved between
+                // shards, the trust key is validated against the card's latest one.
+                if ($secret_key_id == -1) {
+                    // picks only the card's latest trust key insert for authentication.
+                    $query = "SELECT r.secret_key_id, r.rolling_pass FROM `secretKeysTable` AS s ".
+                            "JOIN `rollingPasswordTable` AS r ON r.id = s.latest_rolling_id ".
+                            "WHERE s.hashed_tag_uid=X'%s' AND r.hashed_blockdata IN (X'%s') AND r.rolling_pass IN (X'%s')";
+                    $query = sprintf($query, $hashed_tag_uid,
+                                implode("', X'", array_merge(array($old_block2data), defaultBlock2Datas($hashed_tag_uid))),
+                                implode("', X'", array_merge(array($old_trustkey), defaultTrustKeys($hashed_tag_uid))));
+                    $result = dbQuery($shardCon, $query);
+                    //echo $query . " \n";
+
+                    if ($result && ($row = dbFetchRow($result))) {
+                        $secret_key_id = $row[0];
+                        $isDefaultKey = isDefaultTrustKey(bin2hex($row[1]), $hashed_tag_uid);
+                    }
+
+                    dbFreeResult($result);
                 }
 
-                mysqli_free_result($result);
+                // A trust organization PCD overwrites the trust key of an enrolled
+                // card whatever it currently holds.
+                if ($secret_key_id == -1 && $inTrustOrgMode) {
+                    $query = "SELECT id FROM `secretKeysTable` WHERE hashed_tag_uid=X'%s'";
+                    $result = dbQuery($shardCon, sprintf($query, $hashed_tag_uid));
+
+                    if ($result && ($row = dbFetchRow($result))) {
+                        $secret_key_id = $row[0];
+                    }
 
-                if($secret_key_id != -1 || $inTrustOrgMode) {
-                    $new_block2data = md5hash($trustOrgId . $PCD_uid);
-                    $new_trustkey = sha256hash(random_bytes(8) . $old_trustkey);
-                    $bin_response = insertTrustKey($new_block2data, $new_trustkey, $PCD_uid, $secret_key_id);
+                    dbFreeResult($result);
+                }
+
+                if($secret_key_id != -1 && !isRotationDue($frame, $hashed_tag_uid, $riskLevel, $inTrustOrgMode, $isDefaultKey)) {
+                    // The card keeps its trust key, the PCD skips writing the tag.
+                    $bin_response = verifiedResponse($PCD_uid);
+                } elseif($secret_key_id != -1) {
+                    // Cards are migrated to the compact credential once the PCD writes it.
+                    list($new_block2data, $new_trustkey, $new_credential) = newCredential($old_trustkey, $PCD_uid, $frame["is_compact"]);
+                    if (insertTrustKey($new_block2data, $new_trustkey, $secret_key_id)) {
+                        // new Trust Key Will be:
+                        $bin_response = $new_credential;
+                        recordRotation($hashed_tag_uid, $riskLevel);
+                    }
                 }
 
                 if (empty($bin_response)){
@@ -180,6 +336,24 @@
 
         //echo bin2hex($bin_response); //For postman testing only.
         echo $bin_response;
+    } elseif (!isset($_GET["metrics"]) && !admitRequest("history")) {
+        // The history page and export are shed first under load.
+        echo shedRequest();
+    } elseif (isset($_GET["export"])) {
+        // Handle the rotation history export GET request.
+        $after = empty($_GET["after"]) ? false : parseExportCursor($_GET["after"]);
+        $limit = empty($_GET["limit"]) ? EXPORT_DEFAULT_LIMIT : min(EXPORT_MAX_LIMIT, max(1, intval($_GET["limit"])));
+
+        if (!empty($_GET["after"]) && $after === false) {
+            http_response_code(400);
+            echo "Malformed request!-08";
+        } else {
+            streamExport(array_keys($shardNodes), $after, $limit);
+        }
+    } elseif (isset($_GET["metrics"])) {
+        // Handle the metrics GET request.
+        header("Content-Type:application/json");
+        echo json_encode((object)cacheMetrics());
     } else {
         // Handle GET request.
         $page = 1;
@@ -187,25 +361,30 @@
             $page = max(1, intval($_GET["page"]));
         }
 
-        $offset = ($page-1) * 10;
+        $offset = ($page-1) * 20;
 
+        $data = array();
         try {
+            // The page is merged from the most recent rows of every shard node.
             $query = "SELECT hashed_blockdata, rolling_pass, created_on FROM `rollingPasswordTable` ".
-                    "ORDER BY created_on DESC LIMIT 20 OFFSET ".$offset;
-            $result = mysqli_query($con, $query);
-            $data = array();
+                    "ORDER BY created_on DESC LIMIT ".($offset + 20);
+
+            foreach (array_keys($shardNodes) as $name) {
+                $result = dbQuery(shardConnection($name), $query);
 
-            if ($result && mysqli_num_rows($result) > 0) {
-                while($row = mysqli_fetch_assoc($result)) {
+                while($result && ($row = dbFetchAssoc($result))) {
                      array_push($data, (object)[
                         "created_on" => $row["created_on"],
-                        "hashed_block2data" => $row["hashed_blockdata"],
-                        "rolling_password" => substr($row["rolling_pass"],0,10)."...".substr($row["rolling_pass"],-10),
+                        "hashed_block2data" => bin2hex($row["hashed_blockdata"]),
+                        "rolling_password" => substr(bin2hex($row["rolling_pass"]),0,10)."...".substr(bin2hex($row["rolling_pass"]),-10),
                     ]);
                 }
+
+                dbFreeResult($result);
             }
 
-            mysqli_free_result($result);
+            usort($data, function ($a, $b) { return strcmp($b->created_on, $a->created_on); });
+            $data = array_slice($data, $offset, 20);
         } catch (Exception $e) {
             //echo $e;
         }
@@ -221,5 +400,5 @@
 
     //echo $data;
     //echo json_encode($_SERVER);
-    mysqli_close($con);
+    dbClose($con);
 ?>
\ No newline at end of file
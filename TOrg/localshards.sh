@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs the trust organization API locally with N shard nodes, each being the
+# database <dbname>_<i> of the local MySQL server configured in db.php.
+#   Usage: ./localshards.sh <dbname> [shards] [port]
+# The main database <dbname> holding the devices must already exist. Extra
+# mysql client options e.g. -u root -p are read from MYSQL_OPTS.
+
+set -e
+
+DBNAME=${1:?"Usage: $0 <dbname> [shards] [port]"}
+SHARDS=${2:-4}
+PORT=${3:-8000}
+
+cd "$(dirname "$0")"
+
+i=0
+while [ "$i" -lt "$SHARDS" ]; do
+    mysql $MYSQL_OPTS -e "CREATE DATABASE IF NOT EXISTS \`${DBNAME}_$i\`"
+    if [ -z "$(mysql $MYSQL_OPTS -N -e "SHOW TABLES LIKE 'secretKeysTable'" "${DBNAME}_$i")" ]; then
+        mysql $MYSQL_OPTS "${DBNAME}_$i" < db.sql
+    fi
+    i=$((i + 1))
+done
+
+echo "Serving http://127.0.0.1:$PORT/index.php with $SHARDS shard nodes"
+TRUST_ORG_LOCAL_SHARDS=$SHARDS exec php -S 127.0.0.1:"$PORT"
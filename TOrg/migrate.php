@@ -0,0 +1,130 @@
+<?php
+	require 'db.php';
+
+	/* ------------------------------------------------------------- *
+        Migrates the hex string columns to the binary columns in db.sql.
+        Every hashed value and id is stored as a binary column half the size
+        of its hex string so the indexes are about half as big. The binary
+        copy of each column is filled in batches of MIGRATE_BATCH_ROWS rows
+        while the API is still running. The API must then be stopped for the
+        final swap of the columns and indexes. Run it from the command line
+        i.e. php migrate.php, it is safe to run again if interrupted. It
+        only applies to the mysql storage engine. Apply the migrations
+        folder first, the rebuilt indexes cover risk_level.
+    * ------------------------------------------------------------- */
+
+    define ("MIGRATE_BATCH_ROWS", 10000);
+
+	if (php_sapi_name() != "cli") {
+        http_response_code(403);
+        die();
+    }
+
+	// $migrations lists the hex columns per table with their binary definition
+    // and the statements rebuilding the indexes once the columns are swapped.
+	$migrations = array(
+        "devicesTable" => array(
+            "columns" => array("device_id" => "binary(8) NOT NULL"),
+            "indexes" => "ADD UNIQUE KEY `device_id` (`device_id`), ".
+                            "ADD KEY `device_lookup` (`device_id`, `is_trust_org`, `risk_level`)",
+        ),
+        "secretKeysTable" => array(
+            "columns" => array("hashed_tag_uid" => "binary(16) NOT NULL", "secret_key" => "binary(6) NOT NULL"),
+            "indexes" => "ADD UNIQUE KEY `hashed_tag_uid` (`hashed_tag_uid`), ".
+                            "ADD KEY `tag_lookup` (`hashed_tag_uid`, `secret_key`, `latest_rolling_id`)",
+        ),
+        "rollingPasswordTable" => array(
+            "columns" => array("hashed_blockdata" => "binary(16) DEFAULT NULL", "rolling_pass" => "binary(32) DEFAULT NULL"),
+            "indexes" => "",
+        ),
+        "rollingPasswordArchiveTable" => array(
+            "columns" => array("hashed_blockdata" => "binary(16) DEFAULT NULL", "rolling_pass" => "binary(32) DEFAULT NULL"),
+            "indexes" => "",
+        ),
+        "tapTelemetryTable" => array(
+            "columns" => array("device_id" => "binary(8) NOT NULL"),
+            "indexes" => "ADD KEY `device_created_on` (`device_id`, `created_on`)",
+        ),
+    );
+
+	// columnType returns the data type of the column or an empty string if
+    // the column doesn't exist.
+	function columnType($con, $table, $column) {
+        $query = "SELECT DATA_TYPE FROM information_schema.COLUMNS ".
+                    "WHERE TABLE_SCHEMA=DATABASE() AND TABLE_NAME='%s' AND COLUMN_NAME='%s'";
+        $result = mysqli_query($con, sprintf($query, $table, $column));
+        $row = mysqli_fetch_row($result);
+        mysqli_free_result($result);
+        return $row ? $row[0] : "";
+    }
+
+	// copyColumns fills the binary copies of the hex columns in batches of rows.
+	function copyColumns($con, $table, $columns) {
+        $result = mysqli_query($con, "SELECT MAX(id) FROM `$table`");
+        $max_id = (int)mysqli_fetch_row($result)[0];
+        mysqli_free_result($result);
+
+        $sets = array();
+        foreach (array_keys($columns) as $column) {
+            $sets[] = sprintf("`%s_bin`=UNHEX(`%s`)", $column, $column);
+        }
+
+        $sql = "UPDATE `%s` SET %s WHERE id BETWEEN %d AND %d";
+        for ($first_id = 0; $first_id <= $max_id; $first_id += MIGRATE_BATCH_ROWS) {
+            mysqli_query($con, sprintf($sql, $table, implode(", ", $sets), $first_id, $first_id + MIGRATE_BATCH_ROWS - 1));
+        }
+        echo sprintf("%s: copied %d rows\n", $table, $max_id);
+    }
+
+	$pending = array();
+	foreach ($migrations as $table => $migration) {
+        $columns = $migration["columns"];
+        if (columnType($con, $table, array_key_first($columns)) == "binary") {
+            echo sprintf("%s: already migrated\n", $table);
+            continue;
+        }
+
+        $added = array();
+        foreach ($columns as $column => $definition) {
+            if (columnType($con, $table, $column."_bin") == "") {
+                $added[] = sprintf("ADD COLUMN `%s_bin` %s AFTER `%s`",
+                                $column, str_replace("NOT NULL", "DEFAULT NULL", $definition), $column);
+            }
+        }
+        if (!empty($added)) {
+            mysqli_query($con, sprintf("ALTER TABLE `%s` %s", $table, implode(", ", $added)));
+        }
+
+        // New rows inserted by the API during the copy are picked up by the
+        // second pass made after the API is stopped.
+        copyColumns($con, $table, $columns);
+        $pending[$table] = $migration;
+    }
+
+	if (empty($pending)) {
+        mysqli_close($con);
+        exit(0);
+    }
+
+	echo "Stop the API then press enter to swap the columns.\n";
+	fgets(STDIN);
+
+	foreach ($pending as $table => $migration) {
+        copyColumns($con, $table, $migration["columns"]);
+
+        $changes = array();
+        foreach ($migration["columns"] as $column => $definition) {
+            $changes[] = sprintf("DROP COLUMN `%s`", $column);
+            $changes[] = sprintf("CHANGE COLUMN `%s_bin` `%s` %s", $column, $column, $definition);
+        }
+        if (!empty($migration["indexes"])) {
+            $changes[] = $migration["indexes"];
+        }
+
+        // Dropping the hex columns drops their indexes too.
+        mysqli_query($con, sprintf("ALTER TABLE `%s` %s", $table, implode(", ", $changes)));
+        echo sprintf("%s: migrated\n", $table);
+    }
+
+	mysqli_close($con);
+?>
@@ -0,0 +1,26 @@
+-- Adds the latest rolling password pointer to the secret keys and the archive
+-- table used by compact.php. Run once on databases created before db.sql had
+-- them, with the API stopped.
+
+ALTER TABLE `secretKeysTable`
+    ADD COLUMN `latest_rolling_id` int unsigned DEFAULT NULL AFTER `secret_key`;
+
+-- Ids are auto incremented thus the largest id per secret key is its most
+-- recent rolling password.
+UPDATE `secretKeysTable` AS s
+    JOIN (
+        SELECT `secret_key_id`, MAX(`id`) AS latest FROM `rollingPasswordTable` GROUP BY `secret_key_id`
+    ) AS r ON r.secret_key_id = s.id
+    SET s.latest_rolling_id = r.latest;
+
+CREATE TABLE `rollingPasswordArchiveTable` (
+    `id` int unsigned NOT NULL,
+    `hashed_blockdata` varchar(32) DEFAULT NULL,
+    `rolling_pass` varchar(64) DEFAULT NULL,
+    `created_on` datetime NOT NULL,
+    `updated_on` datetime NOT NULL,
+    `secret_key_id` int unsigned NOT NULL,
+    `archived_on` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (`id`),
+    KEY `secret_key_id` (`secret_key_id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
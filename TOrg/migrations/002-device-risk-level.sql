@@ -0,0 +1,11 @@
+-- Adds the risk level of the PCDs read by rotation.php and registry.php.
+-- Existing PCDs get the normal risk level. The device_lookup index covers it
+-- so that a registry miss is answered from the index alone. Run once on
+-- databases created before db.sql had it.
+-- SQLite databases use:
+--     ALTER TABLE devicesTable ADD COLUMN risk_level INTEGER NOT NULL DEFAULT 1;
+
+ALTER TABLE `devicesTable`
+    ADD COLUMN `risk_level` tinyint NOT NULL DEFAULT '1' AFTER `is_trust_org`,
+    DROP KEY `device_lookup`,
+    ADD KEY `device_lookup` (`device_id`, `is_trust_org`, `risk_level`);
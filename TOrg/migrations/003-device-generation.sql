@@ -0,0 +1,19 @@
+-- Adds the devices generation bumped by every change to devicesTable, read by
+-- registry.php to drop the cached PCDs. Run once on databases created before
+-- db.sql had it.
+-- SQLite databases use the statements of db.sqlite.sql instead.
+
+CREATE TABLE `devicesGenerationTable` (
+    `id` tinyint NOT NULL,
+    `generation` int unsigned NOT NULL DEFAULT '0',
+    PRIMARY KEY (`id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
+
+INSERT INTO `devicesGenerationTable` (`id`, `generation`) VALUES (1, 0);
+
+CREATE TRIGGER `devices_inserted` AFTER INSERT ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
+CREATE TRIGGER `devices_updated` AFTER UPDATE ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
+CREATE TRIGGER `devices_deleted` AFTER DELETE ON `devicesTable`
+    FOR EACH ROW UPDATE `devicesGenerationTable` SET `generation` = `generation` + 1 WHERE `id` = 1;
@@ -0,0 +1,122 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Device registry.
+        The PCDs looked up are held in the APCu shared memory so that the
+        device check of a request is a shared memory read instead of a query.
+        Each entry holds the is_trust_org flag and the risk level of a
+        registered PCD, an unknown PCD is held as a negative entry thus a
+        misbehaving or hostile PCD doesn't reach the database on every
+        request. At most DEVICE_NEGATIVE_MAX_ENTRIES negative entries are
+        added every DEVICE_NEGATIVE_TTL seconds, past it the unknown PCDs are
+        queried again.
+        Every change to devicesTable bumps the generation in
+        devicesGenerationTable through its triggers, see db.sql. The entries
+        are keyed by the generation, which a single worker reads again at
+        most once every DEVICE_GENERATION_TTL seconds, thus a registered,
+        removed or updated PCD is seen within that time. Entries of the past
+        generations expire.
+    * ------------------------------------------------------------- */
+
+    define ("DEVICE_PREFIX", "dev:");
+    define ("DEVICE_GENERATION_KEY", "dev-generation");
+    define ("DEVICE_GENERATION_TTL", 1);
+    define ("DEVICE_GENERATION_LOCK_KEY", "dev-generation:lock");
+    define ("DEVICE_GENERATION_LOCK_TTL", 5);
+    define ("DEVICE_ENTRY_TTL", 3600);
+    define ("DEVICE_NEGATIVE_TTL", 60);
+    define ("DEVICE_NEGATIVE_MAX_ENTRIES", 10000);
+    define ("DEVICE_UNKNOWN", "");
+
+	// deviceGeneration returns the current generation of devicesTable. It is
+    // held with the time it was read, once older than DEVICE_GENERATION_TTL
+    // the single worker adding the lock reads it again outside of any APCu
+    // call while the others keep using the stale generation. If it can't be
+    // read, e.g. before migration 003, the last known one or 0 is used.
+	function deviceGeneration() {
+        global $con;
+
+        $cached = apcu_fetch(DEVICE_GENERATION_KEY);
+        if ($cached !== false && time() - $cached[1] < DEVICE_GENERATION_TTL) {
+            return $cached[0];
+        }
+
+        $isRefresher = apcu_add(DEVICE_GENERATION_LOCK_KEY, 1, DEVICE_GENERATION_LOCK_TTL);
+        if (!$isRefresher && $cached !== false) {
+            return $cached[0];
+        }
+
+        $generation = $cached !== false ? $cached[0] : 0;
+        try {
+            $result = dbQuery($con, "SELECT generation FROM `devicesGenerationTable` WHERE id=1");
+            $row = dbFetchRow($result);
+            dbFreeResult($result);
+            if ($row) {
+                $generation = (int)$row[0];
+            }
+        } catch (Exception $e) {
+            //echo $e;
+        }
+
+        apcu_store(DEVICE_GENERATION_KEY, array($generation, time()));
+        if ($isRefresher) {
+            apcu_delete(DEVICE_GENERATION_LOCK_KEY);
+        }
+        return $generation;
+    }
+
+	// cacheDevice adds the registered PCD or the negative entry of an unknown
+    // one to the registry.
+	function cacheDevice($key, $device) {
+        if ($device !== false) {
+            apcu_store($key, chr($device[0] ? 1 : 0).chr($device[1]), DEVICE_ENTRY_TTL);
+            return;
+        }
+
+        $window = DEVICE_PREFIX."negative:".intdiv(time(), DEVICE_NEGATIVE_TTL);
+        apcu_add($window, 0, 2 * DEVICE_NEGATIVE_TTL);
+        if (apcu_inc($window) <= DEVICE_NEGATIVE_MAX_ENTRIES) {
+            apcu_store($key, DEVICE_UNKNOWN, DEVICE_NEGATIVE_TTL);
+        }
+    }
+
+	// findDevices returns the is_trust_org flag and the risk level of the
+    // registered PCDs by PCD ID. The registry is consulted first, the PCDs
+    // it doesn't hold are looked up in a single query.
+	function findDevices($deviceUids) {
+        global $con;
+
+        $devices = array();
+        $missing = array();
+        $isCached = isCacheEnabled();
+        $prefix = $isCached ? DEVICE_PREFIX.deviceGeneration().":" : "";
+
+        foreach ($deviceUids as $deviceUid) {
+            $entry = $isCached ? apcu_fetch($prefix.hex2bin($deviceUid)) : false;
+            if ($entry === false) {
+                $missing[] = $deviceUid;
+            } elseif ($entry !== DEVICE_UNKNOWN) {
+                $devices[$deviceUid] = array(ord($entry[0]) == 1, ord($entry[1]));
+            }
+        }
+
+        countMetric("device_registry_hits", count($deviceUids) - count($missing));
+        if (empty($missing)) {
+            return $devices;
+        }
+        countMetric("device_registry_misses", count($missing));
+
+        $query = "SELECT device_id, is_trust_org, risk_level FROM `devicesTable` WHERE device_id IN (X'%s')";
+        $result = dbQuery($con, sprintf($query, implode("', X'", $missing)));
+        while ($row = dbFetchRow($result)) {
+            $devices[bin2hex($row[0])] = array($row[1] == 1, (int)$row[2]);
+        }
+        dbFreeResult($result);
+
+        if ($isCached) {
+            foreach ($missing as $deviceUid) {
+                cacheDevice($prefix.hex2bin($deviceUid), $devices[$deviceUid] ?? false);
+            }
+        }
+        return $devices;
+    }
+?>
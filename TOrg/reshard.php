@@ -0,0 +1,107 @@
+<?php
+	require 'db.php';
+	require 'cache.php';
+	require 'shards.php';
+
+	/* ------------------------------------------------------------- *
+        Moves the cards whose owner changed from $previousShardNodes to
+        $shardNodes. A card is moved with its secret key and its rolling
+        passwords, the archived ones stay behind. The secret key row is
+        locked on the previous node during the move so a trust key rotation
+        racing with it fails and the PCD simply retries the tap. It is safe
+        to run again if interrupted. Run it from the command line i.e.
+        php reshard.php then empty $previousShardNodes. It only applies to
+        the mysql storage engine.
+    * ------------------------------------------------------------- */
+
+    define ("RESHARD_BATCH_KEYS", 1000);
+
+	if (php_sapi_name() != "cli") {
+        http_response_code(403);
+        die();
+    }
+
+	// moveCard copies the card to its new owner node then deletes it from
+    // the previous node. Returns true if the card was moved.
+	function moveCard($from, $to, $secret_key_id) {
+        try {
+            mysqli_begin_transaction($from);
+
+            $query = "SELECT hashed_tag_uid, secret_key, latest_rolling_id, created_on FROM `secretKeysTable` WHERE id=%d FOR UPDATE";
+            $result = mysqli_query($from, sprintf($query, $secret_key_id));
+            $card = mysqli_fetch_row($result);
+            mysqli_free_result($result);
+
+            if (!$card) {
+                mysqli_rollback($from);
+                return false;
+            }
+
+            $query = "SELECT id, hashed_blockdata, rolling_pass, created_on FROM `rollingPasswordTable` WHERE secret_key_id=%d ORDER BY id";
+            $result = mysqli_query($from, sprintf($query, $secret_key_id));
+            $rolling_passes = mysqli_fetch_all($result);
+            mysqli_free_result($result);
+
+            mysqli_begin_transaction($to);
+
+            // An existing card on the new owner was copied by an interrupted run.
+            $sql = "INSERT IGNORE INTO `secretKeysTable` (hashed_tag_uid, secret_key, created_on) VALUES(X'%s', X'%s', '%s')";
+            mysqli_query($to, sprintf($sql, bin2hex($card[0]), bin2hex($card[1]), $card[3]));
+
+            if (mysqli_affected_rows($to) == 1) {
+                $new_id = mysqli_insert_id($to);
+                $latest_id = null;
+
+                $sql = "INSERT INTO `rollingPasswordTable` (hashed_blockdata, rolling_pass, secret_key_id, created_on) ".
+                            "VALUES(X'%s', X'%s', %d, '%s')";
+                foreach ($rolling_passes as $row) {
+                    mysqli_query($to, sprintf($sql, bin2hex($row[1]), bin2hex($row[2]), $new_id, $row[3]));
+                    if ($row[0] == $card[2]) {
+                        $latest_id = mysqli_insert_id($to);
+                    }
+                }
+
+                $sql = "UPDATE `secretKeysTable` SET latest_rolling_id=%s WHERE id=%d";
+                mysqli_query($to, sprintf($sql, $latest_id ?? "NULL", $new_id));
+            }
+            mysqli_commit($to);
+
+            mysqli_query($from, sprintf("DELETE FROM `rollingPasswordTable` WHERE secret_key_id=%d", $secret_key_id));
+            mysqli_query($from, sprintf("DELETE FROM `secretKeysTable` WHERE id=%d", $secret_key_id));
+            return mysqli_commit($from);
+        } catch (Exception $e) {
+            mysqli_rollback($to);
+            mysqli_rollback($from);
+            echo $e->getMessage() . "\n";
+        }
+        return false;
+    }
+
+	$moved = 0;
+	foreach (array_keys($previousShardNodes) as $name) {
+        $from = shardConnection($name);
+        $last_id = 0;
+
+        do {
+            $query = "SELECT id, hashed_tag_uid FROM `secretKeysTable` WHERE id > %d ORDER BY id LIMIT %d";
+            $result = mysqli_query($from, sprintf($query, $last_id, RESHARD_BATCH_KEYS));
+            $cards = mysqli_fetch_all($result);
+            mysqli_free_result($result);
+
+            foreach ($cards as $card) {
+                $last_id = $card[0];
+                $owner = shardOwner($shardNodes, bin2hex($card[1]));
+
+                if ($owner != $name && moveCard($from, shardConnection($owner), $card[0])) {
+                    $moved++;
+                }
+            }
+        } while (count($cards) == RESHARD_BATCH_KEYS);
+
+        echo sprintf("%s: moved %d cards so far\n", $name, $moved);
+    }
+
+	echo "Empty \$previousShardNodes in db.php now.\n";
+
+	mysqli_close($con);
+?>
@@ -0,0 +1,80 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Rotation policy.
+        A verified trust key request from a PCD that sets SKIP_ROTATION_FLAG
+        only rotates the card's trust key when the policy of the PCD's risk
+        level (devicesTable.risk_level) says so, otherwise the PCD is told
+        the card was verified and it skips writing the tag. A trust key is
+        rotated once the card was tapped max taps times or max age seconds
+        after its last rotation, whichever comes first. New cards, cards
+        holding the default trust key and the trust organization PCDs are
+        always rotated.
+        The taps since the last rotation are counted in the APCu shared
+        memory, the trust key is rotated on every tap if it is unavailable
+        or the count was lost e.g. on a restart.
+    * ------------------------------------------------------------- */
+
+    define ("ROTATION_PREFIX", "rot:");
+    define ("RISK_LOW", 0);
+    define ("RISK_NORMAL", 1);
+    define ("RISK_HIGH", 2);
+
+	// $rotationPolicies lists risk level => (max taps, max age in seconds).
+	$rotationPolicies = array(
+        RISK_LOW    => array(20, 7 * 86400),   // e.g. PCDs inside the premises.
+        RISK_NORMAL => array(5, 86400),
+        RISK_HIGH   => array(1, 0),            // e.g. PCDs on the perimeter, rotates on every tap.
+    );
+
+	// isRotationDue returns true if the trust key of the card verified by the
+    // decoded trust key request frame must be rotated on this tap.
+	function isRotationDue($frame, $hashed_tag_uid, $riskLevel, $isTrustOrg, $isDefaultKey) {
+        if (!$frame["skips_rotation"] || $isTrustOrg || $isDefaultKey) {
+            return true;
+        }
+
+        // 48 bytes credentials are migrated to the compact one on their next tap.
+        if ($frame["is_compact"] && ord($frame["block2data"][0]) != CREDENTIAL_MAGIC) {
+            return true;
+        }
+        return shouldRotate($hashed_tag_uid, $riskLevel);
+    }
+
+	// shouldRotate returns true if the card's trust key must be rotated on this
+    // tap, otherwise the tap is counted.
+	function shouldRotate($hashed_tag_uid, $riskLevel) {
+        global $rotationPolicies;
+
+        list($max_taps, $max_age) = $rotationPolicies[$riskLevel] ?? $rotationPolicies[RISK_NORMAL];
+        if ($max_taps <= 1 || !isCacheEnabled()) {
+            return true;
+        }
+
+        // Holds the 4 bytes taps since the last rotation and its 4 bytes unix timestamp.
+        $state = apcu_fetch(ROTATION_PREFIX.hex2bin($hashed_tag_uid));
+        if ($state === false) {
+            return true;
+        }
+
+        $t = unpack("Ntaps/Nrotated_on", $state);
+        if ($t["taps"] + 1 >= $max_taps || time() - $t["rotated_on"] >= $max_age) {
+            return true;
+        }
+
+        apcu_store(ROTATION_PREFIX.hex2bin($hashed_tag_uid), pack("NN", $t["taps"] + 1, $t["rotated_on"]),
+            $t["rotated_on"] + $max_age - time());
+        countMetric("rotation_skipped");
+        return false;
+    }
+
+	// recordRotation restarts the card's count once its trust key is rotated.
+	function recordRotation($hashed_tag_uid, $riskLevel) {
+        global $rotationPolicies;
+
+        countMetric("rotation_done");
+        list($max_taps, $max_age) = $rotationPolicies[$riskLevel] ?? $rotationPolicies[RISK_NORMAL];
+        if ($max_taps > 1 && isCacheEnabled()) {
+            apcu_store(ROTATION_PREFIX.hex2bin($hashed_tag_uid), pack("NN", 0, time()), $max_age);
+        }
+    }
+?>
@@ -0,0 +1,106 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Sharding of the secret keys and the rolling passwords.
+        A card's secret key and rolling passwords live on the shard node that
+        owns its hashed tag UID on a consistent hash ring. Every node is
+        placed SHARD_VNODES times on the ring thus adding a node only moves
+        about 1/N of the cards. Routing is computed from $shardNodes alone
+        so any PHP worker on any web server routes a card the same way.
+
+        Resharding: move the current $shardNodes into $previousShardNodes,
+        add the new node to $shardNodes and run reshard.php. Till it is done
+        a card missing from its new owner is read from its previous owner.
+        Empty $previousShardNodes once reshard.php completes.
+    * ------------------------------------------------------------- */
+
+    define ("SHARD_VNODES", 64);
+
+	// shardRing returns the ring points sorted in ascending order and the
+    // node owning each of them.
+	function shardRing($nodes) {
+        static $rings = array();
+
+        $key = implode(",", array_keys($nodes));
+        if (!isset($rings[$key])) {
+            $ring = array();
+            foreach (array_keys($nodes) as $name) {
+                for ($i = 0; $i < SHARD_VNODES; $i++) {
+                    $ring[unpack("N", md5($name."#".$i, true))[1]] = $name;
+                }
+            }
+            ksort($ring);
+            $rings[$key] = array(array_keys($ring), array_values($ring));
+        }
+        return $rings[$key];
+    }
+
+	// shardOwner returns the name of the node owning the hashed tag UID i.e.
+    // the node of the first ring point at or after the hashed tag UID's point.
+	function shardOwner($nodes, $hashed_tag_uid) {
+        list($points, $owners) = shardRing($nodes);
+        $point = hexdec(substr($hashed_tag_uid, 0, 8));
+
+        $low = 0;
+        $high = count($points);
+        while ($low < $high) {
+            $mid = ($low + $high) >> 1;
+            if ($points[$mid] < $point) {
+                $low = $mid + 1;
+            } else {
+                $high = $mid;
+            }
+        }
+        return $owners[$low % count($points)];
+    }
+
+	// shardConnection returns the connection to the named node, connecting
+    // to it on first use.
+	function shardConnection($name) {
+        global $con;
+        global $shardNodes;
+        global $previousShardNodes;
+        static $connections = array();
+
+        if (!isset($connections[$name])) {
+            $node = $shardNodes[$name] ?? $previousShardNodes[$name];
+            if ($node == array(SERVERNAME, USERNAME, PASSWORD, DBNAME)) {
+                $connections[$name] = $con; // The node is the main database.
+            } else {
+                $connections[$name] = dbConnect($node[0], $node[1], $node[2], $node[3]);
+            }
+        }
+        return $connections[$name];
+    }
+
+	// locateShard returns the name of the node holding the card. While
+    // resharding, a card not yet moved to its new owner is on its previous one.
+	function locateShard($hashed_tag_uid) {
+        global $shardNodes;
+        global $previousShardNodes;
+
+        $owner = shardOwner($shardNodes, $hashed_tag_uid);
+        if (empty($previousShardNodes)) {
+            return $owner;
+        }
+
+        $previous = shardOwner($previousShardNodes, $hashed_tag_uid);
+        if ($previous == $owner) {
+            return $owner;
+        }
+
+        $query = "SELECT id FROM `secretKeysTable` WHERE hashed_tag_uid=X'%s'";
+        foreach (array($owner, $previous) as $name) {
+            $result = dbQuery(shardConnection($name), sprintf($query, $hashed_tag_uid));
+            $isFound = ($result && dbFetchRow($result));
+            dbFreeResult($result);
+
+            if ($isFound) {
+                if ($name == $previous) {
+                    countMetric("shard_previous_owner_reads");
+                }
+                return $name;
+            }
+        }
+        return $owner; // New cards are only enrolled on the new owner.
+    }
+?>
@@ -0,0 +1,130 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Storage engines.
+        The database is accessed through the db* functions below so that the
+        same queries run on either of the engines:
+        mysql  => MySQL server through mysqli, see db.sql.
+        sqlite => Embedded SQLite database file in WAL mode, see db.sqlite.sql.
+                  It suits single-site deployments serving a few hundred cards
+                  as there is no network hop to the database. The file is
+                  created on first use.
+        The engine is picked by STORAGE_ENGINE in db.php. The queries only
+        use the SQL understood by both e.g. X'..' literals, row values and
+        window functions. Each function works out the engine from the
+        connection it is given.
+    * ------------------------------------------------------------- */
+
+    define ("SQLITE_SCHEMA_FILE", __DIR__ . "/db.sqlite.sql");
+    define ("SQLITE_BUSY_TIMEOUT_MS", 5000);
+
+	if (function_exists("mysqli_report")) {
+        mysqli_report(MYSQLI_REPORT_ERROR | MYSQLI_REPORT_STRICT);
+    }
+
+	// dbConnect opens a connection to the database. SQLite databases other
+    // than DBNAME e.g. the local shard nodes are files next to SQLITE_FILE.
+	function dbConnect($server, $user, $password, $database, $engine = STORAGE_ENGINE) {
+        if ($engine != "sqlite") {
+            return mysqli_connect($server, $user, $password, $database);
+        }
+
+        $file = ($database == DBNAME) ? SQLITE_FILE : dirname(SQLITE_FILE) . "/" . $database . ".sqlite";
+        $isNew = !file_exists($file);
+
+        $con = new SQLite3($file);
+        $con->enableExceptions(true);
+        $con->busyTimeout(SQLITE_BUSY_TIMEOUT_MS);
+        $con->exec("PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; PRAGMA foreign_keys=ON;");
+
+        if ($isNew) {
+            $con->exec(file_get_contents(SQLITE_SCHEMA_FILE));
+        }
+        return $con;
+    }
+
+	function isSQLite($con) {
+        return $con instanceof SQLite3;
+    }
+
+	// dbQuery runs the query. Unbuffered results are streamed from the server
+    // as they are fetched, SQLite results are always streamed.
+	function dbQuery($con, $query, $isUnbuffered = false) {
+        if (isSQLite($con)) {
+            return $con->query($query);
+        }
+        return mysqli_query($con, $query, $isUnbuffered ? MYSQLI_USE_RESULT : MYSQLI_STORE_RESULT);
+    }
+
+	// dbFetchRow returns the next row as a numeric array or a falsy value if none is left.
+	function dbFetchRow($result) {
+        return ($result instanceof SQLite3Result) ? $result->fetchArray(SQLITE3_NUM) : mysqli_fetch_row($result);
+    }
+
+	// dbFetchAssoc returns the next row as an associative array or a falsy value if none is left.
+	function dbFetchAssoc($result) {
+        return ($result instanceof SQLite3Result) ? $result->fetchArray(SQLITE3_ASSOC) : mysqli_fetch_assoc($result);
+    }
+
+	// dbFetchAll returns the remaining rows as numeric arrays.
+	function dbFetchAll($result) {
+        $rows = array();
+        while ($row = dbFetchRow($result)) {
+            $rows[] = $row;
+        }
+        return $rows;
+    }
+
+	function dbFreeResult($result) {
+        if ($result instanceof SQLite3Result) {
+            $result->finalize();
+        } elseif ($result instanceof mysqli_result) {
+            mysqli_free_result($result);
+        }
+    }
+
+	function dbInsertId($con) {
+        return isSQLite($con) ? $con->lastInsertRowID() : mysqli_insert_id($con);
+    }
+
+	// dbFirstInsertId returns the id of the first row of a multi-row insert.
+    // MySQL reports the first id while SQLite reports the last one.
+	function dbFirstInsertId($con, $rows) {
+        return isSQLite($con) ? $con->lastInsertRowID() - $rows + 1 : mysqli_insert_id($con);
+    }
+
+	function dbAffectedRows($con) {
+        return isSQLite($con) ? $con->changes() : mysqli_affected_rows($con);
+    }
+
+	// dbBegin starts a transaction. SQLite takes the write lock upfront so that
+    // concurrent transactions wait on the busy timeout instead of failing.
+	function dbBegin($con) {
+        return isSQLite($con) ? $con->exec("BEGIN IMMEDIATE") : mysqli_begin_transaction($con);
+    }
+
+	function dbCommit($con) {
+        return isSQLite($con) ? $con->exec("COMMIT") : mysqli_commit($con);
+    }
+
+	function dbRollback($con) {
+        if (!isSQLite($con)) {
+            return mysqli_rollback($con);
+        }
+
+        try {
+            return $con->exec("ROLLBACK");
+        } catch (Exception $e) {
+            return false; // No transaction was active.
+        }
+    }
+
+	function dbClose($con) {
+        return isSQLite($con) ? $con->close() : mysqli_close($con);
+    }
+
+	// dbInsertIgnore returns the insert statement keyword skipping the rows
+    // that would violate a unique key.
+	function dbInsertIgnore($con) {
+        return isSQLite($con) ? "INSERT OR IGNORE" : "INSERT IGNORE";
+    }
+?>
@@ -0,0 +1,47 @@
+<?php
+	/* ------------------------------------------------------------- *
+        Session tokens.
+        The secret key response carries a session token that the PCD echoes
+        back in the trust key request. It holds the state resolved during the
+        secret key request so that the trust key request can be validated
+        with a single primary key lookup. It is 21 bytes long:
+        4 bytes => secret key id
+        4 bytes => rolling password id matched by the block 2 data
+        4 bytes => expiry unix timestamp
+        1 byte  => flags, bit 0: trust organization PCD, bit 1: default trust key,
+                   bits 2-3: risk level of the PCD
+        8 bytes => MAC, truncated HMAC-SHA256 over the fields above, the PCD
+                   ID and the hashed tag UID.
+    * ------------------------------------------------------------- */
+
+    define ("SESSION_TOKEN_SIZE", 21);
+    define ("SESSION_TOKEN_TTL", 30);
+    define ("TOKEN_FLAG_TRUST_ORG", 1);
+    define ("TOKEN_FLAG_DEFAULT_KEY", 2);
+    define ("TOKEN_RISK_SHIFT", 2);
+
+	function sessionTokenMac($fields, $deviceUid, $hashed_tag_uid) {
+        return substr(hash_hmac("sha256", $fields.$deviceUid.$hashed_tag_uid, SESSION_TOKEN_KEY, true), 0, 8);
+    }
+
+	function issueSessionToken($secretKeyId, $rollingPassId, $flags, $deviceUid, $hashed_tag_uid) {
+        $fields = pack("NNNC", $secretKeyId, $rollingPassId, time() + SESSION_TOKEN_TTL, $flags);
+        return $fields . sessionTokenMac($fields, $deviceUid, $hashed_tag_uid);
+    }
+
+	// verifySessionToken returns the token fields if the token was issued for
+    // this PCD and tag and it has not expired, otherwise false.
+	function verifySessionToken($token, $deviceUid, $hashed_tag_uid) {
+        if (strlen($token) != SESSION_TOKEN_SIZE) {
+            return false;
+        }
+
+        $fields = substr($token, 0, 13);
+        if (!hash_equals(sessionTokenMac($fields, $deviceUid, $hashed_tag_uid), substr($token, 13))) {
+            return false;
+        }
+
+        $t = unpack("Nsecret_key_id/Nrolling_pass_id/Nexpiry/Cflags", $fields);
+        return ($t["expiry"] >= time()) ? $t : false;
+    }
+?>
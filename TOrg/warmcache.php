@@ -0,0 +1,30 @@
+<?php
+	require 'db.php';
+	require 'cache.php';
+	require 'shards.php';
+
+	/* ------------------------------------------------------------- *
+        Warms the secret key cache from the snapshot file and the database.
+        APCu memory is reset whenever the web server restarts thus this must
+        be requested once from the server itself after every (re)start e.g.
+        curl http://localhost/rfid-based-auth/warmcache.php
+    * ------------------------------------------------------------- */
+
+	if (!in_array($_SERVER["REMOTE_ADDR"], array("127.0.0.1", "::1"))) {
+        http_response_code(403);
+        die();
+    }
+
+	$loaded = 0;
+	if (isCacheEnabled()) {
+        set_time_limit(0);
+        foreach (array_keys($shardNodes) as $name) {
+            $loaded += warmSecretKeyCache(shardConnection($name), CACHE_SNAPSHOT_FILE.".".$name);
+        }
+    }
+
+	header("Content-Type:application/json");
+	echo json_encode((object)["loaded" => $loaded, "metrics" => cacheMetrics()]);
+
+	dbClose($con);
+?>
@@ -0,0 +1,145 @@
+/*!
+ * @file avr-bench.ino
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part avr-bench package files. It cross compiles the hot paths
+ * of the rfid-plus-display PCD for the ATmega32U4 at 16 MHz and measures
+ * them when run under the sim-bench simulator, see simBench.h. Each routine
+ * runs ITERATIONS times between the markers and its cycles per run are
+ * reported, followed by the static, heap and peak stack SRAM usage.
+ * The transmitter files are copied in from rfid-plus-display by make bench.avr.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "transmitter.h"
+#include "simBench.h"
+
+// ITERATIONS defines the number of runs of each routine per measurement.
+constexpr byte ITERATIONS {32};
+
+// STACK_PAINT fills the free SRAM on reset. The bytes still holding it at
+// the end were never used by the stack.
+constexpr byte STACK_PAINT {0xC5};
+
+// Symbols provided by the avr-libc linker script and malloc.
+extern "C" {
+    extern uint8_t __data_start;
+    extern uint8_t _end;
+    extern uint8_t __stack;
+    extern char* __brkval;
+}
+
+// paintStack runs before the constructors while nothing is on the stack yet.
+void paintStack() __attribute__((naked, used, section(".init3")));
+void paintStack()
+{
+    for (uint8_t* p {&_end}; p <= &__stack; ++p)
+        *p = STACK_PAINT;
+}
+
+// sendName writes the name of the next measurement.
+void sendName(const char* name)
+{
+    while (*name)
+        GPIOR2 = *name++;
+}
+
+// sendValue writes the value of the next measurement.
+void sendValue(uint16_t value)
+{
+    GPIOR1 = value >> 8;
+    GPIOR1 = value & 0xFF;
+}
+
+// report reports a value measured by the firmware itself.
+void report(const char* name, uint16_t value)
+{
+    sendName(name);
+    sendValue(value);
+    GPIOR0 = SimBench::Report;
+}
+
+// measure counts the cycles of ITERATIONS runs of the routine.
+template <typename Routine>
+void measure(const char* name, Routine routine)
+{
+    sendName(name);
+    sendValue(ITERATIONS);
+
+    GPIOR0 = SimBench::Start;
+    for (byte i {0}; i < ITERATIONS; ++i)
+    {
+        routine();
+        asm volatile("" ::: "memory"); // the results must not be optimized away.
+    }
+    GPIOR0 = SimBench::Stop;
+}
+
+// The request frames are packed into globals as the compiler could otherwise
+// drop the unused stack copies.
+Settings::SecretKeyRequest secretKeyRequest;
+Settings::TrustKeyRequest trustKeyRequest;
+
+// Main function.
+int main(void)
+{
+    init();
+
+    // The same pins as the rfid-plus-display PCD, nothing is attached to them
+    // in the simulator.
+    Display view {12, 10, 11, 9, 8, 7, 6};
+    Transmitter rfid {23, 22, view};
+
+    byte block2Data[Settings::blockSize] {};
+    byte trustKey[Settings::TrustKeySize] {};
+    byte sessionToken[Settings::SessionTokenSize] {};
+    byte secretKey[MFRC522::MF_KEY_SIZE] {0x0A, 0x1B, 0x2C, 0x3D, 0x4E, 0x5F};
+
+    Display::Msg details {new char[80]{}, 0};
+    strcpy(details.text, "Initiating data extraction from the tag!  ");
+
+    measure("display.print", [&]() { view.print(details, 0, 1); });
+    measure("display.setDetailsMsg", [&]() { rfid.setDetailsMsg((char*)"Tag reading was successful!  ", false); });
+    measure("display.scroll", [&]() { rfid.printScreen(); });
+
+    measure("frame.secretKeyRequest", [&]() {
+        rfid.setRequestHeader(secretKeyRequest.header);
+        memcpy(secretKeyRequest.block2Data, block2Data, Settings::blockSize);
+    });
+    measure("frame.trustKeyRequest", [&]() {
+        rfid.setRequestHeader(trustKeyRequest.header);
+        memcpy(trustKeyRequest.trustKey, trustKey, Settings::TrustKeySize);
+        memcpy(trustKeyRequest.sessionToken, sessionToken, Settings::SessionTokenSize);
+    });
+
+    measure("auth.setPICCAuthKeyB", [&]() { rfid.setPICCAuthKeyB(secretKey); });
+
+    // The software CRC_A of a read response replacing a coprocessor round trip.
+    byte crc[2];
+    measure("crc.readResponse", [&]() { Reader::calculateCrc(block2Data, Settings::blockSize, crc); });
+
+    // The stack grows down towards the heap, the untouched bytes right above
+    // the heap were never reached.
+    uint8_t* heapEnd {__brkval ? reinterpret_cast<uint8_t*>(__brkval) : &_end};
+    uint8_t* lowestUsed {heapEnd};
+    while (lowestUsed <= &__stack && *lowestUsed == STACK_PAINT)
+        ++lowestUsed;
+
+    report("sram.static", &_end - &__data_start);
+    report("sram.heap", heapEnd - &_end);
+    report("sram.stack", &__stack + 1 - lowestUsed);
+
+    GPIOR0 = SimBench::Done;
+    for (;;) { ; }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*!
+ * @file simBench.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part avr-bench package files. It defines the markers the
+ * benchmark firmware writes to talk to the sim-bench simulator. They are
+ * written into the general purpose I/O registers of the ATmega32U4 which
+ * have no side effect on the hardware and cost a single cycle each:
+ *      GPIOR2 => the next character of the measurement name.
+ *      GPIOR1 => the next byte of the measurement value, most significant first.
+ *      GPIOR0 => a Command completing the measurement.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __SIM_BENCH__
+#define __SIM_BENCH__
+
+#include <stdint.h>
+
+namespace SimBench
+{
+    // COMMAND_ADDR, VALUE_ADDR and NAME_ADDR define the data space addresses
+    // of GPIOR0, GPIOR1 and GPIOR2 on the ATmega32U4.
+    constexpr uint16_t COMMAND_ADDR {0x3E};
+    constexpr uint16_t VALUE_ADDR {0x4A};
+    constexpr uint16_t NAME_ADDR {0x4B};
+
+    // Command defines the values written into GPIOR0.
+    enum Command : uint8_t
+    {
+        Start = 1,  // Starts counting cycles, the value holds the iterations.
+        Stop,       // Reports the cycles counted per iteration since Start.
+        Report,     // Reports the value as is e.g. a memory usage in bytes.
+        Done,       // All the measurements were reported, stops the simulation.
+    };
+};
+
+#endif
@@ -0,0 +1,249 @@
+/*!
+ * @file sim-bench.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part avr-bench package files. It runs the avr-bench firmware
+ * on a simulated ATmega32U4 at 16 MHz, collects the measurements reported
+ * through the markers described in simBench.h and compares them against the
+ * stored baselines. Cycles are counted by simavr thus a run is exactly
+ * repeatable for a given firmware.
+ *
+ *  Usage: sim-bench [-b baselines] [-t tolerance] [-u] firmware.elf
+ *      -b  baselines file holding a "name value" line per measurement.
+ *      -t  allowed increase in percent over a baseline, defaults to 2.
+ *      -u  overwrites the baselines file with the measured values.
+ *  Exits with 1 if a measurement exceeds its baseline by more than the
+ *  tolerance, has no baseline or the firmware doesn't complete. Record the
+ *  baselines of new measurements with make bench.avr.baseline.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "../simBench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+
+// MCU_NAME and MCU_FREQUENCY define the simulated PCD microcontroller.
+constexpr const char* MCU_NAME {"atmega32u4"};
+constexpr uint32_t MCU_FREQUENCY {16000000};
+
+// MAX_CYCLES stops a firmware that never reports Done, about 4.5 simulated mins.
+constexpr avr_cycle_count_t MAX_CYCLES {1ULL << 32};
+
+// DEFAULT_TOLERANCE defines the default allowed increase in percent.
+constexpr double DEFAULT_TOLERANCE {2.0};
+
+// Measurement holds a single value reported by the firmware.
+struct Measurement
+{
+    std::string name;
+    uint64_t value;
+};
+
+// BenchState holds the partially received measurement.
+struct BenchState
+{
+    std::string name;
+    uint32_t value {0};
+    avr_cycle_count_t started {0};
+    bool isDone {false};
+    std::vector<Measurement> results;
+};
+
+// onName appends the character written into GPIOR2 to the name.
+void onName(avr_t*, avr_io_addr_t, uint8_t v, void* param)
+{
+    static_cast<BenchState*>(param)->name += static_cast<char>(v);
+}
+
+// onValue shifts the byte written into GPIOR1 into the value.
+void onValue(avr_t*, avr_io_addr_t, uint8_t v, void* param)
+{
+    BenchState* state {static_cast<BenchState*>(param)};
+    state->value = (state->value << 8) | v;
+}
+
+// onCommand handles the commands written into GPIOR0.
+void onCommand(avr_t* avr, avr_io_addr_t, uint8_t v, void* param)
+{
+    BenchState* state {static_cast<BenchState*>(param)};
+    switch (v)
+    {
+        case SimBench::Start:
+            state->started = avr->cycle;
+            return; // the name and iterations are used on Stop.
+
+        case SimBench::Stop:
+            state->results.push_back({state->name, (avr->cycle - state->started) / (state->value ? state->value : 1)});
+            break;
+
+        case SimBench::Report:
+            state->results.push_back({state->name, state->value});
+            break;
+
+        case SimBench::Done:
+            state->isDone = true;
+            avr->state = cpu_Done;
+            break;
+
+        default:
+            fprintf(stderr, "Unknown command %u from the firmware\n", v);
+            break;
+    }
+
+    state->name.clear();
+    state->value = 0;
+}
+
+// readBaselines returns the values of the baselines file by name.
+std::map<std::string, uint64_t> readBaselines(const std::string& path)
+{
+    std::map<std::string, uint64_t> baselines;
+    std::ifstream file {path};
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields {line};
+        std::string name;
+        uint64_t value;
+        if (line.empty() || line[0] == '#' || !(fields >> name >> value))
+            continue; // Skip the comments.
+        baselines[name] = value;
+    }
+    return baselines;
+}
+
+// writeBaselines overwrites the baselines file with the measurements.
+bool writeBaselines(const std::string& path, const std::vector<Measurement>& results)
+{
+    std::ofstream file {path, std::ios::trunc};
+    file << "# avr-bench baselines, cycles per run or bytes. Updated by make bench.avr.baseline\n";
+    for (const Measurement& result : results)
+        file << result.name << " " << result.value << "\n";
+    return file.good();
+}
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    std::string baselinesPath;
+    double tolerance {DEFAULT_TOLERANCE};
+    bool isUpdate {false};
+
+    int option;
+    while ((option = getopt(argc, argv, "b:t:u")) != -1)
+    {
+        switch (option)
+        {
+            case 'b': baselinesPath = optarg; break;
+            case 't': tolerance = atof(optarg); break;
+            case 'u': isUpdate = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-b baselines] [-t tolerance] [-u] firmware.elf\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc || (isUpdate && baselinesPath.empty()))
+    {
+        fprintf(stderr, "Usage: %s [-b baselines] [-t tolerance] [-u] firmware.elf\n", argv[0]);
+        return 1;
+    }
+
+    elf_firmware_t firmware {};
+    if (elf_read_firmware(argv[optind], &firmware) != 0)
+    {
+        fprintf(stderr, "Unable to read the firmware: %s\n", argv[optind]);
+        return 1;
+    }
+
+    avr_t* avr {avr_make_mcu_by_name(MCU_NAME)};
+    if (avr == nullptr)
+    {
+        fprintf(stderr, "simavr doesn't support the %s\n", MCU_NAME);
+        return 1;
+    }
+
+    avr_init(avr);
+    avr->frequency = MCU_FREQUENCY;
+    avr_load_firmware(avr, &firmware);
+
+    BenchState state;
+    avr_register_io_write(avr, SimBench::NAME_ADDR, onName, &state);
+    avr_register_io_write(avr, SimBench::VALUE_ADDR, onValue, &state);
+    avr_register_io_write(avr, SimBench::COMMAND_ADDR, onCommand, &state);
+
+    int cpuState {cpu_Running};
+    while (cpuState != cpu_Done && cpuState != cpu_Crashed && avr->cycle < MAX_CYCLES)
+        cpuState = avr_run(avr);
+
+    if (!state.isDone)
+    {
+        fprintf(stderr, "The firmware didn't complete after %llu cycles\n", (unsigned long long)avr->cycle);
+        return 1;
+    }
+
+    if (isUpdate)
+    {
+        if (!writeBaselines(baselinesPath, state.results))
+        {
+            fprintf(stderr, "Unable to write the baselines: %s\n", baselinesPath.c_str());
+            return 1;
+        }
+        printf("Updated %zu baselines in %s\n", state.results.size(), baselinesPath.c_str());
+        return 0;
+    }
+
+    std::map<std::string, uint64_t> baselines;
+    if (!baselinesPath.empty())
+        baselines = readBaselines(baselinesPath);
+
+    // A measurement without a baseline fails the run too, otherwise a missing
+    // or emptied baselines file lets every regression through.
+    int regressions {0};
+    int missing {0};
+    printf("%-28s %12s %12s %9s\n", "measurement", "value", "baseline", "change");
+    for (const Measurement& result : state.results)
+    {
+        auto baseline {baselines.find(result.name)};
+        if (baseline == baselines.end())
+        {
+            ++missing;
+            printf("%-28s %12llu %12s %9s\n", result.name.c_str(), (unsigned long long)result.value, "-", "new");
+            continue;
+        }
+
+        double change {baseline->second ? 100.0 * ((double)result.value - baseline->second) / baseline->second : 0.0};
+        bool isRegression {change > tolerance || (baseline->second == 0 && result.value > 0)};
+        regressions += isRegression;
+
+        printf("%-28s %12llu %12llu %+8.2f%%%s\n", result.name.c_str(), (unsigned long long)result.value,
+            (unsigned long long)baseline->second, change, isRegression ? " REGRESSED" : "");
+    }
+
+    if (missing > 0)
+        fprintf(stderr, "%d measurement(s) have no baseline, record them with make bench.avr.baseline\n", missing);
+    if (regressions > 0)
+        fprintf(stderr, "%d measurement(s) exceeded the %.2f%% tolerance\n", regressions, tolerance);
+    return (missing > 0 || regressions > 0) ? 1 : 0;
+}
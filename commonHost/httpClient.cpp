@@ -0,0 +1,325 @@
+/*!
+ * @file httpClient.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rfid-based-auth project files. It holds the minimal
+ * keep-alive HTTP/1.1 client shared between the host sub-projects i.e. the
+ * rfid-gateway and the edge-relay.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "httpClient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////
+// General Purpose Functions
+//////////////////////////////////////////////////
+
+// connectTo opens a TCP connection to the trust organization. Returns -1
+// on failure.
+static int connectTo(const HttpEndpoint& endpoint, int timeoutMs)
+{
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* results {nullptr};
+    if (getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &results) != 0)
+        return -1;
+
+    int sock {-1};
+    for (addrinfo* addr {results}; addr != nullptr; addr = addr->ai_next)
+    {
+        sock = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (sock < 0)
+            continue;
+
+        timeval timeout {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        int isEnabled {1};
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &isEnabled, sizeof(isEnabled));
+
+        if (connect(sock, addr->ai_addr, addr->ai_addrlen) == 0)
+            break;
+
+        close(sock);
+        sock = -1;
+    }
+
+    freeaddrinfo(results);
+    return sock;
+}
+
+// maxHeadersSize and maxBodySize bound the response accepted from the trust
+// organization, its responses are a few dozen bytes.
+static constexpr size_t maxHeadersSize {8192};
+static constexpr size_t maxBodySize {1 << 20};
+
+// sendAll writes the whole buffer into the socket.
+static bool sendAll(int sock, const std::string& data)
+{
+    size_t sent {0};
+    while (sent < data.size())
+    {
+        ssize_t n {send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)};
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// readResponse reads a single HTTP/1.1 response from the socket. Bytes read
+// past the current response are not expected as requests are never pipelined.
+// Returns false if the connection failed before a complete response was read,
+// isUnanswered is then set if it was closed before any response byte.
+static bool readResponse(int sock, int& status, std::string& body, bool& isKeptAlive,
+    bool& isUnanswered)
+{
+    std::string data;
+    char chunk[1024];
+    size_t headerEnd {std::string::npos};
+
+    // Read the status line and headers.
+    isUnanswered = false;
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (data.size() > maxHeadersSize)
+            return false;
+
+        ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+        if (n <= 0)
+        {
+            isUnanswered = (n == 0 && data.empty());
+            return false;
+        }
+        data.append(chunk, static_cast<size_t>(n));
+    }
+
+    std::string headers {data.substr(0, headerEnd)};
+    body = data.substr(headerEnd + 4);
+
+    if (sscanf(headers.c_str(), "HTTP/%*d.%*d %d", &status) != 1)
+        return false;
+
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    isKeptAlive = headers.find("connection: close") == std::string::npos;
+
+    size_t pos {headers.find("content-length:")};
+    if (pos != std::string::npos)
+    {
+        size_t length {0};
+        if (!parseSize(headers.substr(pos + 15), 10, maxBodySize, length))
+            return false;
+
+        while (body.size() < length)
+        {
+            ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+            if (n <= 0)
+                return false;
+            body.append(chunk, static_cast<size_t>(n));
+        }
+        body.resize(length);
+        return true;
+    }
+
+    if (headers.find("transfer-encoding: chunked") != std::string::npos)
+    {
+        std::string raw {body};
+        body.clear();
+
+        // Decode the chunks as they become available.
+        size_t offset {0};
+        for (;;)
+        {
+            size_t lineEnd {raw.find("\r\n", offset)};
+            if (lineEnd != std::string::npos)
+            {
+                size_t chunkSize {0};
+                if (!parseSize(raw.substr(offset, lineEnd - offset), 16, maxBodySize - body.size(), chunkSize))
+                    return false;
+
+                if (chunkSize == 0 && raw.find("\r\n\r\n", offset) != std::string::npos)
+                    return true;
+
+                size_t chunkEnd {lineEnd + 2 + chunkSize + 2};
+                if (chunkSize > 0 && raw.size() >= chunkEnd)
+                {
+                    body.append(raw, lineEnd + 2, chunkSize);
+                    offset = chunkEnd;
+                    continue;
+                }
+            }
+
+            if (raw.size() - offset > maxBodySize)
+                return false;
+
+            ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+            if (n <= 0)
+                return false;
+            raw.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+    // Neither length nor chunks are set, the body ends when the connection closes.
+    isKeptAlive = false;
+    for (;;)
+    {
+        ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return true;
+        if (body.size() > maxBodySize)
+            return false;
+        body.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+// parseSize parses the decimal or hexadecimal size at the start of a header
+// value or a chunk size line sent by the peer. Returns false if it is
+// malformed or larger than maxSize.
+bool parseSize(const std::string& text, int base, size_t maxSize, size_t& size)
+{
+    const char* start {text.c_str()};
+    while (*start == ' ' || *start == '\t')
+        ++start;
+
+    // strtoul accepts a sign, skips more whitespace and a 0x prefix in base
+    // 16, only digits are valid.
+    if (!isxdigit(static_cast<unsigned char>(*start)))
+        return false;
+    if (base == 16 && start[0] == '0' && (start[1] == 'x' || start[1] == 'X'))
+        return false;
+
+    char* end {nullptr};
+    errno = 0;
+    unsigned long value {strtoul(start, &end, base)};
+    if (errno == ERANGE || value > maxSize)
+        return false;
+
+    while (*end == ' ' || *end == '\t')
+        ++end;
+    if (*end != '\0' && *end != '\r' && *end != '\n' && *end != ';')
+        return false;
+
+    size = value;
+    return true;
+}
+
+///////////////////////////////////////////////////
+// HttpEndpoint Members
+//////////////////////////////////////////////////
+
+// parse splits a http://host[:port]/path url. Returns false if the url is
+// not supported. Only plain http is supported as used by the WiFi module.
+bool HttpEndpoint::parse(const std::string& url)
+{
+    const std::string scheme {"http://"};
+    if (url.compare(0, scheme.size(), scheme) != 0)
+        return false;
+
+    std::string rest {url.substr(scheme.size())};
+    size_t slash {rest.find('/')};
+    std::string authority {rest.substr(0, slash)};
+    path = (slash == std::string::npos) ? "/" : rest.substr(slash);
+
+    size_t colon {authority.find(':')};
+    host = authority.substr(0, colon);
+    if (colon != std::string::npos)
+        port = authority.substr(colon + 1);
+
+    return !host.empty();
+}
+
+///////////////////////////////////////////////////
+// HttpConnection Members
+//////////////////////////////////////////////////
+
+// HttpConnection constructor. The connection is lazily opened on the first
+// request.
+HttpConnection::HttpConnection(const HttpEndpoint& endpoint, int timeoutMs)
+    : m_endpoint {endpoint}, m_timeoutMs {timeoutMs}
+{
+}
+
+HttpConnection::~HttpConnection()
+{
+    if (m_sock >= 0)
+        close(m_sock);
+}
+
+// post sends the body to the path provided and reads back the response.
+// It reconnects once if a kept alive connection was closed by the server
+// in between requests. Returns the HTTP status code or a negative client
+// error code.
+int HttpConnection::post(const std::string& path, const char* contentType,
+    const std::string& body, std::string& reply)
+{
+    std::string request;
+    request.reserve(256 + body.size());
+    request += "POST " + path + " HTTP/1.1\r\n";
+    request += "Host: " + m_endpoint.host + "\r\n";
+    request += "Content-Type: " + std::string(contentType) + "\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    request += "Connection: keep-alive\r\n\r\n";
+    request += body;
+
+    for (int attempt {0}; attempt < 2; ++attempt)
+    {
+        bool isReused {m_sock >= 0};
+        if (!isReused)
+            m_sock = connectTo(m_endpoint, m_timeoutMs);
+
+        if (m_sock < 0)
+            return HTTPC_ERROR_CONNECTION_FAILED;
+
+        int status {0};
+        bool isKeptAlive {false};
+        bool isSent {sendAll(m_sock, request)};
+        bool isUnanswered {false};
+        if (isSent && readResponse(m_sock, status, reply, isKeptAlive, isUnanswered))
+        {
+            if (!isKeptAlive)
+            {
+                close(m_sock);
+                m_sock = -1;
+            }
+            return status;
+        }
+
+        close(m_sock);
+        m_sock = -1;
+
+        // Only a stale kept alive connection is retried i.e. the request
+        // couldn't be sent or the server closed it without answering. A POST
+        // isn't idempotent thus a timeout or a partial response never is, the
+        // trust key could be rotated twice.
+        if (!isReused || (isSent && !isUnanswered))
+            break;
+    }
+
+    return HTTPC_ERROR_NOT_CONNECTED;
+}
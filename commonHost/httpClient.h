@@ -0,0 +1,73 @@
+/*!
+ * @file httpClient.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rfid-based-auth project files. It holds the minimal
+ * keep-alive HTTP/1.1 client shared between the host sub-projects i.e. the
+ * rfid-gateway and the edge-relay.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef _COMMON_HOST_HTTP_CLIENT_
+#define _COMMON_HOST_HTTP_CLIENT_
+
+#include <string>
+
+// HttpEndpoint holds the parsed parts of the trust organization url.
+struct HttpEndpoint
+{
+    std::string host;
+    std::string port {"80"};
+    std::string path {"/"};
+
+    // parse splits a http://host[:port]/path url. Returns false if the url is
+    // not supported.
+    bool parse(const std::string& url);
+};
+
+// parseSize parses the decimal or hexadecimal (base 16) size at the start of
+// a header value or a chunk size line sent by the peer. Leading blanks are
+// skipped, the digits may be followed by blanks, a chunk extension or the end
+// of the line. Returns false if it is malformed or larger than maxSize.
+bool parseSize(const std::string& text, int base, size_t maxSize, size_t& size);
+
+// HttpConnection holds a single keep-alive connection to the endpoint. It is
+// not thread safe, each thread should use its own connection.
+class HttpConnection
+{
+    public:
+        // Client errors match the ones defined in the ESP8266HTTPClient.h class.
+        enum httpClientErr {
+            HTTPC_ERROR_CONNECTION_FAILED = -1,
+            HTTPC_ERROR_NOT_CONNECTED = -4,
+        };
+
+        explicit HttpConnection(const HttpEndpoint& endpoint, int timeoutMs);
+        ~HttpConnection();
+
+        HttpConnection(const HttpConnection&) = delete;
+        HttpConnection& operator=(const HttpConnection&) = delete;
+
+        // post sends the body to the path provided and reads back the response.
+        // It reconnects once if a kept alive connection was closed by the server
+        // in between requests. Returns the HTTP status code or a negative client
+        // error code.
+        int post(const std::string& path, const char* contentType,
+            const std::string& body, std::string& reply);
+
+    private:
+        HttpEndpoint m_endpoint;
+        int m_timeoutMs;
+        int m_sock {-1};
+};
+
+#endif
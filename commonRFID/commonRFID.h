@@ -4,8 +4,8 @@
  * @section intro_sec Introduction
  *
  * This file is part rfid-based-auth project files. It holds the common settings
- * configurations that are shared between rfid-plus-display and the wifi-module
- * sub-projects.
+ * configurations that are shared between rfid-plus-display, the wifi-module
+ * and the rfid-gateway sub-projects.
  *
  * @section author Author
  *
@@ -20,7 +20,14 @@
 #ifndef _COMMON_RFID_CONFIG_
 #define _COMMON_RFID_CONFIG_
 
+#ifdef ARDUINO
 #include "arduino.h"
+#else
+// Host builds e.g. the rfid-gateway only require the fixed width types.
+#include <cstddef>
+#include <cstdint>
+typedef uint8_t byte;
+#endif
 
 // IS_TRUST_ORG flag is used to indicate that the current PCD mode allows a trust
 // organization to over write blank memory space if no previous Trust Key exists.
@@ -37,7 +44,7 @@ namespace CommonRFID
 
     // SERVER_API_URL defines the trust organisation server API url that this
     // device supports.
-    static const char* SERVER_API_URL = {"http://dmigwi.atwebpages.com/rfid-based-auth/"};
+    static const char* const SERVER_API_URL = {"http://dmigwi.atwebpages.com/rfid-based-auth/"};
 
     // SERIAL_BAUD_RATE defines the data communication rate to be used during
     // serial communication.
@@ -51,6 +58,11 @@ namespace CommonRFID
     // authentication after the previous one finished.
     constexpr int AUTH_DELAY {5000};
 
+    // FRAME_READ_TIMEOUT defines how long in ms the WiFi module waits for more
+    // bytes of a frame on the serial link. Frames written closer together are
+    // read as one thus the PCD keeps them further apart.
+    constexpr int FRAME_READ_TIMEOUT {30};
+
     // blockSize defines the size of a block data that is read from
     // an NFC tag's sector with the Trust Key.
     constexpr int blockSize {16};
@@ -61,6 +73,135 @@ namespace CommonRFID
     // then 3 consecutive blocks will be adequate to store 384 bit/ 48 bytes.
     constexpr byte TrustKeySize{48};
 
+    // UidFieldSize defines the space reserved for the card's UID in the
+    // request frames. Shorter UIDs are padded with zeros.
+    constexpr byte UidFieldSize {10};
+
+    // SecretKeySize defines the size of the secret key that starts a successful
+    // secret key response.
+    constexpr byte SecretKeySize {6};
+
+    // SessionTokenSize defines the size of the session token appended by the
+    // trust organization to a successful secret key response. It is opaque
+    // to the PCD and is echoed back in the following trust key request so
+    // that the trust organization doesn't resolve the same state twice.
+    constexpr byte SessionTokenSize {21};
+
+    // The request frames and the responses are declared once as the packed
+    // structs below. The PCD fills the request fields in place and sends the
+    // struct bytes as they are, the uplinks read the fields in place over the
+    // received bytes. The trust organization unpacks the same layout, see
+    // decodeFrame in TOrg/frame.php.
+
+    // RequestHeader defines the header that starts every request frame.
+    typedef struct __attribute__((packed))
+    {
+        byte uidSize;                       // UID size, either of (4/7/10) | flags below
+        byte uid[UidFieldSize];             // card's UID Data
+        byte deviceId[sizeof(DEVICE_ID)];   // Current PCD's ID
+    } RequestHeader;
+
+    // SecretKeyRequest defines the frame sent when authenticating block 2 data.
+    typedef struct __attribute__((packed))
+    {
+        RequestHeader header;
+        byte block2Data[blockSize];
+    } SecretKeyRequest;
+
+    // TrustKeyRequest defines the frame sent when validating the trust key
+    // read from the tag. The session token is only sent if one came with the
+    // secret key.
+    typedef struct __attribute__((packed))
+    {
+        RequestHeader header;
+        byte trustKey[TrustKeySize];
+        byte sessionToken[SessionTokenSize];
+    } TrustKeyRequest;
+
+    // SecretKeyReply defines a successful secret key response. Older trust
+    // organizations and cached relay responses have no session token.
+    typedef struct __attribute__((packed))
+    {
+        byte secretKey[SecretKeySize];
+        byte sessionToken[SessionTokenSize];
+    } SecretKeyReply;
+
+    // TrustKeyReply defines a successful trust key response i.e. the new trust
+    // key to be written on the tag. Its last block holds the trust organization
+    // ID and the PCD ID that requested it.
+    typedef struct __attribute__((packed))
+    {
+        byte rollingKey[TrustKeySize - blockSize];
+        byte trustOrgId[sizeof(DEVICE_ID)];
+        byte deviceId[sizeof(DEVICE_ID)];
+    } TrustKeyReply;
+
+    // COMPACT_CREDENTIAL_FLAG is set in the RequestHeader's uidSize by the PCDs
+    // that write the compact credential below. The trust organization then
+    // returns the new trust key in the compact format, this migrates the
+    // 48 bytes cards on their next tap.
+    constexpr byte COMPACT_CREDENTIAL_FLAG {0x80};
+
+    // UID_SIZE_MASK extracts the UID size from the RequestHeader's uidSize.
+    constexpr byte UID_SIZE_MASK {0x0F};
+
+    // CREDENTIAL_MAGIC and CompactCredentialVersion start the reference block
+    // of a compact credential. A 48 bytes credential holds the trust
+    // organization ID there instead.
+    constexpr byte CREDENTIAL_MAGIC {0xC7};
+    constexpr byte CompactCredentialVersion {2};
+
+    // CompactCredentialSize defines the size of the compact credential stored
+    // in blocks 1 and 2 of the sector. Block 1 holds the rolling key and block 2
+    // the reference below, block 0 is no longer used. Block 2 is read while
+    // authenticating with KeyA thus a tap reads a single block with KeyB and
+    // writes two blocks instead of three.
+    // The compact credential is sent in the TrustKeyAuthDataSize layout with
+    // the rolling key zero padded to a full trust key.
+    constexpr byte CompactCredentialSize {2 * blockSize};
+
+    // CredentialReference defines the reference block of a compact credential.
+    // The trust organization resolves the leading bytes of its ID and the PCD
+    // ID held in it.
+    typedef struct __attribute__((packed))
+    {
+        byte magic;                         // CREDENTIAL_MAGIC
+        byte version;                       // CompactCredentialVersion
+        byte trustOrgRef[6];                // Leading bytes of the trust organization ID
+        byte deviceId[sizeof(DEVICE_ID)];   // ID of the PCD that wrote the credential
+    } CredentialReference;
+
+    // CompactTrustKeyReply defines a successful trust key response to a PCD
+    // that set the COMPACT_CREDENTIAL_FLAG. Its size and PCD ID position
+    // match the TrustKeyReply.
+    typedef struct __attribute__((packed))
+    {
+        byte rollingKey[blockSize];
+        CredentialReference reference;
+        byte trustOrgId[sizeof(DEVICE_ID)];
+        byte deviceId[sizeof(DEVICE_ID)];
+    } CompactTrustKeyReply;
+
+    // SKIP_ROTATION_FLAG is set in the RequestHeader's uidSize by the PCDs that
+    // accept a VerifiedReply. The trust organization then decides per card
+    // and per PCD whether the trust key is rotated on the tap.
+    constexpr byte SKIP_ROTATION_FLAG {0x40};
+
+    // NO_ROTATION_MARKER fills the first block of a VerifiedReply. A rotated
+    // trust key starting with a whole block of it is practically impossible.
+    constexpr byte NO_ROTATION_MARKER {0x5A};
+
+    // VerifiedReply defines a successful trust key response that keeps the
+    // card's trust key thus the tag isn't written. Its size and PCD ID
+    // position match the TrustKeyReply.
+    typedef struct __attribute__((packed))
+    {
+        byte marker[blockSize];             // NO_ROTATION_MARKER bytes
+        byte reserved[blockSize];
+        byte trustOrgId[sizeof(DEVICE_ID)];
+        byte deviceId[sizeof(DEVICE_ID)];
+    } VerifiedReply;
+
     // SecretKeyAuthDataSize defines the size of API data sent from PCD to the backend
     // servers when authenticating block 2 data. It contains:
     // 1 byte => UID size, either of (4/7/10)
@@ -69,7 +210,7 @@ namespace CommonRFID
     // 16 bytes => Block 2 Data
     // In total 35 bytes should be transmitted via the serial communication.
     // NB: Data is packaged in the order above as from byte zero.
-    constexpr byte SecretKeyAuthDataSize {35};
+    constexpr byte SecretKeyAuthDataSize {sizeof(SecretKeyRequest)};
 
     // TrustKeyAuthDataSize defines the size of API data sent from PCD to the backend
     // servers when validating a trust key read from the NFC tag. It contains:
@@ -79,11 +220,80 @@ namespace CommonRFID
     // 48 bytes => Trust Key Data
     // In total 67 bytes should be transmitted via the serial communication.
     // NB: Data is packaged in the order above as from byte zero.
-    constexpr byte TrustKeyAuthDataSize {67};
+    constexpr byte TrustKeyAuthDataSize {offsetof(TrustKeyRequest, sessionToken)};
+
+    // TrustKeyTokenAuthDataSize defines the size of API data sent from PCD to
+    // the backend servers when validating a trust key with a session token.
+    // It holds the TrustKeyAuthDataSize data followed by the session token.
+    // In total 88 bytes should be transmitted via the serial communication.
+    constexpr byte TrustKeyTokenAuthDataSize {sizeof(TrustKeyRequest)};
+
+    // The wire layout is shared with the deployed PCDs and the trust
+    // organization thus it must never change silently.
+    static_assert(offsetof(RequestHeader, uid) == 1 && offsetof(RequestHeader, deviceId) == 11 &&
+        sizeof(RequestHeader) == 19, "Request header layout changed");
+    static_assert(SecretKeyAuthDataSize == 35, "Secret key request layout changed");
+    static_assert(TrustKeyAuthDataSize == 67, "Trust key request layout changed");
+    static_assert(TrustKeyTokenAuthDataSize == 88, "Trust key request layout changed");
+    static_assert(sizeof(SecretKeyReply) == 27, "Secret key response layout changed");
+    static_assert(sizeof(TrustKeyReply) == TrustKeySize, "Trust key response layout changed");
+    static_assert(sizeof(CredentialReference) == blockSize, "Credential reference layout changed");
+    static_assert(sizeof(VerifiedReply) == TrustKeySize &&
+        offsetof(VerifiedReply, deviceId) == offsetof(TrustKeyReply, deviceId), "Trust key response layout changed");
+    static_assert(sizeof(CompactTrustKeyReply) == TrustKeySize &&
+        offsetof(CompactTrustKeyReply, deviceId) == offsetof(TrustKeyReply, deviceId), "Trust key response layout changed");
+
+    // TelemetryDataSize defines the size of a per-tap telemetry record sent
+    // from the PCD to the WiFi module once the tap completes. No response is
+    // expected for it thus it adds no round trip to the tap path. It contains:
+    // 1 byte => Telemetry marker (TELEMETRY_MARKER)
+    // 1 byte => Tap outcome (TapOutcome)
+    // 1 byte => RF retries i.e. card reactivations during the tap
+    // 1 byte => Last MFRC522 status code recorded
+    // 2 bytes => Tap sequence number
+    // 2 bytes => Read stage duration in ms
+    // 2 bytes => Network stage duration in ms
+    // 2 bytes => Write stage duration in ms
+    // 2 bytes => Total tap duration in ms
+    // 2 bytes => Reserved
+    // In total 16 bytes should be transmitted via the serial communication.
+    // NB: Multi-byte fields are packaged in little endian order.
+    constexpr byte TelemetryDataSize {16};
+
+    // TELEMETRY_MARKER is the first byte of every telemetry record. It allows
+    // the WiFi module to tell a telemetry record from corrupted request data.
+    constexpr byte TELEMETRY_MARKER {0xA7};
+
+    // TapOutcome defines the stage at which a tap completed.
+    enum TapOutcome : byte {
+        TapSuccess,             // Read, network and write stages succeeded.
+        TapReadFailed,          // Authentication or reading the tag failed.
+        TapNetworkFailed,       // Trust organization validation failed.
+        TapWriteFailed,         // Writing the new trust key failed.
+        TapVerified,            // Read and network stages succeeded, no rotation was due.
+    };
+
+    // TelemetryRecord defines the layout of a telemetry record described above.
+    typedef struct __attribute__((packed))
+    {
+        byte marker;
+        byte outcome;
+        byte retries;
+        byte status;
+        uint16_t sequence;
+        uint16_t readMs;
+        uint16_t networkMs;
+        uint16_t writeMs;
+        uint16_t totalMs;
+        uint16_t reserved;
+    } TelemetryRecord;
+
+    static_assert(sizeof(TelemetryRecord) == TelemetryDataSize, "Telemetry record layout changed");
 
     // MaxReqSize the maximum size of the data from the serial communication
     // can be read into contagious memory location.
-    constexpr int MaxReqSize {72};
+    constexpr int MaxReqSize {96};
+    static_assert(MaxReqSize >= TrustKeyTokenAuthDataSize, "Requests don't fit the serial buffer");
 
     // ACK_SIGNAL_SIZE defines the number of chars in the ack signal
     // including the null terminator.
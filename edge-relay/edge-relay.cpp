@@ -0,0 +1,97 @@
+/*!
+ * @file edge-relay.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part edge-relay package files. It parses the command line
+ * options and runs the relay.
+ *
+ *  Usage: edge-relay [-u url] [-l port] [-t seconds] [-s spool]
+ *      -u  trust organization API url, defaults to SERVER_API_URL.
+ *      -l  port to listen on for the LAN clients.
+ *      -t  time to live in seconds of the cached secret key responses.
+ *      -s  file holding the telemetry records not uploaded yet, defaults to
+ *          DEFAULT_TELEMETRY_SPOOL in the working directory.
+ *  Sending SIGUSR1 to the process prints the relay metrics at any time.
+ *
+ *  The WiFi modules discover the relay through the _rfid-relay._tcp mDNS
+ *  service. On hosts running avahi, copy rfid-relay.service into the
+ *  /etc/avahi/services directory to advertise it.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "relay.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    std::string url {Settings::SERVER_API_URL};
+    int port {Settings::DEFAULT_PORT};
+    int cacheTtl {Settings::DEFAULT_CACHE_TTL_SEC};
+    std::string spoolPath {Settings::DEFAULT_TELEMETRY_SPOOL};
+
+    int option;
+    while ((option = getopt(argc, argv, "u:l:t:s:")) != -1)
+    {
+        switch (option)
+        {
+            case 'u': url = optarg; break;
+            case 'l': port = atoi(optarg); break;
+            case 't': cacheTtl = atoi(optarg); break;
+            case 's': spoolPath = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-u url] [-l port] [-t seconds] [-s spool]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    HttpEndpoint endpoint;
+    if (!endpoint.parse(url))
+    {
+        fprintf(stderr, "Unsupported trust organization url: %s\n", url.c_str());
+        return 1;
+    }
+
+    // Block the handled signals before any thread is created so that they
+    // are only delivered to the main thread.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    EdgeRelay relay {endpoint, cacheTtl, spoolPath};
+    if (!relay.listen(port))
+        return 1;
+
+    std::thread(&EdgeRelay::run, &relay).detach();
+    printf("edge-relay listening on port %d, upstream %s\n", port, url.c_str());
+    fflush(stdout);
+
+    for (;;)
+    {
+        int signal {0};
+        sigwait(&signals, &signal);
+
+        relay.printStats();
+        if (signal != SIGUSR1)
+            break;
+    }
+
+    return 0;
+}
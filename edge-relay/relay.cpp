@@ -0,0 +1,578 @@
+/*!
+ * @file relay.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part edge-relay package files. The edge relay runs on a site
+ * server and speaks the trust organization protocol to the WiFi modules on
+ * the LAN. It proxies the requests to the trust organization over kept alive
+ * connections, caches the secret key responses and batches the telemetry
+ * uploads so that the slow WAN link is used as little as possible.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "relay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////
+// General Purpose Functions
+//////////////////////////////////////////////////
+
+// readRequest reads a single HTTP/1.1 request from the client connection.
+// Returns false if the connection was closed or the request is malformed.
+static bool readRequest(int fd, std::string& buffered, std::string& method,
+    std::string& target, std::string& body, bool& isKeptAlive)
+{
+    char chunk[1024];
+    size_t headerEnd;
+    while ((headerEnd = buffered.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (buffered.size() > 8192)
+            return false; // Headers are too large.
+
+        ssize_t n {recv(fd, chunk, sizeof(chunk), 0)};
+        if (n <= 0)
+            return false;
+        buffered.append(chunk, static_cast<size_t>(n));
+    }
+
+    std::string headers {buffered.substr(0, headerEnd)};
+    buffered.erase(0, headerEnd + 4);
+
+    size_t methodEnd {headers.find(' ')};
+    size_t targetEnd {headers.find(' ', methodEnd + 1)};
+    if (methodEnd == std::string::npos || targetEnd == std::string::npos)
+        return false;
+
+    method = headers.substr(0, methodEnd);
+    target = headers.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    isKeptAlive = headers.find("connection: close") == std::string::npos;
+
+    size_t length {0};
+    size_t pos {headers.find("content-length:")};
+    if (pos != std::string::npos && !parseSize(headers.substr(pos + 15), 10, Settings::MAX_BODY_SIZE, length))
+        return false; // Malformed or too large body.
+
+    while (buffered.size() < length)
+    {
+        ssize_t n {recv(fd, chunk, sizeof(chunk), 0)};
+        if (n <= 0)
+            return false;
+        buffered.append(chunk, static_cast<size_t>(n));
+    }
+
+    body = buffered.substr(0, length);
+    buffered.erase(0, length);
+    return true;
+}
+
+// writeResponse writes the HTTP/1.1 response to the client connection.
+static bool writeResponse(int fd, int status, const std::string& body, bool isKeptAlive)
+{
+    const char* reason {status == 200 ? "OK" : (status == 502 ? "Bad Gateway" :
+        (status == 503 ? "Service Unavailable" : "Error"))};
+
+    std::string response {"HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"};
+    response += "Content-Type: application/octet-stream\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    response += isKeptAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    response += body;
+
+    size_t sent {0};
+    while (sent < response.size())
+    {
+        ssize_t n {send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL)};
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// isSecretKeyReply returns true if the reply holds a secret key i.e. it is
+// exactly a secret key, or one followed by the session token, and isn't one
+// of the error texts the trust organization returns with HTTP 200.
+static bool isSecretKeyReply(const std::string& reply)
+{
+    static const char* const errors[] {"Malformed request!", "Hacking Attempt!", "Server busy!"};
+
+    if (reply.size() != Settings::SecretKeySize && reply.size() != sizeof(Settings::SecretKeyReply))
+        return false;
+
+    for (const char* error : errors)
+        if (reply.compare(0, strlen(error), error) == 0)
+            return false;
+    return true;
+}
+
+///////////////////////////////////////////////////
+// SecretKeyCache Members
+//////////////////////////////////////////////////
+
+SecretKeyCache::SecretKeyCache(int ttlSec, size_t maxEntries)
+    : m_ttl {ttlSec}, m_maxEntries {maxEntries}
+{
+}
+
+// lookup returns true and sets the reply if a fresh entry exists.
+bool SecretKeyCache::lookup(const std::string& request, std::string& reply)
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+
+    auto entry = m_entries.find(request);
+    if (entry == m_entries.end() || entry->second.expiry < Clock::now())
+    {
+        ++misses;
+        return false;
+    }
+
+    ++hits;
+    reply = entry->second.reply;
+    return true;
+}
+
+// store adds the reply to the cache, evicting the oldest entry if full.
+void SecretKeyCache::store(const std::string& request, const std::string& reply)
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+
+    if (m_entries.find(request) == m_entries.end())
+    {
+        while (m_entries.size() >= m_maxEntries && !m_insertOrder.empty())
+        {
+            m_entries.erase(m_insertOrder.front());
+            m_insertOrder.pop_front();
+        }
+        m_insertOrder.push_back(request);
+    }
+
+    m_entries[request] = Entry {reply, Clock::now() + m_ttl};
+}
+
+///////////////////////////////////////////////////
+// UpstreamPool Members
+//////////////////////////////////////////////////
+
+UpstreamPool::UpstreamPool(const HttpEndpoint& endpoint)
+    : m_endpoint {endpoint}
+{
+}
+
+// post sends the request on an idle connection, opening a new one if none
+// is available. The connection is returned to the pool afterwards.
+int UpstreamPool::post(const std::string& path, const char* contentType,
+    const std::string& body, std::string& reply)
+{
+    std::unique_ptr<HttpConnection> connection;
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if (!m_idle.empty())
+        {
+            connection = std::move(m_idle.back());
+            m_idle.pop_back();
+        }
+    }
+
+    if (!connection)
+        connection.reset(new HttpConnection(m_endpoint, Settings::CONNECTION_TIMEOUT_MS));
+
+    int status {connection->post(path, contentType, body, reply)};
+
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_idle.push_back(std::move(connection));
+    return status;
+}
+
+///////////////////////////////////////////////////
+// TelemetryBatcher Members
+//////////////////////////////////////////////////
+
+TelemetryBatcher::TelemetryBatcher(UpstreamPool& upstream, const std::string& spoolPath)
+    : m_upstream {upstream}, m_spoolPath {spoolPath}
+{
+    loadSpool();
+    m_flusher = std::thread(&TelemetryBatcher::flush, this);
+}
+
+TelemetryBatcher::~TelemetryBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_isStopping = true;
+    }
+    m_wakeUp.notify_all();
+    m_flusher.join();
+
+    if (m_spoolFd >= 0)
+        close(m_spoolFd);
+}
+
+// add buffers the records uploaded by the PCD with the given ID. They are
+// refused if the PCD already has too many buffered or the spool file can't
+// be written. The flusher is woken up early once a full batch is buffered.
+bool TelemetryBatcher::add(const std::string& deviceId, const std::string& records)
+{
+    const size_t batchSize {Settings::TELEMETRY_BATCH_RECORDS * Settings::TelemetryDataSize};
+    const size_t count {records.size() / Settings::TelemetryDataSize};
+
+    bool isFull {false};
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        std::string& pending {m_pending[deviceId]};
+
+        if (pending.size() + records.size() > Settings::TELEMETRY_MAX_PENDING_BATCHES * batchSize ||
+            !appendSpool(deviceId, records))
+        {
+            refused += count;
+            return false;
+        }
+
+        pending += records;
+        isFull = pending.size() >= batchSize;
+    }
+
+    received += count;
+    if (isFull)
+        m_wakeUp.notify_one();
+    return true;
+}
+
+// loadSpool buffers the records left in the spool file then opens it for the
+// new records. A truncated last entry, i.e. one that was never acknowledged,
+// is dropped.
+void TelemetryBatcher::loadSpool()
+{
+    const size_t idSize {sizeof(Settings::DEVICE_ID)};
+    const size_t headerSize {idSize + sizeof(uint32_t)};
+
+    std::string spool;
+    int fd {open(m_spoolPath.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd >= 0)
+    {
+        char chunk[4096];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+            spool.append(chunk, static_cast<size_t>(n));
+        close(fd);
+    }
+
+    for (size_t offset {0}; offset + headerSize <= spool.size();)
+    {
+        uint32_t size;
+        memcpy(&size, spool.data() + offset + idSize, sizeof(size));
+        if (size % Settings::TelemetryDataSize != 0 || offset + headerSize + size > spool.size())
+            break;
+
+        m_pending[spool.substr(offset, idSize)] += spool.substr(offset + headerSize, size);
+        offset += headerSize + size;
+    }
+
+    rewriteSpool();
+    if (m_spoolFd < 0)
+        fprintf(stderr, "Telemetry spool file %s can't be written, telemetry is refused: %s\n",
+            m_spoolPath.c_str(), strerror(errno));
+}
+
+// appendSpool writes the records to the spool file and syncs it. A partly
+// written entry is cut off again. Returns false on failure.
+bool TelemetryBatcher::appendSpool(const std::string& deviceId, const std::string& records)
+{
+    if (m_spoolFd < 0)
+        return false;
+
+    uint32_t size {static_cast<uint32_t>(records.size())};
+    std::string entry {deviceId};
+    entry.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    entry += records;
+
+    size_t written {0};
+    while (written < entry.size())
+    {
+        ssize_t n {write(m_spoolFd, entry.data() + written, entry.size() - written)};
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += static_cast<size_t>(n);
+    }
+
+    if (written < entry.size() || fdatasync(m_spoolFd) != 0)
+    {
+        if (ftruncate(m_spoolFd, m_spoolSize) != 0)
+            perror("Telemetry spool file truncate failed");
+        return false;
+    }
+
+    m_spoolSize += static_cast<off_t>(entry.size());
+    return true;
+}
+
+// rewriteSpool replaces the spool file with the buffered records. The new
+// file is synced before it is renamed over the old one thus a crash leaves
+// either of them.
+void TelemetryBatcher::rewriteSpool()
+{
+    std::string spool;
+    for (const auto& pending : m_pending)
+    {
+        if (pending.second.empty())
+            continue;
+
+        uint32_t size {static_cast<uint32_t>(pending.second.size())};
+        spool += pending.first;
+        spool.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        spool += pending.second;
+    }
+
+    const std::string tmpPath {m_spoolPath + ".tmp"};
+    int fd {open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600)};
+    if (fd < 0)
+        return; // The current spool file still holds the records.
+
+    size_t written {0};
+    while (written < spool.size())
+    {
+        ssize_t n {write(fd, spool.data() + written, spool.size() - written)};
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += static_cast<size_t>(n);
+    }
+
+    if (written < spool.size() || fdatasync(fd) != 0 || rename(tmpPath.c_str(), m_spoolPath.c_str()) != 0)
+    {
+        close(fd);
+        unlink(tmpPath.c_str());
+        return;
+    }
+
+    if (m_spoolFd >= 0)
+        close(m_spoolFd);
+    m_spoolFd = fd;
+    m_spoolSize = static_cast<off_t>(spool.size());
+}
+
+// flush uploads the buffered records in batches per PCD. Records whose
+// upload failed are kept for the next interval.
+void TelemetryBatcher::flush()
+{
+    const size_t batchSize {Settings::TELEMETRY_BATCH_RECORDS * Settings::TelemetryDataSize};
+    const std::string path {m_upstream.endpoint().path + Settings::TELEMETRY_API_QUERY};
+
+    std::unique_lock<std::mutex> lock {m_mutex};
+    while (!m_isStopping)
+    {
+        m_wakeUp.wait_for(lock, std::chrono::milliseconds(Settings::TELEMETRY_FLUSH_INTERVAL_MS));
+
+        std::map<std::string, std::string> batches;
+        batches.swap(m_pending);
+        lock.unlock();
+
+        std::map<std::string, size_t> batchSizes;
+        for (const auto& batch : batches)
+            batchSizes[batch.first] = batch.second.size();
+
+        for (auto& batch : batches)
+        {
+            const std::string& deviceId {batch.first};
+            std::string& records {batch.second};
+
+            while (!records.empty())
+            {
+                std::string body {deviceId + records.substr(0, batchSize)};
+                std::string reply;
+                if (m_upstream.post(path, "application/octet-stream", body, reply) != 200)
+                    break;
+
+                uploaded += (body.size() - deviceId.size()) / Settings::TelemetryDataSize;
+                records.erase(0, batchSize);
+            }
+        }
+
+        lock.lock();
+        bool isUploaded {false};
+        for (auto& batch : batches)
+        {
+            isUploaded = isUploaded || batch.second.size() < batchSizes[batch.first];
+            if (!batch.second.empty())
+                m_pending[batch.first].insert(0, batch.second);
+        }
+
+        // The spool file only shrinks once records were uploaded.
+        if (isUploaded)
+            rewriteSpool();
+    }
+}
+
+///////////////////////////////////////////////////
+// EdgeRelay Members
+//////////////////////////////////////////////////
+
+EdgeRelay::EdgeRelay(const HttpEndpoint& endpoint, int cacheTtlSec, const std::string& spoolPath)
+    : m_upstream {endpoint}, m_cache {cacheTtlSec, Settings::MAX_CACHE_ENTRIES},
+      m_telemetry {m_upstream, spoolPath}
+{
+}
+
+// listen binds the listening socket. Returns false on failure.
+bool EdgeRelay::listen(int port)
+{
+    m_listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+    {
+        perror("socket");
+        return false;
+    }
+
+    int isEnabled {1};
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &isEnabled, sizeof(isEnabled));
+
+    // Accept both IPv4 and IPv6 clients.
+    int isV6Only {0};
+    setsockopt(m_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &isV6Only, sizeof(isV6Only));
+
+    sockaddr_in6 addr {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(static_cast<uint16_t>(port));
+
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(m_listenFd, SOMAXCONN) != 0)
+    {
+        perror("bind");
+        return false;
+    }
+    return true;
+}
+
+// run accepts the LAN client connections on their own threads. A site has
+// a few dozen doors at most thus a thread per connection is adequate.
+void EdgeRelay::run()
+{
+    for (;;)
+    {
+        int fd {accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)};
+        if (fd < 0)
+        {
+            perror("accept");
+            continue;
+        }
+
+        std::thread(&EdgeRelay::serveClient, this, fd).detach();
+    }
+}
+
+// serveClient handles kept alive requests on a client connection.
+void EdgeRelay::serveClient(int fd)
+{
+    timeval timeout {Settings::CLIENT_IDLE_TIMEOUT_MS / 1000, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int isEnabled {1};
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &isEnabled, sizeof(isEnabled));
+
+    std::string buffered;
+    std::string method, target, body;
+    bool isKeptAlive {true};
+
+    while (isKeptAlive && readRequest(fd, buffered, method, target, body, isKeptAlive))
+    {
+        std::string reply;
+        int status {method == "POST" ? handleRequest(target, body, reply) : 405};
+
+        if (!writeResponse(fd, status, reply, isKeptAlive))
+            break;
+    }
+
+    close(fd);
+}
+
+// handleRequest handles a single request and returns the status code.
+//  - Telemetry uploads are acknowledged once spooled and batched upstream.
+//  - Secret key requests are served from the cache when possible.
+//  - Everything else, including trust key rotations, is forwarded as is.
+int EdgeRelay::handleRequest(const std::string& target, const std::string& body,
+    std::string& reply)
+{
+    const size_t idSize {sizeof(Settings::DEVICE_ID)};
+
+    if (target.find(Settings::TELEMETRY_API_QUERY) != std::string::npos)
+    {
+        size_t recordsSize {body.size() - std::min(body.size(), idSize)};
+        if (recordsSize == 0 || recordsSize % Settings::TelemetryDataSize != 0)
+        {
+            reply = "Malformed request!-07";
+            return 400;
+        }
+
+        if (!m_telemetry.add(body.substr(0, idSize), body.substr(idSize)))
+        {
+            reply = "Server busy!-11";
+            return 503;
+        }
+
+        reply = "OK";
+        return 200;
+    }
+
+    bool isSecretKeyRequest {body.size() == Settings::SecretKeyAuthDataSize};
+    if (isSecretKeyRequest && m_cache.lookup(body, reply))
+        return 200;
+
+    ++m_forwarded;
+    int status {m_upstream.post(m_upstream.endpoint().path,
+        "application/x-www-form-urlencoded", body, reply)};
+
+    if (status < 0)
+    {
+        ++m_upstreamFailures;
+        reply.clear();
+        return 502;
+    }
+
+    // Only the secret key of the successful responses is cached. The session
+    // token that follows it is issued per tap and expires shortly, a PCD
+    // served from the cache sends the trust key request without one.
+    if (isSecretKeyRequest && status == 200 && isSecretKeyReply(reply))
+        m_cache.store(body, reply.substr(0, Settings::SecretKeySize));
+
+    return status;
+}
+
+// printStats writes the relay metrics to the stdout.
+void EdgeRelay::printStats()
+{
+    uint64_t hits {m_cache.hits}, misses {m_cache.misses};
+    double hitRate {hits + misses ? 100.0 * hits / (hits + misses) : 0.0};
+
+    printf("forwarded: %llu, upstream failures: %llu, cache hits: %llu, misses: %llu (%.1f%%), "
+        "telemetry received: %llu, uploaded: %llu, refused: %llu\n",
+        static_cast<unsigned long long>(m_forwarded.load()),
+        static_cast<unsigned long long>(m_upstreamFailures.load()),
+        static_cast<unsigned long long>(hits), static_cast<unsigned long long>(misses), hitRate,
+        static_cast<unsigned long long>(m_telemetry.received.load()),
+        static_cast<unsigned long long>(m_telemetry.uploaded.load()),
+        static_cast<unsigned long long>(m_telemetry.refused.load()));
+    fflush(stdout);
+}
@@ -0,0 +1,223 @@
+/*!
+ * @file relay.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part edge-relay package files. The edge relay runs on a site
+ * server and speaks the trust organization protocol to the WiFi modules on
+ * the LAN. It proxies the requests to the trust organization over kept alive
+ * connections, caches the secret key responses and batches the telemetry
+ * uploads so that the slow WAN link is used as little as possible.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_EDGE_RELAY__
+#define __RFID_EDGE_RELAY__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "commonRFID.h"
+#include "httpClient.h"
+
+namespace Settings
+{
+    // Import the common settings configurations here.
+    using namespace CommonRFID;
+
+    // DEFAULT_PORT defines the port the relay listens on. It is advertised
+    // over mDNS as the _rfid-relay._tcp service.
+    constexpr int DEFAULT_PORT {8080};
+
+    // DEFAULT_CACHE_TTL_SEC defines how long a cached secret key response is
+    // served before the trust organization is consulted again.
+    constexpr int DEFAULT_CACHE_TTL_SEC {300};
+
+    // MAX_CACHE_ENTRIES bounds the secret key cache. The oldest entries are
+    // evicted first once it is reached.
+    constexpr size_t MAX_CACHE_ENTRIES {100000};
+
+    // CONNECTION_TIMEOUT_MS defines the send and receive timeout in ms on the
+    // trust organization connections.
+    constexpr int CONNECTION_TIMEOUT_MS {AUTH_DELAY};
+
+    // CLIENT_IDLE_TIMEOUT_MS defines how long an idle LAN client connection
+    // is kept open.
+    constexpr int CLIENT_IDLE_TIMEOUT_MS {30000};
+
+    // TELEMETRY_BATCH_RECORDS defines the maximum number of telemetry records
+    // accepted by the trust organization in a single upload.
+    constexpr size_t TELEMETRY_BATCH_RECORDS {64};
+
+    // TELEMETRY_FLUSH_INTERVAL_MS defines the interval at which the buffered
+    // telemetry records are uploaded upstream.
+    constexpr int TELEMETRY_FLUSH_INTERVAL_MS {10000};
+
+    // TELEMETRY_MAX_PENDING_BATCHES bounds the telemetry records buffered per
+    // PCD while upstream is unreachable. Past it the uploads are refused with
+    // 503 so that the WiFi module keeps them.
+    constexpr size_t TELEMETRY_MAX_PENDING_BATCHES {16};
+
+    // DEFAULT_TELEMETRY_SPOOL defines the file the buffered telemetry records
+    // are written to before they are acknowledged.
+    constexpr const char* DEFAULT_TELEMETRY_SPOOL {"edge-relay.spool"};
+
+    // MAX_BODY_SIZE defines the largest request body accepted from the LAN.
+    constexpr size_t MAX_BODY_SIZE {sizeof(DEVICE_ID) + TELEMETRY_BATCH_RECORDS * TelemetryDataSize};
+
+    // TELEMETRY_API_QUERY identifies the telemetry ingestion endpoint.
+    constexpr const char* TELEMETRY_API_QUERY {"?telemetry"};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// SecretKeyCache caches the successful secret key responses keyed by the
+// complete 35 bytes request i.e. the UID, the PCD's ID and block 2 data.
+// Secret keys never change after being issued, the TTL only bounds how long
+// a deregistered PCD or a rotated block 2 data keeps being served.
+class SecretKeyCache
+{
+    public:
+        SecretKeyCache(int ttlSec, size_t maxEntries);
+
+        // lookup returns true and sets the reply if a fresh entry exists.
+        bool lookup(const std::string& request, std::string& reply);
+
+        // store adds the reply to the cache, evicting the oldest entry if full.
+        void store(const std::string& request, const std::string& reply);
+
+        std::atomic<uint64_t> hits {0};
+        std::atomic<uint64_t> misses {0};
+
+    private:
+        struct Entry
+        {
+            std::string reply;
+            Clock::time_point expiry;
+        };
+
+        std::chrono::seconds m_ttl;
+        size_t m_maxEntries;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+        std::deque<std::string> m_insertOrder;
+};
+
+// UpstreamPool holds the kept alive connections to the trust organization.
+class UpstreamPool
+{
+    public:
+        explicit UpstreamPool(const HttpEndpoint& endpoint);
+
+        // post sends the request on an idle connection, opening a new one if
+        // none is available. Returns the HTTP status code or a negative client
+        // error code.
+        int post(const std::string& path, const char* contentType,
+            const std::string& body, std::string& reply);
+
+        const HttpEndpoint& endpoint() const { return m_endpoint; }
+
+    private:
+        HttpEndpoint m_endpoint;
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<HttpConnection>> m_idle;
+};
+
+// TelemetryBatcher accepts the telemetry uploads from the LAN once they are
+// written to the spool file and uploads them upstream in batches per PCD. The
+// spool file holds the records not uploaded yet, a restarted relay uploads
+// the ones left by the previous run.
+class TelemetryBatcher
+{
+    public:
+        TelemetryBatcher(UpstreamPool& upstream, const std::string& spoolPath);
+        ~TelemetryBatcher();
+
+        // add buffers the records uploaded by the PCD with the given ID.
+        // Returns false if they weren't stored thus the PCD has to keep them.
+        bool add(const std::string& deviceId, const std::string& records);
+
+        std::atomic<uint64_t> received {0};
+        std::atomic<uint64_t> uploaded {0};
+        std::atomic<uint64_t> refused {0};
+
+    private:
+        // flush uploads the buffered records till SIGINT or SIGTERM.
+        void flush();
+
+        // loadSpool buffers the records left in the spool file.
+        void loadSpool();
+
+        // appendSpool writes the records to the spool file and syncs it.
+        // Returns false on failure.
+        bool appendSpool(const std::string& deviceId, const std::string& records);
+
+        // rewriteSpool replaces the spool file with the buffered records.
+        void rewriteSpool();
+
+        UpstreamPool& m_upstream;
+        bool m_isStopping {false};
+
+        std::string m_spoolPath;
+        int m_spoolFd {-1};
+        off_t m_spoolSize {0};
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::map<std::string, std::string> m_pending;
+        std::thread m_flusher;
+};
+
+// EdgeRelay serves the LAN clients.
+class EdgeRelay
+{
+    public:
+        EdgeRelay(const HttpEndpoint& endpoint, int cacheTtlSec, const std::string& spoolPath);
+
+        // listen binds the listening socket. Returns false on failure.
+        bool listen(int port);
+
+        // run accepts the LAN client connections on their own threads.
+        void run();
+
+        // printStats writes the relay metrics to the stdout.
+        void printStats();
+
+    private:
+        // serveClient handles kept alive requests on a client connection.
+        void serveClient(int fd);
+
+        // handleRequest handles a single request and returns the status code.
+        int handleRequest(const std::string& target, const std::string& body,
+            std::string& reply);
+
+        UpstreamPool m_upstream;
+        SecretKeyCache m_cache;
+        TelemetryBatcher m_telemetry;
+        int m_listenFd {-1};
+
+        std::atomic<uint64_t> m_forwarded {0};
+        std::atomic<uint64_t> m_upstreamFailures {0};
+};
+
+#endif
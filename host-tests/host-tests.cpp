@@ -0,0 +1,483 @@
+/*!
+ * @file host-tests.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part host-tests package files. It checks the host built
+ * clients against a stub trust organization on the loopback and a PCD
+ * driven through a pty i.e. the shared HTTP client size parsing and its
+ * retry of stale kept alive connections, and the rfid-gateway ports staying
+ * open when drained and closing once hung up.
+ *
+ *  Usage: host-tests
+ *  Exits with a non zero status if any check fails.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "gateway.h"
+#include "httpClient.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+// failures counts the checks that failed so far.
+static int failures {0};
+
+// check prints the outcome of a single check.
+static void check(bool isPassed, const char* name)
+{
+    printf("%s %s\n", isPassed ? "PASS" : "FAIL", name);
+    if (!isPassed)
+        ++failures;
+}
+
+///////////////////////////////////////////////////
+// StubServer Members
+//////////////////////////////////////////////////
+
+// Reply lists the ways the stub trust organization answers a request.
+enum class Reply
+{
+    Answer,             // Answers and keeps the connection alive.
+    AnswerAndClose,     // Answers then closes the connection as if it idled out.
+    CloseUnanswered,    // Closes the connection without any response byte.
+    Partial,            // Sends the status line only then closes the connection.
+    Silent,             // Never answers, the client must time out.
+};
+
+// StubServer is a single threaded HTTP/1.1 server on the loopback serving
+// one connection at a time. Each request is answered with "OK" following
+// the script entry of its index, requests past the script are answered.
+class StubServer
+{
+    public:
+        explicit StubServer(const std::vector<Reply>& script);
+        ~StubServer();
+
+        // url returns the endpoint url of the server.
+        std::string url() const;
+
+        // stop closes the server and waits for it to exit. The counters are
+        // final once it returns.
+        void stop();
+
+        std::atomic<int> requests {0};
+        std::atomic<int> connections {0};
+
+    private:
+        // serve accepts the connections till the server is stopped.
+        void serve();
+
+        // readRequest reads a single request. Returns false once the client
+        // closed the connection.
+        bool readRequest(int sock);
+
+        std::vector<Reply> m_script;
+        int m_listenFd {-1};
+        int m_port {0};
+
+        std::mutex m_mutex;
+        int m_clientFd {-1};
+        bool m_isStopping {false};
+        std::thread m_thread;
+};
+
+// StubServer constructor listens on an ephemeral loopback port.
+StubServer::StubServer(const std::vector<Reply>& script)
+    : m_script {script}
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size {sizeof(addr)};
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), size) != 0 || listen(m_listenFd, 8) != 0 ||
+        getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &size) != 0)
+    {
+        perror("stub server");
+        exit(1);
+    }
+
+    m_port = ntohs(addr.sin_port);
+    m_thread = std::thread(&StubServer::serve, this);
+}
+
+StubServer::~StubServer()
+{
+    stop();
+}
+
+// url returns the endpoint url of the server.
+std::string StubServer::url() const
+{
+    return "http://127.0.0.1:" + std::to_string(m_port) + "/";
+}
+
+// stop closes the server and waits for it to exit.
+void StubServer::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_isStopping = true;
+        shutdown(m_listenFd, SHUT_RDWR);
+        if (m_clientFd >= 0)
+            shutdown(m_clientFd, SHUT_RDWR);
+    }
+
+    m_thread.join();
+    close(m_listenFd);
+}
+
+// serve accepts the connections till the server is stopped.
+void StubServer::serve()
+{
+    const std::string response {"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK"};
+
+    for (;;)
+    {
+        int sock {accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)};
+        if (sock < 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            if (m_isStopping)
+            {
+                close(sock);
+                return;
+            }
+            m_clientFd = sock;
+        }
+        ++connections;
+
+        bool isOpen {true};
+        while (isOpen && readRequest(sock))
+        {
+            int index {requests++};
+            Reply reply {index < static_cast<int>(m_script.size()) ? m_script[index] : Reply::Answer};
+
+            switch (reply)
+            {
+                case Reply::Answer:
+                    send(sock, response.data(), response.size(), MSG_NOSIGNAL);
+                    break;
+                case Reply::AnswerAndClose:
+                    send(sock, response.data(), response.size(), MSG_NOSIGNAL);
+                    isOpen = false;
+                    break;
+                case Reply::CloseUnanswered:
+                    isOpen = false;
+                    break;
+                case Reply::Partial:
+                    send(sock, "HTTP/1.1 200 OK\r\n", 17, MSG_NOSIGNAL);
+                    isOpen = false;
+                    break;
+                case Reply::Silent:
+                    isOpen = readRequest(sock); // Held till the client gives up.
+                    break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock {m_mutex};
+        close(sock);
+        m_clientFd = -1;
+    }
+}
+
+// readRequest reads a single request. Returns false once the client closed
+// the connection.
+bool StubServer::readRequest(int sock)
+{
+    std::string data;
+    char chunk[512];
+    size_t headerEnd {std::string::npos};
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+        if (n <= 0)
+            return false;
+        data.append(chunk, static_cast<size_t>(n));
+    }
+
+    size_t length {0};
+    size_t pos {data.find("Content-Length:")};
+    if (pos != std::string::npos && !parseSize(data.substr(pos + 15), 10, 1 << 20, length))
+        return false;
+
+    while (data.size() < headerEnd + 4 + length)
+    {
+        ssize_t n {recv(sock, chunk, sizeof(chunk), 0)};
+        if (n <= 0)
+            return false;
+        data.append(chunk, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////
+// HTTP Client Tests
+//////////////////////////////////////////////////
+
+// testParseSize checks the sizes accepted and rejected from the peer.
+static void testParseSize()
+{
+    struct Case
+    {
+        const char* text;
+        int base;
+        bool isValid;
+        size_t expected;
+    };
+
+    static const Case cases[] {
+        {"35", 10, true, 35},
+        {" \t35\r\n", 10, true, 35},
+        {"35 \t", 10, true, 35},
+        {"1a", 16, true, 26},
+        {"1A;name=value", 16, true, 26},
+        {"0", 16, true, 0},
+        {"100", 10, true, 100},
+        {"", 10, false, 0},
+        {"+5", 10, false, 0},
+        {"-5", 10, false, 0},
+        {" -5", 10, false, 0},
+        {"abc", 10, false, 0},
+        {"5x", 10, false, 0},
+        {"4 5", 10, false, 0},
+        {"0x10", 16, false, 0},
+        {"101", 10, false, 0},
+        {"65", 16, false, 0},
+        {"18446744073709551616", 10, false, 0},
+        {"ffffffffffffffffff", 16, false, 0},
+    };
+
+    for (const Case& c : cases)
+    {
+        size_t size {12345};
+        bool isValid {parseSize(c.text, c.base, 100, size)};
+
+        std::string name {"parseSize(\""};
+        for (const char* ch {c.text}; *ch != '\0'; ++ch)
+            name += (*ch == '\t') ? "\\t" : (*ch == '\r') ? "\\r" : (*ch == '\n') ? "\\n" : std::string(1, *ch);
+        name += "\", " + std::to_string(c.base) + ") " + (c.isValid ? "accepted" : "rejected");
+        check(isValid == c.isValid && (!isValid || size == c.expected) && (isValid || size == 12345), name.c_str());
+    }
+}
+
+// post sends a request on the connection and returns its status.
+static int post(HttpConnection& connection, std::string& reply)
+{
+    return connection.post("/", "application/octet-stream", "request", reply);
+}
+
+// testPostRetries checks that a POST is only resent when a kept alive
+// connection was closed by the server before any response byte.
+static void testPostRetries()
+{
+    HttpEndpoint endpoint;
+    std::string reply;
+
+    {
+        // The kept alive connection is closed after the first response.
+        StubServer server {{Reply::AnswerAndClose}};
+        endpoint.parse(server.url());
+        HttpConnection connection {endpoint, 1000};
+
+        int first {post(connection, reply)};
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        int second {post(connection, reply)};
+        server.stop();
+
+        check(first == 200 && second == 200 && reply == "OK", "post retries a stale kept alive connection");
+        check(server.requests == 2 && server.connections == 2, "post sends the stale request once more only");
+    }
+
+    {
+        // The reused connection never answers, the request may have been served.
+        StubServer server {{Reply::Answer, Reply::Silent}};
+        endpoint.parse(server.url());
+        HttpConnection connection {endpoint, 300};
+
+        int first {post(connection, reply)};
+        int second {post(connection, reply)};
+        server.stop();
+
+        check(first == 200 && second == HttpConnection::HTTPC_ERROR_NOT_CONNECTED, "post fails on a timeout");
+        check(server.requests == 2 && server.connections == 1, "post never resends after a timeout");
+    }
+
+    {
+        // The reused connection is closed part way through the response.
+        StubServer server {{Reply::Answer, Reply::Partial}};
+        endpoint.parse(server.url());
+        HttpConnection connection {endpoint, 1000};
+
+        int first {post(connection, reply)};
+        int second {post(connection, reply)};
+        server.stop();
+
+        check(first == 200 && second == HttpConnection::HTTPC_ERROR_NOT_CONNECTED, "post fails on a partial response");
+        check(server.requests == 2 && server.connections == 1, "post never resends a partially answered request");
+    }
+
+    {
+        // A new connection is closed unanswered thus it wasn't stale.
+        StubServer server {{Reply::CloseUnanswered}};
+        endpoint.parse(server.url());
+        HttpConnection connection {endpoint, 1000};
+
+        int status {post(connection, reply)};
+        server.stop();
+
+        check(status == HttpConnection::HTTPC_ERROR_NOT_CONNECTED, "post fails on a new connection closed unanswered");
+        check(server.requests == 1 && server.connections == 1, "post never resends on a new connection");
+    }
+}
+
+///////////////////////////////////////////////////
+// Gateway Tests
+//////////////////////////////////////////////////
+
+// exchange writes the frame to the PCD side of the pty and reads back up to
+// size bytes within the timeout.
+static std::string exchange(int fd, const void* frame, size_t frameSize, size_t size, int timeoutMs)
+{
+    if (write(fd, frame, frameSize) != static_cast<ssize_t>(frameSize))
+        return "";
+
+    std::string data;
+    Clock::time_point deadline {Clock::now() + std::chrono::milliseconds(timeoutMs)};
+    while (data.size() < size && Clock::now() < deadline)
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        pollfd pfd {fd, POLLIN, 0};
+        if (poll(&pfd, 1, static_cast<int>(left)) <= 0)
+            break;
+
+        char chunk[128];
+        ssize_t n {read(fd, chunk, std::min(sizeof(chunk), size - data.size()))};
+        if (n <= 0)
+            break;
+        data.append(chunk, static_cast<size_t>(n));
+    }
+    return data;
+}
+
+// isOpened returns true if the process holds a fd on the TTY.
+static bool isOpened(const std::string& name)
+{
+    bool isFound {false};
+    DIR* dir {opendir("/proc/self/fd")};
+    for (dirent* entry {readdir(dir)}; !isFound && entry != nullptr; entry = readdir(dir))
+    {
+        char target[256] {};
+        std::string path {"/proc/self/fd/" + std::string(entry->d_name)};
+        if (readlink(path.c_str(), target, sizeof(target) - 1) > 0)
+            isFound = name == std::string(target).substr(0, name.size()) &&
+                (target[name.size()] == '\0' || target[name.size()] == ' ');
+    }
+    closedir(dir);
+    return isFound;
+}
+
+// testGatewayPort drives a gateway port as a PCD through a pty. The gateway
+// opens the slave side as it does a USB TTY, the test holds the master side
+// thus closing it hangs up the port as unplugging the PCD would.
+static void testGatewayPort()
+{
+    StubServer server {{}};
+    HttpEndpoint endpoint;
+    endpoint.parse(server.url());
+
+    int pcd {posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC)};
+    if (pcd < 0 || grantpt(pcd) != 0 || unlockpt(pcd) != 0)
+    {
+        perror("posix_openpt");
+        check(false, "gateway pty created");
+        return;
+    }
+    std::string name {ptsname(pcd)};
+
+    Gateway gateway {endpoint, 1, 1};
+    check(gateway.addPort(name), "gateway opens the pty port");
+
+    std::thread loop {[&gateway]{ gateway.run(0); }};
+
+    const int ackSize {Settings::ACK_SIGNAL_SIZE - 1};
+    const int readySize {Settings::READY_SIGNAL_SIZE - 1};
+    std::string ready {Settings::READY_SIGNAL, static_cast<size_t>(readySize)};
+
+    check(exchange(pcd, Settings::ACK_SIGNAL, ackSize, readySize, 1000) == ready, "gateway answers ACK with READY");
+
+    // The port was drained by the first frame, it must still be served.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    check(exchange(pcd, Settings::ACK_SIGNAL, ackSize, readySize, 1000) == ready, "gateway keeps a drained port open");
+
+    byte request[Settings::SecretKeyAuthDataSize] {};
+    for (size_t i {0}; i < sizeof(request); ++i)
+        request[i] = static_cast<byte>(i + 1);
+    check(exchange(pcd, request, sizeof(request), 2, 2000) == "OK", "gateway forwards a request and its reply");
+    check(server.requests == 1, "gateway sends the request once");
+
+    // Unplug the PCD.
+    close(pcd);
+    bool isClosed {false};
+    for (int i {0}; i < 100 && !isClosed; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        isClosed = !isOpened(name);
+    }
+    check(isClosed, "gateway closes a hung up port");
+
+    pthread_kill(loop.native_handle(), SIGTERM);
+    loop.join();
+}
+
+// Main function.
+int main()
+{
+    // The gateway event loop handles the termination signals, block them
+    // before any thread is created so that they are only read by it.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    testParseSize();
+    testPostRetries();
+    testGatewayPort();
+
+    printf("%d check(s) failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
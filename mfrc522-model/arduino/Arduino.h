@@ -0,0 +1,110 @@
+/*!
+ * @file Arduino.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It is the host stand-in of
+ * the Arduino core API used by the MFRC522 library and the rfid-plus-display
+ * transmitter. Time is virtual, see hostBoard.h, thus delays return at once.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __HOST_ARDUINO__
+#define __HOST_ARDUINO__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t*>(address))
+
+// Flash strings are plain strings on the host.
+class __FlashStringHelper;
+#define F(string) (reinterpret_cast<const __FlashStringHelper*>(string))
+
+// min and max are functions rather than the core's macros so that they don't
+// clash with the standard library.
+template <typename T, typename U>
+inline auto min(const T& a, const U& b) -> decltype(a < b ? a : b) { return (b < a) ? b : a; }
+
+template <typename T, typename U>
+inline auto max(const T& a, const U& b) -> decltype(a < b ? a : b) { return (a < b) ? b : a; }
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// HostSerial stands in for the hardware and USB serials. The bytes written
+// are passed to the onWrite handler which may queue the bytes to be read
+// back e.g. the trust organization responses.
+class HostSerial
+{
+    public:
+        void begin(long) {}
+        void setTimeout(unsigned long timeout) { m_timeout = timeout; }
+
+        int available() { return static_cast<int>(m_input.size()); }
+        int read();
+
+        size_t write(uint8_t value) { return write(&value, 1); }
+        size_t write(const uint8_t* data, size_t size);
+
+        // readBytes waits upto the timeout in virtual time for the bytes.
+        size_t readBytes(uint8_t* buffer, size_t size);
+        size_t readBytes(char* buffer, size_t size) { return readBytes(reinterpret_cast<uint8_t*>(buffer), size); }
+
+        // The debug output of the MFRC522 library is discarded.
+        template <typename T> size_t print(const T&, int = DEC) { return 0; }
+        template <typename T> size_t println(const T&, int = DEC) { return 0; }
+        size_t println() { return 0; }
+
+        // queue adds bytes to be read.
+        void queue(const uint8_t* data, size_t size) { m_input.insert(m_input.end(), data, data + size); }
+
+        std::function<void(const uint8_t* data, size_t size)> onWrite;
+
+    private:
+        std::deque<uint8_t> m_input;
+        unsigned long m_timeout {1000};
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial1;
+
+#endif
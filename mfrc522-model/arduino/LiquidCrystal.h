@@ -0,0 +1,34 @@
+/*!
+ * @file LiquidCrystal.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It is the host stand-in of
+ * the LiquidCrystal library, nothing is displayed.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __HOST_LIQUID_CRYSTAL__
+#define __HOST_LIQUID_CRYSTAL__
+
+#include "Arduino.h"
+
+class LiquidCrystal
+{
+    public:
+        LiquidCrystal(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {}
+        void begin(uint8_t, uint8_t) {}
+        void clear() {}
+        void setCursor(uint8_t, uint8_t) {}
+        size_t print(const char* text) { return strlen(text); }
+};
+
+#endif
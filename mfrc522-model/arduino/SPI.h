@@ -0,0 +1,49 @@
+/*!
+ * @file SPI.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It is the host stand-in of
+ * the Arduino SPI library. The bytes are clocked into the chip model attached
+ * with HostBoard::attach while its chip select pin is low.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __HOST_SPI__
+#define __HOST_SPI__
+
+#include "Arduino.h"
+
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_MODE0 0x00
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+class SPISettings
+{
+    public:
+        SPISettings() {}
+        SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+    public:
+        void begin() {}
+        void end() {}
+        void beginTransaction(SPISettings) {}
+        void endTransaction() {}
+        uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,125 @@
+/*!
+ * @file hostBoard.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It implements the host
+ * stand-ins of the Arduino core and SPI library.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "hostBoard.h"
+#include "Arduino.h"
+#include "SPI.h"
+#include "chipModel.h"
+
+HostSerial Serial;
+HostSerial Serial1;
+SPIClass SPI;
+
+namespace
+{
+    ChipModel* attachedChip {nullptr};
+    uint8_t chipSelectPin {0xFF};
+    uint8_t irqPin {0xFF};
+    uint64_t clockNs {0};
+};
+
+///////////////////////////////////////////////////
+// Host Board
+//////////////////////////////////////////////////
+
+void HostBoard::attach(ChipModel& chip, uint8_t ssPin, uint8_t chipIrqPin)
+{
+    attachedChip = &chip;
+    chipSelectPin = ssPin;
+    irqPin = chipIrqPin;
+}
+
+void HostBoard::advance(uint64_t ns) { clockNs += ns; }
+
+uint64_t HostBoard::now() { return clockNs; }
+
+///////////////////////////////////////////////////
+// Arduino Core
+//////////////////////////////////////////////////
+
+unsigned long millis() { return static_cast<unsigned long>(clockNs / 1000000); }
+
+unsigned long micros() { return static_cast<unsigned long>(clockNs / 1000); }
+
+void delay(unsigned long ms) { HostBoard::advance(ms * 1000000ULL); }
+
+void delayMicroseconds(unsigned int us) { HostBoard::advance(us * 1000ULL); }
+
+// yield is called in the busy wait loops, each poll is about a microsecond
+// on the AVR thus a missed completion can't spin forever.
+void yield() { HostBoard::advance(1000); }
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (attachedChip != nullptr && pin == chipSelectPin)
+        attachedChip->select(value == LOW);
+}
+
+// digitalRead returns the chip's IRQ line, the other pins read high e.g. the
+// chip's reset pin while it is powered.
+int digitalRead(uint8_t pin)
+{
+    if (attachedChip != nullptr && pin == irqPin)
+        return attachedChip->irqLevel() ? HIGH : LOW;
+    return HIGH;
+}
+
+///////////////////////////////////////////////////
+// Serial
+//////////////////////////////////////////////////
+
+int HostSerial::read()
+{
+    if (m_input.empty())
+        return -1;
+
+    uint8_t value {m_input.front()};
+    m_input.pop_front();
+    return value;
+}
+
+size_t HostSerial::write(const uint8_t* data, size_t size)
+{
+    if (onWrite)
+        onWrite(data, size);
+    return size;
+}
+
+// readBytes returns the queued bytes at once. Missing bytes cost the whole
+// timeout as no more bytes arrive while the caller waits.
+size_t HostSerial::readBytes(uint8_t* buffer, size_t size)
+{
+    size_t count {0};
+    for (; count < size && !m_input.empty(); ++count)
+        buffer[count] = static_cast<uint8_t>(read());
+
+    if (count < size)
+        delay(m_timeout);
+    return count;
+}
+
+///////////////////////////////////////////////////
+// SPI
+//////////////////////////////////////////////////
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    return (attachedChip != nullptr) ? attachedChip->transfer(data) : 0xFF;
+}
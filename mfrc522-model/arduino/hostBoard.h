@@ -0,0 +1,40 @@
+/*!
+ * @file hostBoard.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It wires the chip model to
+ * the host stand-ins of the Arduino core and SPI library and keeps the
+ * virtual clock read by millis() and micros(). The clock advances on
+ * delays, serial timeouts and the SPI and RF time of the chip model.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __HOST_BOARD__
+#define __HOST_BOARD__
+
+#include <cstdint>
+
+class ChipModel;
+
+namespace HostBoard
+{
+    // attach wires the chip's NSS to the ssPin and its IRQ to the irqPin.
+    void attach(ChipModel& chip, uint8_t ssPin, uint8_t irqPin);
+
+    // advance moves the virtual clock forward.
+    void advance(uint64_t ns);
+
+    // now returns the virtual time in ns.
+    uint64_t now();
+};
+
+#endif
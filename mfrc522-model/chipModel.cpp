@@ -0,0 +1,610 @@
+/*!
+ * @file chipModel.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It implements the MFRC522
+ * register level model and the MIFARE Classic 1K PICC in its field.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "chipModel.h"
+#include "hostBoard.h"
+
+#include <cstring>
+
+// Registers and bits of the MFRC522 datasheet section 9 used by the model.
+namespace
+{
+    enum Register : uint8_t
+    {
+        CommandReg = 0x01, ComIEnReg = 0x02, DivIEnReg = 0x03, ComIrqReg = 0x04,
+        DivIrqReg = 0x05, ErrorReg = 0x06, Status1Reg = 0x07, Status2Reg = 0x08,
+        FIFODataReg = 0x09, FIFOLevelReg = 0x0A, WaterLevelReg = 0x0B, ControlReg = 0x0C,
+        BitFramingReg = 0x0D, CollReg = 0x0E, ModeReg = 0x11, TxModeReg = 0x12,
+        RxModeReg = 0x13, TxControlReg = 0x14, TxASKReg = 0x15, TxSelReg = 0x16,
+        RxSelReg = 0x17, RxThresholdReg = 0x18, DemodReg = 0x19, MfTxReg = 0x1C,
+        SerialSpeedReg = 0x1F, CRCResultRegH = 0x21, CRCResultRegL = 0x22,
+        ModWidthReg = 0x24, RFCfgReg = 0x26, GsNReg = 0x27, CWGsPReg = 0x28,
+        ModGsPReg = 0x29, TModeReg = 0x2A, TPrescalerReg = 0x2B, TReloadRegH = 0x2C,
+        TReloadRegL = 0x2D, VersionReg = 0x37,
+    };
+
+    enum Command : uint8_t
+    {
+        Idle = 0x0, Mem = 0x1, GenerateRandomID = 0x2, CalcCRC = 0x3, Transmit = 0x4,
+        NoCmdChange = 0x7, Receive = 0x8, Transceive = 0xC, MFAuthent = 0xE, SoftReset = 0xF,
+    };
+
+    // ComIrqReg bits.
+    constexpr uint8_t TxIRq {0x40};
+    constexpr uint8_t RxIRq {0x20};
+    constexpr uint8_t IdleIRq {0x10};
+    constexpr uint8_t TimerIRq {0x01};
+
+    // DivIrqReg bits.
+    constexpr uint8_t CRCIRq {0x04};
+
+    // Set1 selects setting rather than clearing the marked interrupt bits.
+    constexpr uint8_t Set1 {0x80};
+
+    // StartSend starts the transmission of a Transceive command.
+    constexpr uint8_t StartSend {0x80};
+
+    // FlushBuffer clears the FIFO.
+    constexpr uint8_t FlushBuffer {0x80};
+
+    // MFCrypto1On is set in Status2Reg after a successful MFAuthent.
+    constexpr uint8_t MFCrypto1On {0x08};
+
+    // PICC commands and responses.
+    constexpr uint8_t REQA {0x26};
+    constexpr uint8_t WUPA {0x52};
+    constexpr uint8_t SEL_CL1 {0x93};
+    constexpr uint8_t HLTA {0x50};
+    constexpr uint8_t MF_READ {0x30};
+    constexpr uint8_t MF_WRITE {0xA0};
+    constexpr uint8_t MF_AUTH_KEY_A {0x60};
+    constexpr uint8_t MF_ACK {0x0A};
+    constexpr uint8_t MF_NAK {0x04};
+    constexpr uint8_t SAK_MIFARE_1K {0x08};
+
+    // hasValidCrc returns true if the frame ends with its CRC_A.
+    bool hasValidCrc(const std::vector<uint8_t>& data)
+    {
+        if (data.size() < 3)
+            return false;
+        uint16_t crc {ChipModel::crcA(data.data(), data.size() - 2)};
+        return data[data.size() - 2] == (crc & 0xFF) && data[data.size() - 1] == (crc >> 8);
+    }
+
+    // appendCrc appends the CRC_A of the data.
+    void appendCrc(std::vector<uint8_t>& data)
+    {
+        uint16_t crc {ChipModel::crcA(data.data(), data.size())};
+        data.push_back(crc & 0xFF);
+        data.push_back(crc >> 8);
+    }
+};
+
+///////////////////////////////////////////////////
+// ChipCounters Members
+//////////////////////////////////////////////////
+
+ChipCounters ChipCounters::operator-(const ChipCounters& other) const
+{
+    ChipCounters delta {*this};
+    delta.spiBytes -= other.spiBytes;
+    delta.registerReads -= other.registerReads;
+    delta.registerWrites -= other.registerWrites;
+    delta.fifoBytes -= other.fifoBytes;
+    delta.commands -= other.commands;
+    delta.rfFrames -= other.rfFrames;
+    delta.irqAssertions -= other.irqAssertions;
+    delta.busNs -= other.busNs;
+    delta.rfNs -= other.rfNs;
+    return delta;
+}
+
+ChipCounters& ChipCounters::operator+=(const ChipCounters& other)
+{
+    spiBytes += other.spiBytes;
+    registerReads += other.registerReads;
+    registerWrites += other.registerWrites;
+    fifoBytes += other.fifoBytes;
+    commands += other.commands;
+    rfFrames += other.rfFrames;
+    irqAssertions += other.irqAssertions;
+    busNs += other.busNs;
+    rfNs += other.rfNs;
+    return *this;
+}
+
+///////////////////////////////////////////////////
+// PiccModel Class Members
+//////////////////////////////////////////////////
+
+// PiccModel constructor sets up a card in the factory transport
+// configuration i.e. all the sector keys are FF FF FF FF FF FF.
+PiccModel::PiccModel()
+{
+    const uint8_t uid[4] {0xDE, 0xAD, 0xBE, 0xEF};
+    setUid(uid);
+
+    memset(m_blocks, 0, sizeof(m_blocks));
+    const uint8_t trailer[16] {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    for (int sector {0}; sector < 16; ++sector)
+        memcpy(m_blocks[sector*4 + 3], trailer, sizeof(trailer));
+}
+
+void PiccModel::setPresent(bool isPresent)
+{
+    m_isPresent = isPresent;
+    reset();
+}
+
+void PiccModel::reset()
+{
+    m_state = Idle;
+    m_authSector = -1;
+    m_pendingWrite = -1;
+}
+
+// setUid also refreshes the manufacturer block i.e. the UID and its BCC.
+void PiccModel::setUid(const uint8_t uid[4])
+{
+    memcpy(m_uid, uid, sizeof(m_uid));
+    memcpy(m_blocks[0], uid, sizeof(m_uid));
+    m_blocks[0][4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+}
+
+bool PiccModel::handle(const Frame& request, Frame& response)
+{
+    response = {};
+    if (!m_isPresent || request.data.empty())
+        return false;
+
+    const std::vector<uint8_t>& data {request.data};
+
+    // Short frames i.e. 7 bits REQA and WUPA.
+    if (request.lastBits == 7 && data.size() == 1)
+    {
+        if ((data[0] == REQA && m_state == Idle) || (data[0] == WUPA && (m_state == Idle || m_state == Halt)))
+        {
+            m_state = Ready;
+            m_authSector = -1;
+            response.data = {0x04, 0x00}; // ATQA of a MIFARE Classic 1K.
+            return true;
+        }
+        return false;
+    }
+
+    if (m_state == Ready)
+    {
+        // Anticollision of cascade level 1 without any known UID bits.
+        if (data.size() == 2 && data[0] == SEL_CL1 && data[1] == 0x20)
+        {
+            response.data = {m_uid[0], m_uid[1], m_uid[2], m_uid[3], m_blocks[0][4]};
+            return true;
+        }
+
+        // Select of cascade level 1 with the whole UID and BCC.
+        if (data.size() == 9 && data[0] == SEL_CL1 && data[1] == 0x70 && hasValidCrc(data) &&
+            memcmp(&data[2], m_blocks[0], 5) == 0)
+        {
+            m_state = Active;
+            response.data = {SAK_MIFARE_1K};
+            appendCrc(response.data);
+            return true;
+        }
+
+        m_state = Idle; // Any other frame returns the card to IDLE.
+        return false;
+    }
+
+    if (m_state != Active || !hasValidCrc(data))
+        return false;
+
+    // The data frame of a write follows its acknowledged command frame.
+    if (m_pendingWrite >= 0)
+    {
+        if (data.size() == 18)
+            memcpy(m_blocks[m_pendingWrite], data.data(), 16);
+        m_pendingWrite = -1;
+
+        response.data = {(uint8_t)(data.size() == 18 ? MF_ACK : MF_NAK)};
+        response.lastBits = 4;
+        return true;
+    }
+
+    if (data.size() == 4 && data[0] == HLTA && data[1] == 0x00)
+    {
+        m_state = Halt; // HLTA is never answered.
+        m_authSector = -1;
+        return false;
+    }
+
+    if (data.size() == 4 && (data[0] == MF_READ || data[0] == MF_WRITE))
+    {
+        uint8_t blockAddr {data[1]};
+        if (blockAddr > 63 || m_authSector != blockAddr / 4)
+        {
+            m_state = Idle; // The card stops after a NAK.
+            response.data = {MF_NAK};
+            response.lastBits = 4;
+            return true;
+        }
+
+        if (data[0] == MF_READ)
+        {
+            response.data.assign(m_blocks[blockAddr], m_blocks[blockAddr] + 16);
+            appendCrc(response.data);
+            return true;
+        }
+
+        m_pendingWrite = blockAddr;
+        response.data = {MF_ACK};
+        response.lastBits = 4;
+        return true;
+    }
+    return false;
+}
+
+bool PiccModel::authenticate(uint8_t keyType, uint8_t blockAddr, const uint8_t* key, const uint8_t* uid)
+{
+    if (!m_isPresent || m_state != Active || blockAddr > 63 || memcmp(uid, m_uid, sizeof(m_uid)) != 0)
+        return false;
+
+    const uint8_t* trailer {m_blocks[blockAddr | 3]};
+    const uint8_t* sectorKey {(keyType == MF_AUTH_KEY_A) ? trailer : trailer + 10};
+    if (memcmp(key, sectorKey, 6) != 0)
+    {
+        reset();
+        return false;
+    }
+
+    m_authSector = blockAddr / 4;
+    return true;
+}
+
+///////////////////////////////////////////////////
+// ChipModel Class Members
+//////////////////////////////////////////////////
+
+ChipModel::ChipModel()
+{
+    softReset();
+}
+
+// softReset sets the reset values of the datasheet's register overview.
+void ChipModel::softReset()
+{
+    memset(m_registers, 0, sizeof(m_registers));
+    m_registers[CommandReg] = 0x20;
+    m_registers[ComIEnReg] = 0x80;
+    m_registers[ComIrqReg] = 0x14;
+    m_registers[Status1Reg] = 0x21;
+    m_registers[WaterLevelReg] = 0x08;
+    m_registers[ControlReg] = 0x10;
+    m_registers[CollReg] = 0x80;
+    m_registers[ModeReg] = 0x3F;
+    m_registers[TxControlReg] = 0x80;
+    m_registers[TxSelReg] = 0x10;
+    m_registers[RxSelReg] = 0x84;
+    m_registers[RxThresholdReg] = 0x84;
+    m_registers[DemodReg] = 0x4D;
+    m_registers[MfTxReg] = 0x62;
+    m_registers[SerialSpeedReg] = 0xEB;
+    m_registers[CRCResultRegH] = 0xFF;
+    m_registers[CRCResultRegL] = 0xFF;
+    m_registers[ModWidthReg] = 0x26;
+    m_registers[RFCfgReg] = 0x48;
+    m_registers[GsNReg] = 0x88;
+    m_registers[CWGsPReg] = 0x20;
+    m_registers[ModGsPReg] = 0x20;
+    m_registers[VersionReg] = ChipSettings::VERSION;
+
+    m_fifo.clear();
+    updateIrq();
+}
+
+void ChipModel::select(bool isSelected)
+{
+    m_isSelected = isSelected;
+    m_hasAddress = false;
+}
+
+// transfer follows the SPI framing of the datasheet section 8.1.2. The first
+// byte holds the address as (R/W, address[5..0], 0). On reads the byte
+// clocked out is the register addressed by the previous byte, on writes all
+// the following bytes are written into the same register.
+uint8_t ChipModel::transfer(uint8_t mosi)
+{
+    ++m_counters.spiBytes;
+    uint64_t busNs {8 * 1000000000ULL / ChipSettings::SPI_CLOCK_HZ};
+    m_counters.busNs += busNs;
+    HostBoard::advance(busNs);
+
+    if (!m_isSelected)
+        return 0xFF;
+
+    if (!m_hasAddress)
+    {
+        m_hasAddress = true;
+        m_isRead = (mosi & 0x80) != 0;
+        m_address = (mosi >> 1) & 0x3F;
+        return 0x00;
+    }
+
+    if (!m_isRead)
+    {
+        writeRegister(m_address, mosi);
+        return 0x00;
+    }
+
+    uint8_t value {readRegister(m_address)};
+    m_address = (mosi >> 1) & 0x3F;
+    return value;
+}
+
+bool ChipModel::irqLevel() const
+{
+    // IRqInv inverts the IRQ pin i.e. it is active low.
+    bool isInverted {(m_registers[ComIEnReg] & 0x80) != 0};
+    return isInverted ? !m_isIrqPending : m_isIrqPending;
+}
+
+uint8_t ChipModel::readRegister(uint8_t reg)
+{
+    ++m_counters.registerReads;
+    switch (reg)
+    {
+        case FIFODataReg:
+        {
+            ++m_counters.fifoBytes;
+            if (m_fifo.empty())
+                return 0x00;
+            uint8_t value {m_fifo.front()};
+            m_fifo.pop_front();
+            return value;
+        }
+
+        case FIFOLevelReg:
+            return static_cast<uint8_t>(m_fifo.size());
+
+        case Status1Reg:
+            // IRq, CRCReady and the FIFO alert bits are computed.
+            return (m_registers[Status1Reg] & 0xE0) | (m_isIrqPending ? 0x10 : 0x00) |
+                (m_fifo.empty() ? 0x01 : 0x00);
+
+        default:
+            return m_registers[reg];
+    }
+}
+
+void ChipModel::writeRegister(uint8_t reg, uint8_t value)
+{
+    ++m_counters.registerWrites;
+    switch (reg)
+    {
+        case CommandReg:
+            m_registers[CommandReg] = (m_registers[CommandReg] & 0x0F) | (value & 0x30);
+            if ((value & 0x0F) != NoCmdChange)
+                execute(value & 0x0F);
+            return;
+
+        case ComIrqReg:
+        case DivIrqReg:
+            if (value & Set1)
+                m_registers[reg] |= (value & 0x7F);
+            else
+                m_registers[reg] &= ~value;
+            updateIrq();
+            return;
+
+        case FIFODataReg:
+            ++m_counters.fifoBytes;
+            if (m_fifo.size() < ChipSettings::FIFO_SIZE)
+                m_fifo.push_back(value);
+            else
+                m_registers[ErrorReg] |= 0x10; // BufferOvfl
+            return;
+
+        case FIFOLevelReg:
+            if (value & FlushBuffer)
+            {
+                m_fifo.clear();
+                m_registers[ErrorReg] &= ~0x10;
+            }
+            return;
+
+        case BitFramingReg:
+            m_registers[BitFramingReg] = value & ~StartSend;
+            if ((value & StartSend) && (m_registers[CommandReg] & 0x0F) == Transceive)
+                transceive();
+            return;
+
+        case Status2Reg:
+            // Only MFCrypto1On can be cleared, the rest is read only.
+            m_registers[Status2Reg] = (m_registers[Status2Reg] & ~0xC8) | (value & 0xC0) |
+                (m_registers[Status2Reg] & value & MFCrypto1On);
+            return;
+
+        case ErrorReg:
+        case Status1Reg:
+        case CRCResultRegH:
+        case CRCResultRegL:
+        case VersionReg:
+            return; // Read only.
+
+        case ComIEnReg:
+        case DivIEnReg:
+            m_registers[reg] = value;
+            updateIrq();
+            return;
+
+        default:
+            m_registers[reg] = value;
+            return;
+    }
+}
+
+void ChipModel::execute(uint8_t command)
+{
+    ++m_counters.commands;
+    m_registers[CommandReg] = (m_registers[CommandReg] & 0x30) | command;
+
+    switch (command)
+    {
+        case SoftReset:
+            softReset();
+            return;
+
+        case CalcCRC:
+            calculateCrc();
+            return;
+
+        case MFAuthent:
+            authenticate();
+            return;
+
+        case Mem:
+        case GenerateRandomID:
+        case Transmit:
+        case Receive:
+            // Not used by the library, they complete at once.
+            m_registers[CommandReg] &= 0x30;
+            m_registers[ComIrqReg] |= IdleIRq;
+            updateIrq();
+            return;
+
+        default:
+            return; // Idle or Transceive waiting for StartSend.
+    }
+}
+
+void ChipModel::transceive()
+{
+    PiccModel::Frame request;
+    request.data.assign(m_fifo.begin(), m_fifo.end());
+    request.lastBits = m_registers[BitFramingReg] & 0x07;
+    m_fifo.clear();
+
+    ++m_counters.rfFrames;
+    m_registers[ErrorReg] = 0x00;
+    m_registers[ComIrqReg] |= TxIRq;
+
+    uint64_t txBits {request.data.size() * 9 - (request.lastBits ? 8 - request.lastBits : 0)};
+    advanceRf(txBits * ChipSettings::RF_BIT_NS);
+
+    PiccModel::Frame response;
+    if (!m_picc.handle(request, response))
+    {
+        // The timer started by TAuto at the end of the transmission expires.
+        advanceRf(timerTimeoutNs());
+        m_registers[ComIrqReg] |= TimerIRq;
+        updateIrq();
+        return;
+    }
+
+    uint64_t rxBits {response.data.size() * 9 - (response.lastBits ? 8 - response.lastBits : 0)};
+    advanceRf(ChipSettings::FRAME_DELAY_NS + rxBits * ChipSettings::RF_BIT_NS);
+
+    for (uint8_t value : response.data)
+        if (m_fifo.size() < ChipSettings::FIFO_SIZE)
+            m_fifo.push_back(value);
+
+    m_registers[ControlReg] = (m_registers[ControlReg] & ~0x07) | response.lastBits;
+    m_registers[ComIrqReg] |= RxIRq;
+    updateIrq();
+}
+
+// authenticate expects the FIFO to hold the auth command, the block address,
+// the 6 bytes key and the 4 bytes UID.
+void ChipModel::authenticate()
+{
+    uint8_t data[12] {};
+    for (int i {0}; i < 12 && !m_fifo.empty(); ++i)
+    {
+        data[i] = m_fifo.front();
+        m_fifo.pop_front();
+    }
+
+    ++m_counters.rfFrames;
+    m_registers[ErrorReg] = 0x00;
+
+    // Three passes of the authentication i.e. 2 + 4 + 8 bytes exchanged.
+    advanceRf(2 * ChipSettings::FRAME_DELAY_NS + 14 * 9 * ChipSettings::RF_BIT_NS);
+    if (!m_picc.authenticate(data[0], data[1], &data[2], &data[8]))
+    {
+        advanceRf(timerTimeoutNs());
+        m_registers[ComIrqReg] |= TimerIRq;
+        updateIrq();
+        return;
+    }
+
+    m_registers[Status2Reg] |= MFCrypto1On;
+    m_registers[CommandReg] &= 0x30;
+    m_registers[ComIrqReg] |= IdleIRq;
+    updateIrq();
+}
+
+void ChipModel::calculateCrc()
+{
+    static const uint16_t presets[4] {0x0000, 0x6363, 0xA671, 0xFFFF};
+
+    std::vector<uint8_t> data {m_fifo.begin(), m_fifo.end()};
+    m_fifo.clear();
+
+    uint16_t crc {crcA(data.data(), data.size(), presets[m_registers[ModeReg] & 0x03])};
+    m_registers[CRCResultRegL] = crc & 0xFF;
+    m_registers[CRCResultRegH] = crc >> 8;
+    m_registers[Status1Reg] |= 0x20; // CRCReady
+    m_registers[DivIrqReg] |= CRCIRq;
+    updateIrq();
+}
+
+uint64_t ChipModel::timerTimeoutNs() const
+{
+    // TPrescaler is 12 bits split over TModeReg and TPrescalerReg.
+    uint32_t prescaler {((m_registers[TModeReg] & 0x0Fu) << 8) | m_registers[TPrescalerReg]};
+    uint32_t reload {((uint32_t)m_registers[TReloadRegH] << 8) | m_registers[TReloadRegL]};
+    return static_cast<uint64_t>((2.0 * prescaler + 1) * (reload + 1) / ChipSettings::CARRIER_HZ * 1e9);
+}
+
+void ChipModel::advanceRf(uint64_t ns)
+{
+    m_counters.rfNs += ns;
+    HostBoard::advance(ns);
+}
+
+void ChipModel::updateIrq()
+{
+    bool isPending {(m_registers[ComIEnReg] & m_registers[ComIrqReg] & 0x7F) != 0 ||
+        (m_registers[DivIEnReg] & m_registers[DivIrqReg] & 0x14) != 0};
+    if (isPending && !m_isIrqPending)
+        ++m_counters.irqAssertions;
+    m_isIrqPending = isPending;
+}
+
+// crcA computes the CRC_A of ISO 14443-3 annex B i.e. the CRC-16/CCITT
+// polynomial processed LSB first.
+uint16_t ChipModel::crcA(const uint8_t* data, size_t size, uint16_t preset)
+{
+    uint16_t crc {preset};
+    for (size_t i {0}; i < size; ++i)
+    {
+        uint8_t value {static_cast<uint8_t>(data[i] ^ (crc & 0xFF))};
+        value ^= value << 4;
+        crc = (crc >> 8) ^ (value << 8) ^ (value << 3) ^ (value >> 4);
+    }
+    return crc;
+}
@@ -0,0 +1,191 @@
+/*!
+ * @file chipModel.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It is a host model of the
+ * MFRC522 reader chip at the register level i.e. the register file, the 64
+ * bytes FIFO, the timer unit, the CRC coprocessor and the IRQ line, with a
+ * MIFARE Classic 1K PICC in its field. It is driven over the SPI stand-in by
+ * the unmodified MFRC522 library and rfid-plus-display transmitter code so
+ * that driver changes can be measured without hardware.
+ * The RF and SPI bus time is not spent but accounted for in the counters and
+ * added to the host virtual clock, see hostBoard.h.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __MFRC522_CHIP_MODEL__
+#define __MFRC522_CHIP_MODEL__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace ChipSettings
+{
+    // SPI_CLOCK_HZ defines the SPI clock used by the MFRC522 library on a
+    // 16 MHz AVR i.e. SPI_CLOCK_DIV4.
+    constexpr uint32_t SPI_CLOCK_HZ {4000000};
+
+    // CARRIER_HZ defines the RF carrier the timer unit is clocked from.
+    constexpr double CARRIER_HZ {13.56e6};
+
+    // RF_BIT_NS defines the ISO 14443A bit duration at 106 kbit/s.
+    constexpr uint64_t RF_BIT_NS {9440};
+
+    // FRAME_DELAY_NS defines the PICC response delay after the PCD frame.
+    constexpr uint64_t FRAME_DELAY_NS {86000};
+
+    // FIFO_SIZE defines the size of the chip's FIFO buffer.
+    constexpr int FIFO_SIZE {64};
+
+    // VERSION defines the VersionReg value of a MFRC522 v2.0.
+    constexpr uint8_t VERSION {0x92};
+};
+
+// ChipCounters holds the activity counted by the model. Subtracting two
+// snapshots gives the activity of a single operation.
+struct ChipCounters
+{
+    uint64_t spiBytes {0};          // bytes clocked over SPI including address bytes.
+    uint64_t registerReads {0};
+    uint64_t registerWrites {0};
+    uint64_t fifoBytes {0};         // FIFODataReg reads and writes.
+    uint64_t commands {0};          // commands started in CommandReg.
+    uint64_t rfFrames {0};          // frames sent to the PICC.
+    uint64_t irqAssertions {0};     // times the IRQ line became active.
+    uint64_t busNs {0};             // SPI bus time.
+    uint64_t rfNs {0};              // RF time including the timer unit timeouts.
+
+    ChipCounters operator-(const ChipCounters& other) const;
+    ChipCounters& operator+=(const ChipCounters& other);
+};
+
+// PiccModel is a MIFARE Classic 1K card with a 4 bytes UID. It follows the
+// ISO 14443A activation states, the MIFARE authentication is checked against
+// the keys in the sector trailers but the Crypto1 stream isn't modelled.
+class PiccModel
+{
+    public:
+        // Frame defines a RF frame, lastBits holds the valid bits in the last
+        // byte with 0 meaning the whole byte.
+        struct Frame
+        {
+            std::vector<uint8_t> data;
+            uint8_t lastBits {0};
+        };
+
+        PiccModel();
+
+        // setPresent moves the card in or out of the field. A card entering
+        // the field is in the IDLE state.
+        void setPresent(bool isPresent);
+
+        // reset returns the card to the IDLE state as if it left and
+        // reentered the field.
+        void reset();
+
+        // setUid sets the 4 bytes UID.
+        void setUid(const uint8_t uid[4]);
+
+        // block returns the 16 bytes of the block.
+        uint8_t* block(uint8_t blockAddr) { return m_blocks[blockAddr & 0x3F]; }
+
+        // handle returns true and the response if the card answers the frame.
+        bool handle(const Frame& request, Frame& response);
+
+        // authenticate returns true if the key matches the block's sector
+        // trailer key of the type requested. The card stops answering till
+        // it is woken up again on failure.
+        bool authenticate(uint8_t keyType, uint8_t blockAddr, const uint8_t* key, const uint8_t* uid);
+
+    private:
+        enum State { Idle, Ready, Active, Halt };
+
+        bool m_isPresent {true};
+        State m_state {Idle};
+        int m_authSector {-1};
+        int m_pendingWrite {-1};
+        uint8_t m_uid[4];
+        uint8_t m_blocks[64][16];
+};
+
+// ChipModel is the MFRC522 register level model.
+class ChipModel
+{
+    public:
+        ChipModel();
+
+        // softReset sets the registers to their reset values.
+        void softReset();
+
+        // select handles the chip select (NSS) line, an SPI transaction starts
+        // with the address byte once it goes low.
+        void select(bool isSelected);
+
+        // transfer clocks a byte in and returns the byte clocked out.
+        uint8_t transfer(uint8_t mosi);
+
+        // irqLevel returns the level of the IRQ pin.
+        bool irqLevel() const;
+
+        // picc returns the card in the field.
+        PiccModel& picc() { return m_picc; }
+
+        // counters returns the activity counted so far.
+        const ChipCounters& counters() const { return m_counters; }
+
+        // crcA returns the ISO 14443A CRC of the data, low byte first.
+        static uint16_t crcA(const uint8_t* data, size_t size, uint16_t preset = 0x6363);
+
+    private:
+        uint8_t readRegister(uint8_t reg);
+        void writeRegister(uint8_t reg, uint8_t value);
+
+        // execute starts the command written into CommandReg.
+        void execute(uint8_t command);
+
+        // transceive sends the FIFO contents to the card and receives its
+        // response into the FIFO.
+        void transceive();
+
+        // authenticate runs the MFAuthent command on the FIFO contents.
+        void authenticate();
+
+        // calculateCrc runs the CRC coprocessor over the FIFO contents.
+        void calculateCrc();
+
+        // timerTimeoutNs returns the timer unit timeout set in the registers.
+        uint64_t timerTimeoutNs() const;
+
+        // advanceRf accounts for RF time.
+        void advanceRf(uint64_t ns);
+
+        // updateIrq recomputes the IRQ line after an interrupt flag changes.
+        void updateIrq();
+
+        uint8_t m_registers[64] {};
+        std::deque<uint8_t> m_fifo;
+
+        // SPI transaction state.
+        bool m_isSelected {false};
+        bool m_hasAddress {false};
+        bool m_isRead {false};
+        uint8_t m_address {0};
+
+        bool m_isIrqPending {false};
+
+        PiccModel m_picc;
+        ChipCounters m_counters;
+};
+
+#endif
@@ -0,0 +1,305 @@
+/*!
+ * @file mfrc522-bench.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part mfrc522-model package files. It runs the rfid-plus-display
+ * transmitter and the MFRC522 library operations against the chip model and
+ * reports per operation the SPI bytes, register accesses, FIFO bytes, IRQ
+ * assertions, the SPI bus and RF time accounted by the model, the virtual
+ * time including the delays and the host wall time.
+ * The trust organization is answered over the uplink serial stand-in with a
+ * compact trust key reply thus a whole tap can be measured.
+ *
+ *  Usage: mfrc522-bench [-n iterations] [-o operation]
+ *      -n  number of runs of each operation, defaults to 1000.
+ *      -o  only runs the operations whose name contains the text.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "transmitter.h"
+#include "chipModel.h"
+#include "hostBoard.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace BenchSettings
+{
+    // The same pins as the rfid-plus-display PCD.
+    constexpr uint8_t RFID_RST {22};
+    constexpr uint8_t RFID_SS {23};
+    constexpr uint8_t RFID_IRQ {2};
+
+    // DEFAULT_ITERATIONS defines the default number of runs per operation.
+    constexpr int DEFAULT_ITERATIONS {1000};
+
+    // secretKey is returned by the uplink for every secret key request.
+    constexpr byte secretKey[MFRC522::MF_KEY_SIZE] {0x0A, 0x1B, 0x2C, 0x3D, 0x4E, 0x5F};
+
+    // credentialBlock0 defines the first block of the trust key sector.
+    constexpr byte credentialBlock0 {4};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Operation holds the totals measured over the runs of an operation.
+struct Operation
+{
+    std::string name;
+    int runs {0};
+    int failures {0};
+    ChipCounters counters;
+    uint64_t virtualNs {0};
+    uint64_t wallNs {0};
+};
+
+// Uplink answers the requests the PCD sends to the trust organization.
+class Uplink
+{
+    public:
+        // onWrite queues the response of a complete request frame.
+        void onWrite(const uint8_t* data, size_t size)
+        {
+            if (size == Settings::SecretKeyAuthDataSize)
+            {
+                byte token[Settings::SessionTokenSize] {};
+                Serial1.queue(BenchSettings::secretKey, sizeof(BenchSettings::secretKey));
+                Serial1.queue(token, sizeof(token));
+            }
+            else if (size == Settings::TrustKeyAuthDataSize || size == Settings::TrustKeyTokenAuthDataSize)
+            {
+                // Every tap rotates the rolling key.
+                for (byte& value : m_reply.rollingKey)
+                    value = static_cast<byte>(rand());
+
+                m_reply.reference.magic = Settings::CREDENTIAL_MAGIC;
+                m_reply.reference.version = Settings::CompactCredentialVersion;
+                memcpy(m_reply.reference.deviceId, Settings::DEVICE_ID, sizeof(Settings::DEVICE_ID));
+                memcpy(m_reply.deviceId, Settings::DEVICE_ID, sizeof(Settings::DEVICE_ID));
+                Serial1.queue(reinterpret_cast<const uint8_t*>(&m_reply), sizeof(m_reply));
+            }
+            (void)data; // Telemetry records aren't answered.
+        }
+
+        // lastReply returns the last trust key reply sent.
+        const Settings::CompactTrustKeyReply& lastReply() const { return m_reply; }
+
+    private:
+        Settings::CompactTrustKeyReply m_reply {};
+};
+
+// provisionCard writes a compact credential into the trust key sector with
+// the PCD's KeyA and the KeyB derived from the secret key.
+void provisionCard(PiccModel& picc)
+{
+    const uint8_t uid[4] {0x04, 0x9C, 0x21, 0x6A};
+    picc.setUid(uid);
+
+    uint8_t* reference {picc.block(BenchSettings::credentialBlock0 + 2)};
+    reference[0] = Settings::CREDENTIAL_MAGIC;
+    reference[1] = Settings::CompactCredentialVersion;
+    memcpy(reference + 8, Settings::DEVICE_ID, sizeof(Settings::DEVICE_ID));
+
+    // KeyB = (secretKey ⨁ KeyA ⨁ TagUid) with the UID zero padded to 6 bytes.
+    uint8_t* trailer {picc.block(BenchSettings::credentialBlock0 + 3)};
+    memcpy(trailer, Settings::KeyA.keyByte, MFRC522::MF_KEY_SIZE);
+    const byte accessBits[4] {0x4B, 0x44, 0xBB, 0x69};
+    memcpy(trailer + MFRC522::MF_KEY_SIZE, accessBits, sizeof(accessBits));
+    for (int i {0}; i < MFRC522::MF_KEY_SIZE; ++i)
+        trailer[10 + i] = BenchSettings::secretKey[i] ^ Settings::KeyA.keyByte[i] ^ (i < 4 ? uid[i] : 0);
+}
+
+// measure runs the operation after its untimed setup and adds up the model
+// counters, the virtual and the wall time spent by the operation only.
+template <typename Setup, typename Run>
+void measure(std::vector<Operation>& results, const std::string& filter, const ChipModel& chip,
+    const char* name, int iterations, Setup setup, Run run)
+{
+    if (!filter.empty() && std::string(name).find(filter) == std::string::npos)
+        return;
+
+    Operation operation;
+    operation.name = name;
+    for (int i {0}; i < iterations; ++i)
+    {
+        setup();
+
+        ChipCounters before {chip.counters()};
+        uint64_t virtualStart {HostBoard::now()};
+        Clock::time_point wallStart {Clock::now()};
+
+        bool isSuccessful {run()};
+
+        operation.wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wallStart).count();
+        operation.virtualNs += HostBoard::now() - virtualStart;
+        operation.counters += chip.counters() - before;
+        operation.failures += !isSuccessful;
+        ++operation.runs;
+    }
+    results.push_back(operation);
+}
+
+// printResults writes the per run averages of the operations.
+void printResults(const std::vector<Operation>& results)
+{
+    printf("%-22s %8s %8s %8s %8s %6s %10s %10s %12s %10s %6s\n", "operation", "spi B", "reads", "writes",
+        "fifo B", "irqs", "bus us", "rf us", "virtual us", "wall us", "fails");
+
+    for (const Operation& operation : results)
+    {
+        double runs {static_cast<double>(operation.runs ? operation.runs : 1)};
+        const ChipCounters& c {operation.counters};
+        printf("%-22s %8.1f %8.1f %8.1f %8.1f %6.2f %10.1f %10.1f %12.1f %10.3f %6d\n", operation.name.c_str(),
+            c.spiBytes / runs, c.registerReads / runs, c.registerWrites / runs, c.fifoBytes / runs,
+            c.irqAssertions / runs, c.busNs / runs / 1000, c.rfNs / runs / 1000,
+            operation.virtualNs / runs / 1000, operation.wallNs / runs / 1000, operation.failures);
+    }
+}
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    int iterations {BenchSettings::DEFAULT_ITERATIONS};
+    std::string filter;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:o:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': iterations = std::max(1, atoi(optarg)); break;
+            case 'o': filter = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-o operation]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    ChipModel chip;
+    PiccModel& picc {chip.picc()};
+    provisionCard(picc);
+    HostBoard::attach(chip, BenchSettings::RFID_SS, BenchSettings::RFID_IRQ);
+
+    Uplink uplink;
+    Serial1.onWrite = [&uplink](const uint8_t* data, size_t size) { uplink.onWrite(data, size); };
+
+    // The same initialization as the rfid-plus-display main function.
+    Display view {12, 10, 11, 9, 8, 7, 6};
+    Transmitter rfid {BenchSettings::RFID_SS, BenchSettings::RFID_RST, view};
+    UPLINK_SERIAL.setTimeout(Settings::AUTH_DELAY);
+    rfid.enableInterrupts();
+
+    // The library operations run on a second driver instance over the same chip.
+    MFRC522 driver {BenchSettings::RFID_SS, BenchSettings::RFID_RST};
+    auto selectCard = [&]() {
+        driver.PCD_StopCrypto1();
+        picc.reset();
+        driver.PICC_IsNewCardPresent();
+        driver.PICC_ReadCardSerial();
+    };
+    auto authenticate = [&]() {
+        selectCard();
+        MFRC522::MIFARE_Key key {Settings::KeyA};
+        driver.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, BenchSettings::credentialBlock0 + 2, &key, &driver.uid);
+    };
+
+    std::vector<Operation> results;
+    auto none = []() {};
+
+    // Transmitter operations.
+    measure(results, filter, chip, "enableInterrupts", iterations, none, [&]() {
+        rfid.enableInterrupts();
+        return true;
+    });
+    // activateTransmission doesn't flush the FIFO, the ATQA of the previous
+    // run would be sent along with the REQA.
+    auto flushFifo = [&]() { driver.PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80); };
+    measure(results, filter, chip, "activateTransmission", iterations,
+        [&]() { rfid.resetInterrupt(); flushFifo(); picc.reset(); },
+        [&]() {
+            rfid.activateTransmission();
+            return digitalRead(BenchSettings::RFID_IRQ) == LOW; // The ATQA raised the IRQ.
+        });
+    measure(results, filter, chip, "resetInterrupt", iterations,
+        [&]() { flushFifo(); picc.reset(); rfid.activateTransmission(); },
+        [&]() {
+            rfid.resetInterrupt();
+            return digitalRead(BenchSettings::RFID_IRQ) == HIGH;
+        });
+    measure(results, filter, chip, "isNewCardDetected", iterations,
+        [&]() { picc.reset(); },
+        [&]() { return rfid.isNewCardDetected(); });
+    measure(results, filter, chip, "handleDetectedCard", iterations,
+        [&]() { picc.reset(); onInterrupt = true; },
+        [&]() {
+            rfid.handleDetectedCard();
+            // The tap succeeded if the rotated rolling key was written.
+            return memcmp(picc.block(BenchSettings::credentialBlock0 + 1), uplink.lastReply().rollingKey, Settings::blockSize) == 0;
+        });
+
+    // MFRC522 library operations.
+    byte data[Settings::blockSize + 2] {};
+    byte result[2];
+    measure(results, filter, chip, "PCD_CalculateCRC", iterations, none, [&]() {
+        uint16_t crc {ChipModel::crcA(data, Settings::blockSize)};
+        return driver.PCD_CalculateCRC(data, Settings::blockSize, result) == MFRC522::STATUS_OK &&
+            result[0] == (crc & 0xFF) && result[1] == (crc >> 8);
+    });
+    measure(results, filter, chip, "PICC_Select", iterations,
+        [&]() { driver.PCD_StopCrypto1(); picc.reset(); driver.PICC_IsNewCardPresent(); },
+        [&]() { return driver.PICC_ReadCardSerial(); });
+    measure(results, filter, chip, "PCD_Authenticate", iterations, selectCard, [&]() {
+        MFRC522::MIFARE_Key key {Settings::KeyA};
+        return driver.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, BenchSettings::credentialBlock0 + 2,
+            &key, &driver.uid) == MFRC522::STATUS_OK;
+    });
+    measure(results, filter, chip, "MIFARE_Read", iterations, authenticate, [&]() {
+        byte size {sizeof(data)};
+        return driver.MIFARE_Read(BenchSettings::credentialBlock0 + 2, data, &size) == MFRC522::STATUS_OK;
+    });
+    measure(results, filter, chip, "MIFARE_Write", iterations, authenticate, [&]() {
+        return driver.MIFARE_Write(BenchSettings::credentialBlock0, data, Settings::blockSize) == MFRC522::STATUS_OK;
+    });
+    measure(results, filter, chip, "PICC_HaltA", iterations, selectCard, [&]() {
+        return driver.PICC_HaltA() == MFRC522::STATUS_OK;
+    });
+
+    // The same operations with the CRC_A computed in software by the PCD's
+    // Reader driver, see transmitter.h.
+    Reader reader {BenchSettings::RFID_SS, BenchSettings::RFID_RST};
+    measure(results, filter, chip, "Reader::calculateCrc", iterations, none, [&]() {
+        uint16_t crc {ChipModel::crcA(data, Settings::blockSize)};
+        Reader::calculateCrc(data, Settings::blockSize, result);
+        return result[0] == (crc & 0xFF) && result[1] == (crc >> 8);
+    });
+    measure(results, filter, chip, "Reader::MIFARE_Read", iterations, authenticate, [&]() {
+        byte size {sizeof(data)};
+        return reader.MIFARE_Read(BenchSettings::credentialBlock0 + 2, data, &size) == MFRC522::STATUS_OK;
+    });
+    measure(results, filter, chip, "Reader::MIFARE_Write", iterations, authenticate, [&]() {
+        return reader.MIFARE_Write(BenchSettings::credentialBlock0, data, Settings::blockSize) == MFRC522::STATUS_OK;
+    });
+    measure(results, filter, chip, "Reader::PICC_HaltA", iterations, selectCard, [&]() {
+        return reader.PICC_HaltA() == MFRC522::STATUS_OK;
+    });
+
+    printResults(results);
+
+    for (const Operation& operation : results)
+        if (operation.failures > 0)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*!
+ * @file bench.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. It checks each kernel the
+ * CPU runs against OpenSSL then measures the per core throughput of each
+ * one next to OpenSSL hashing the messages one at a time.
+ *
+ *  Usage: multidigest-bench [-n messages] [-i iterations]
+ *      -n  number of messages hashed per call, 256 by default i.e. the md5
+ *          and sha256 inputs of a full batch request of 64 records.
+ *      -i  number of calls timed per kernel.
+ *  The messages have the sizes of the trust organization digest inputs e.g.
+ *  a hex tag UID, a salted hashed tag UID or a hex block 2 data.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "multidigest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Batch holds the messages hashed by every call.
+struct Batch
+{
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> sizes;
+};
+
+// Algorithm holds a digest and the ways of computing it.
+struct Algorithm
+{
+    const char* name;
+    const EVP_MD* (*evp)();
+    uint32_t digestSize;
+    void (*compute)(MultiDigest::Kernel, const uint8_t*, const uint32_t*, uint32_t, uint8_t*);
+};
+
+// makeBatch returns count random messages with the digest input sizes.
+static Batch makeBatch(uint32_t count)
+{
+    static const uint32_t inputSizes[] {14, 84, 32, 30, 116, 72};
+
+    std::mt19937 random {42};
+    Batch batch;
+    for (uint32_t i {0}; i < count; ++i)
+    {
+        uint32_t size {inputSizes[i % (sizeof(inputSizes) / sizeof(inputSizes[0]))]};
+        batch.sizes.push_back(size);
+        for (uint32_t j {0}; j < size; ++j)
+            batch.data.push_back(static_cast<uint8_t>(random()));
+    }
+    return batch;
+}
+
+// hashOpenSSL hashes the messages one at a time with OpenSSL.
+static void hashOpenSSL(const Algorithm& algorithm, const Batch& batch, uint8_t* digests)
+{
+    const uint8_t* message {batch.data.data()};
+    for (size_t i {0}; i < batch.sizes.size(); ++i)
+    {
+        EVP_Digest(message, batch.sizes[i], digests + i * algorithm.digestSize, nullptr, algorithm.evp(), nullptr);
+        message += batch.sizes[i];
+    }
+}
+
+// printRate prints the throughput of a run.
+static void printRate(const char* algorithm, const char* kernel, uint32_t messages, int iterations,
+    Clock::duration elapsed, double baseline)
+{
+    double seconds {std::chrono::duration<double>(elapsed).count()};
+    double rate {messages * static_cast<double>(iterations) / seconds};
+    printf("%-7s %-14s %12.0f digests/s %8.1f ns/digest %6.2fx\n", algorithm, kernel, rate, 1e9 / rate,
+        baseline > 0 ? rate / baseline : 1.0);
+}
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    uint32_t count {256};
+    int iterations {20000};
+
+    int option;
+    while ((option = getopt(argc, argv, "n:i:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': count = std::max(1, atoi(optarg)); break;
+            case 'i': iterations = std::max(1, atoi(optarg)); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n messages] [-i iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    const Algorithm algorithms[] {
+        {"md5", EVP_md5, MultiDigest::MD5_SIZE, MultiDigest::md5},
+        {"sha256", EVP_sha256, MultiDigest::SHA256_SIZE, MultiDigest::sha256},
+    };
+
+    Batch batch {makeBatch(count)};
+    printf("%u messages per call, %d calls, best kernel %s\n", count, iterations,
+        MultiDigest::kernelName(MultiDigest::bestKernel()));
+
+    bool isValid {true};
+    for (const Algorithm& algorithm : algorithms)
+    {
+        std::vector<uint8_t> expected(count * algorithm.digestSize);
+        std::vector<uint8_t> digests(count * algorithm.digestSize);
+
+        Clock::time_point start {Clock::now()};
+        for (int i {0}; i < iterations; ++i)
+            hashOpenSSL(algorithm, batch, expected.data());
+        Clock::duration elapsed {Clock::now() - start};
+
+        double seconds {std::chrono::duration<double>(elapsed).count()};
+        double baseline {count * static_cast<double>(iterations) / seconds};
+        printRate(algorithm.name, "openssl", count, iterations, elapsed, 0);
+
+        for (int kernel {0}; kernel < MultiDigest::kernelsCount; ++kernel)
+        {
+            MultiDigest::Kernel current {static_cast<MultiDigest::Kernel>(kernel)};
+            if (!MultiDigest::isSupported(current))
+            {
+                printf("%-7s %-14s not supported by this CPU\n", algorithm.name, MultiDigest::kernelName(current));
+                continue;
+            }
+
+            algorithm.compute(current, batch.data.data(), batch.sizes.data(), count, digests.data());
+            if (digests != expected)
+            {
+                printf("%-7s %-14s MISMATCH with openssl\n", algorithm.name, MultiDigest::kernelName(current));
+                isValid = false;
+                continue;
+            }
+
+            start = Clock::now();
+            for (int i {0}; i < iterations; ++i)
+                algorithm.compute(current, batch.data.data(), batch.sizes.data(), count, digests.data());
+            printRate(algorithm.name, MultiDigest::kernelName(current), count, iterations, Clock::now() - start, baseline);
+        }
+    }
+
+    return isValid ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/*!
+ * @file kernels-avx2.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. It instantiates the kernels
+ * over 8 lanes, it is built with -mavx2.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "kernels.h"
+
+typedef uint32_t Avx2Vector __attribute__((vector_size(32)));
+
+void MultiDigest::md5Avx2(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    md5Lanes<Avx2Vector, 8>(data, sizes, count, digests);
+}
+
+void MultiDigest::sha256Avx2(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    sha256Lanes<Avx2Vector, 8>(data, sizes, count, digests);
+}
@@ -0,0 +1,31 @@
+/*!
+ * @file kernels-scalar.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. It instantiates the kernels
+ * over 1 lanes i.e. the portable scalar fallback.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "kernels.h"
+
+typedef uint32_t ScalarVector __attribute__((vector_size(4)));
+
+void MultiDigest::md5Scalar(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    md5Lanes<ScalarVector, 1>(data, sizes, count, digests);
+}
+
+void MultiDigest::sha256Scalar(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    sha256Lanes<ScalarVector, 1>(data, sizes, count, digests);
+}
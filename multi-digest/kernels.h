@@ -0,0 +1,274 @@
+/*!
+ * @file kernels.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. It holds the MD5 and
+ * SHA-256 kernels written once over a GCC vector type of Lanes 32 bits
+ * lanes. Each kernel translation unit includes it with the instruction set
+ * of its vector type enabled. Everything here has internal linkage so that
+ * the AVX code of one unit is never linked in place of another's.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_MULTI_DIGEST_KERNELS__
+#define __RFID_MULTI_DIGEST_KERNELS__
+
+#include <cstdint>
+#include <cstring>
+
+#include "multidigest.h"
+
+namespace
+{
+    // BLOCK_SIZE defines the MD5 and SHA-256 block size in bytes.
+    constexpr uint32_t BLOCK_SIZE {64};
+
+    constexpr uint32_t MD5_K[64] {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+    };
+
+    constexpr int MD5_SHIFTS[4][4] {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+
+    constexpr uint32_t SHA256_K[64] {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    constexpr uint32_t SHA256_INIT[8] {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    // Message holds a lane's message and the number of its padded blocks.
+    struct Message
+    {
+        const uint8_t* data {nullptr};
+        uint32_t size {0};
+        uint32_t blocks {0};
+    };
+
+    // paddedByte returns the byte at offset of the padded message i.e. the
+    // message, 0x80, zeros then its size in bits in the last 8 bytes.
+    inline uint8_t paddedByte(const Message& message, uint32_t offset, bool isBigEndian)
+    {
+        if (offset < message.size)
+            return message.data[offset];
+        if (offset == message.size)
+            return 0x80;
+
+        uint32_t sizeAt {message.blocks * BLOCK_SIZE - 8};
+        if (offset < sizeAt)
+            return 0;
+
+        uint64_t bits {uint64_t {message.size} * 8};
+        uint32_t index {offset - sizeAt};
+        return static_cast<uint8_t>(bits >> (8 * (isBigEndian ? 7 - index : index)));
+    }
+
+    // paddedWord returns the 32 bits word at offset of the padded message.
+    inline uint32_t paddedWord(const Message& message, uint32_t offset, bool isBigEndian)
+    {
+        uint32_t word;
+        if (offset + 4 <= message.size)
+        {
+            memcpy(&word, message.data + offset, sizeof(word));
+            return isBigEndian ? __builtin_bswap32(word) : word;
+        }
+
+        word = 0;
+        for (uint32_t i {0}; i < 4; ++i)
+        {
+            uint32_t byte {paddedByte(message, offset + i, isBigEndian)};
+            word |= isBigEndian ? byte << (8 * (3 - i)) : byte << (8 * i);
+        }
+        return word;
+    }
+
+    template <typename V>
+    inline V rotateLeft(V x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    template <typename V>
+    inline V rotateRight(V x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    // select returns the lanes of x where mask is set, those of y elsewhere.
+    template <typename V>
+    inline V select(V mask, V x, V y) { return (x & mask) | (y & ~mask); }
+
+    // LaneGroup holds the messages hashed together and the mask of the lanes
+    // that still have a block to hash.
+    template <typename V, int Lanes>
+    struct LaneGroup
+    {
+        Message messages[Lanes];
+        uint32_t maxBlocks {0};
+        V blockCounts {};
+
+        // load takes up to Lanes messages from data, returns the bytes taken.
+        uint32_t load(const uint8_t* data, const uint32_t* sizes, uint32_t count)
+        {
+            uint32_t taken {0};
+            uint32_t counts[Lanes];
+            for (int lane {0}; lane < Lanes; ++lane)
+            {
+                messages[lane] = Message {};
+                if (static_cast<uint32_t>(lane) < count)
+                {
+                    messages[lane] = Message {data + taken, sizes[lane], (sizes[lane] + 8) / BLOCK_SIZE + 1};
+                    taken += sizes[lane];
+                }
+
+                counts[lane] = messages[lane].blocks;
+                if (messages[lane].blocks > maxBlocks)
+                    maxBlocks = messages[lane].blocks;
+            }
+            memcpy(&blockCounts, counts, sizeof(blockCounts));
+            return taken;
+        }
+
+        // words loads the 16 words of the block of each lane. They are
+        // transposed in memory first, inserting each lane is much slower.
+        void words(uint32_t block, V* w, bool isBigEndian) const
+        {
+            alignas(sizeof(V)) uint32_t transposed[16][Lanes];
+            for (int lane {0}; lane < Lanes; ++lane)
+                for (int i {0}; i < 16; ++i)
+                    transposed[i][lane] = (block < messages[lane].blocks) ?
+                        paddedWord(messages[lane], block * BLOCK_SIZE + i * 4, isBigEndian) : 0;
+
+            memcpy(w, transposed, sizeof(transposed));
+        }
+
+        // activeMask returns the mask of the lanes holding the block.
+        V activeMask(uint32_t block) const { return (V)((V {} + block) < blockCounts); }
+    };
+
+    template <typename V, int Lanes>
+    void md5Lanes(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+    {
+        for (uint32_t first {0}; first < count; first += Lanes)
+        {
+            LaneGroup<V, Lanes> group;
+            data += group.load(data, sizes + first, count - first);
+
+            V state[4] {V {} + 0x67452301u, V {} + 0xefcdab89u, V {} + 0x98badcfeu, V {} + 0x10325476u};
+            for (uint32_t block {0}; block < group.maxBlocks; ++block)
+            {
+                V w[16];
+                group.words(block, w, false);
+
+                V a {state[0]}, b {state[1]}, c {state[2]}, d {state[3]};
+                for (int i {0}; i < 64; ++i)
+                {
+                    V f;
+                    int g;
+                    switch (i / 16)
+                    {
+                        case 0: f = (b & c) | (~b & d); g = i; break;
+                        case 1: f = (d & b) | (~d & c); g = (5 * i + 1) % 16; break;
+                        case 2: f = b ^ c ^ d; g = (3 * i + 5) % 16; break;
+                        default: f = c ^ (b | ~d); g = (7 * i) % 16; break;
+                    }
+
+                    f += a + MD5_K[i] + w[g];
+                    a = d;
+                    d = c;
+                    c = b;
+                    b += rotateLeft(f, MD5_SHIFTS[i / 16][i % 4]);
+                }
+
+                V mask {group.activeMask(block)};
+                state[0] = select(mask, state[0] + a, state[0]);
+                state[1] = select(mask, state[1] + b, state[1]);
+                state[2] = select(mask, state[2] + c, state[2]);
+                state[3] = select(mask, state[3] + d, state[3]);
+            }
+
+            for (uint32_t lane {0}; lane < Lanes && first + lane < count; ++lane)
+                for (int i {0}; i < 4; ++i)
+                {
+                    uint32_t word {state[i][lane]};
+                    memcpy(digests + (first + lane) * MultiDigest::MD5_SIZE + i * 4, &word, sizeof(word));
+                }
+        }
+    }
+
+    template <typename V, int Lanes>
+    void sha256Lanes(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+    {
+        for (uint32_t first {0}; first < count; first += Lanes)
+        {
+            LaneGroup<V, Lanes> group;
+            data += group.load(data, sizes + first, count - first);
+
+            V state[8];
+            for (int i {0}; i < 8; ++i)
+                state[i] = V {} + SHA256_INIT[i];
+
+            for (uint32_t block {0}; block < group.maxBlocks; ++block)
+            {
+                V w[64];
+                group.words(block, w, true);
+                for (int i {16}; i < 64; ++i)
+                {
+                    V s0 {rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3)};
+                    V s1 {rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10)};
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                V a {state[0]}, b {state[1]}, c {state[2]}, d {state[3]};
+                V e {state[4]}, f {state[5]}, g {state[6]}, h {state[7]};
+                for (int i {0}; i < 64; ++i)
+                {
+                    V s1 {rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)};
+                    V t1 {h + s1 + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i]};
+                    V s0 {rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)};
+                    V t2 {s0 + ((a & b) ^ (a & c) ^ (b & c))};
+
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+
+                V mask {group.activeMask(block)};
+                V rounds[8] {a, b, c, d, e, f, g, h};
+                for (int i {0}; i < 8; ++i)
+                    state[i] = select(mask, state[i] + rounds[i], state[i]);
+            }
+
+            for (uint32_t lane {0}; lane < Lanes && first + lane < count; ++lane)
+                for (int i {0}; i < 8; ++i)
+                {
+                    uint32_t word {__builtin_bswap32(state[i][lane])};
+                    memcpy(digests + (first + lane) * MultiDigest::SHA256_SIZE + i * 4, &word, sizeof(word));
+                }
+        }
+    }
+};
+
+#endif
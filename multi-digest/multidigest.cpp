@@ -0,0 +1,83 @@
+/*!
+ * @file multidigest.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. It picks the kernel at
+ * runtime and exports the C interface.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "multidigest.h"
+
+// kernelName returns the name of the kernel.
+const char* MultiDigest::kernelName(Kernel kernel)
+{
+    static const char* const names[kernelsCount] {"scalar", "avx2", "avx512"};
+    return names[kernel];
+}
+
+// isSupported returns true if the CPU runs the kernel.
+bool MultiDigest::isSupported(Kernel kernel)
+{
+    __builtin_cpu_init();
+    switch (kernel)
+    {
+        case Avx2: return __builtin_cpu_supports("avx2");
+        case Avx512: return __builtin_cpu_supports("avx512f");
+        default: return true;
+    }
+}
+
+// bestKernel returns the fastest kernel the CPU runs. It is only worked out
+// on the first call.
+MultiDigest::Kernel MultiDigest::bestKernel()
+{
+    static const Kernel best {isSupported(Avx512) ? Avx512 : (isSupported(Avx2) ? Avx2 : Scalar)};
+    return best;
+}
+
+// md5 computes the MD5 digests with the given kernel.
+void MultiDigest::md5(Kernel kernel, const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    switch (kernel)
+    {
+        case Avx512: md5Avx512(data, sizes, count, digests); break;
+        case Avx2: md5Avx2(data, sizes, count, digests); break;
+        default: md5Scalar(data, sizes, count, digests); break;
+    }
+}
+
+// sha256 computes the SHA-256 digests with the given kernel.
+void MultiDigest::sha256(Kernel kernel, const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    switch (kernel)
+    {
+        case Avx512: sha256Avx512(data, sizes, count, digests); break;
+        case Avx2: sha256Avx2(data, sizes, count, digests); break;
+        default: sha256Scalar(data, sizes, count, digests); break;
+    }
+}
+
+void multidigest_md5(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    MultiDigest::md5(MultiDigest::bestKernel(), data, sizes, count, digests);
+}
+
+void multidigest_sha256(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests)
+{
+    MultiDigest::sha256(MultiDigest::bestKernel(), data, sizes, count, digests);
+}
+
+const char* multidigest_kernel()
+{
+    return MultiDigest::kernelName(MultiDigest::bestKernel());
+}
@@ -0,0 +1,73 @@
+/*!
+ * @file multidigest.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part multi-digest package files. The multi-digest library
+ * computes the MD5 and SHA-256 digests of many short messages at once, one
+ * message per SIMD lane i.e. 8 lanes with AVX2 and 16 with AVX-512. The
+ * kernel is picked at runtime from the CPU features with a single lane
+ * scalar fallback. The trust organization hashes the records of a batch
+ * request through it, see TOrg/digests.php.
+ *
+ * The messages are held back to back in a single buffer, message i being
+ * sizes[i] bytes long. The digests are written back to back in the same
+ * order.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_MULTI_DIGEST__
+#define __RFID_MULTI_DIGEST__
+
+#include <cstdint>
+
+namespace MultiDigest
+{
+    // MD5_SIZE and SHA256_SIZE define the digest sizes in bytes.
+    constexpr uint32_t MD5_SIZE {16};
+    constexpr uint32_t SHA256_SIZE {32};
+
+    // Kernel lists the kernels from the slowest to the fastest.
+    enum Kernel { Scalar, Avx2, Avx512, kernelsCount };
+
+    // Each kernel is built in its own translation unit with the matching
+    // instruction set enabled, only call those the CPU supports.
+    void md5Scalar(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void md5Avx2(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void md5Avx512(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void sha256Scalar(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void sha256Avx2(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void sha256Avx512(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+
+    // kernelName returns the name of the kernel.
+    const char* kernelName(Kernel kernel);
+
+    // isSupported returns true if the CPU runs the kernel.
+    bool isSupported(Kernel kernel);
+
+    // bestKernel returns the fastest kernel the CPU runs.
+    Kernel bestKernel();
+
+    // md5 and sha256 compute the digests with the given kernel.
+    void md5(Kernel kernel, const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void sha256(Kernel kernel, const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+};
+
+// The C interface loaded by the PHP FFI extension. It always uses the
+// bestKernel.
+extern "C"
+{
+    void multidigest_md5(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    void multidigest_sha256(const uint8_t* data, const uint32_t* sizes, uint32_t count, uint8_t* digests);
+    const char* multidigest_kernel();
+}
+
+#endif
@@ -0,0 +1,408 @@
+/*!
+ * @file migration.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rekey package files. It migrates the trust organization
+ * shard nodes to new default block 2 data and trust key salts while they
+ * keep serving. Only the rolling passwords still holding the defaults of a
+ * never rotated card are derived from the salts, see TOrg/digests.php. The
+ * cards are split into chunks of secret key ids that are streamed, rederived
+ * on all cores and written back a transaction per chunk. Every committed
+ * chunk is journaled into the checkpoint file thus an interrupted run picks
+ * up where it stopped.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "migration.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <openssl/evp.h>
+
+///////////////////////////////////////////////////
+// General Purpose Functions
+//////////////////////////////////////////////////
+
+// toHex returns the lowercase hex of the bytes.
+static std::string toHex(const std::string& bytes)
+{
+    static const char digits[] {"0123456789abcdef"};
+
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes)
+    {
+        hex += digits[c >> 4];
+        hex += digits[c & 0x0F];
+    }
+    return hex;
+}
+
+// digest returns the raw digest of the text uppercased as md5hash and
+// sha256hash do in TOrg/digests.php. PHP's strtoupper only maps the ASCII
+// letters, the multibyte characters of the salts are left as they are.
+static std::string digest(const EVP_MD* md, std::string text)
+{
+    for (char& c : text)
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+
+    unsigned char value[EVP_MAX_MD_SIZE];
+    unsigned int size {0};
+    EVP_Digest(text.data(), text.size(), value, &size, md, nullptr);
+    return std::string(reinterpret_cast<char*>(value), size);
+}
+
+// deriveDefaults returns the defaults of the card derived from the salts.
+Defaults deriveDefaults(const std::string& block2DataSalt, const std::string& trustKeySalt,
+    const std::string& hashedTagUid)
+{
+    std::string uid {toHex(hashedTagUid)};
+    return {digest(EVP_md5(), block2DataSalt + uid), digest(EVP_sha256(), trustKeySalt + uid)};
+}
+
+// sqlValue returns the column as a hex literal or NULL.
+static std::string sqlValue(const char* column, unsigned long size)
+{
+    return column ? "X'" + toHex(std::string(column, size)) + "'" : "NULL";
+}
+
+///////////////////////////////////////////////////
+// RekeyConfig Members
+//////////////////////////////////////////////////
+
+bool RekeyConfig::parse(const std::string& path)
+{
+    std::ifstream file {path};
+    if (!file)
+    {
+        fprintf(stderr, "Unable to read the config file: %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t separator {line.find(' ')};
+        if (line.empty() || line[0] == '#' || separator == std::string::npos)
+            continue; // Skip the comments.
+
+        std::string key {line.substr(0, separator)};
+        std::string value {line.substr(separator + 1)};
+
+        if (key == "node")
+        {
+            ShardNode node;
+            std::istringstream fields {value};
+            if (!(fields >> node.name >> node.host >> node.user >> node.password >> node.database))
+            {
+                fprintf(stderr, "Incomplete node line: node %s\n", node.name.c_str());
+                return false;
+            }
+            nodes.push_back(node);
+        }
+        else if (key == "old_block2data_salt") oldBlock2DataSalt = value;
+        else if (key == "old_trustkey_salt") oldTrustKeySalt = value;
+        else if (key == "new_block2data_salt") newBlock2DataSalt = value;
+        else if (key == "new_trustkey_salt") newTrustKeySalt = value;
+    }
+
+    if (nodes.empty() || oldBlock2DataSalt.empty() || oldTrustKeySalt.empty() ||
+        newBlock2DataSalt.empty() || newTrustKeySalt.empty())
+    {
+        fprintf(stderr, "The config file needs a node and the old and new salts.\n");
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////
+// Migration Members
+//////////////////////////////////////////////////
+
+Migration::Migration(const RekeyConfig& config, uint32_t chunkKeys)
+    : m_config {config}, m_chunkKeys {chunkKeys}
+{
+}
+
+Migration::~Migration()
+{
+    if (m_checkpoint != nullptr)
+        fclose(m_checkpoint);
+}
+
+bool Migration::openCheckpoint(const std::string& path)
+{
+    std::ifstream file {path};
+    std::string line;
+    if (std::getline(file, line))
+    {
+        // The chunks are only comparable if they have the same size.
+        std::string header {std::string(Settings::CHECKPOINT_HEADER) + " " + std::to_string(m_chunkKeys)};
+        if (line != header)
+        {
+            fprintf(stderr, "The checkpoint %s was written with another chunk size: %s\n", path.c_str(), line.c_str());
+            return false;
+        }
+
+        std::string node;
+        uint32_t firstId;
+        while (file >> node >> firstId)
+            m_committed.insert({node, firstId});
+    }
+
+    bool isNew {line.empty()};
+    m_checkpoint = fopen(path.c_str(), "a");
+    if (m_checkpoint == nullptr)
+    {
+        fprintf(stderr, "Unable to open the checkpoint: %s\n", path.c_str());
+        return false;
+    }
+
+    if (isNew)
+        fprintf(m_checkpoint, "%s %u\n", Settings::CHECKPOINT_HEADER, m_chunkKeys);
+    fflush(m_checkpoint);
+    return true;
+}
+
+MYSQL* Migration::connect(const ShardNode& node)
+{
+    MYSQL* con {mysql_init(nullptr)};
+    if (con == nullptr)
+        return nullptr;
+
+    if (!mysql_real_connect(con, node.host.c_str(), node.user.c_str(), node.password.c_str(),
+        node.database.c_str(), 0, nullptr, 0))
+    {
+        fprintf(stderr, "%s: %s\n", node.name.c_str(), mysql_error(con));
+        mysql_close(con);
+        return nullptr;
+    }
+    return con;
+}
+
+bool Migration::plan()
+{
+    for (size_t i {0}; i < m_config.nodes.size(); ++i)
+    {
+        const ShardNode& node {m_config.nodes[i]};
+        MYSQL* con {connect(node)};
+        if (con == nullptr)
+            return false;
+
+        MYSQL_RES* result {nullptr};
+        MYSQL_ROW row {nullptr};
+        if (mysql_query(con, "SELECT MIN(id), MAX(id) FROM `secretKeysTable`") == 0)
+            result = mysql_store_result(con);
+        if (result != nullptr)
+            row = mysql_fetch_row(result);
+
+        if (row == nullptr)
+        {
+            fprintf(stderr, "%s: %s\n", node.name.c_str(), mysql_error(con));
+            mysql_free_result(result);
+            mysql_close(con);
+            return false;
+        }
+
+        // Cards enrolled after the plan already use the new salts.
+        if (row[0] != nullptr)
+        {
+            uint32_t minId {static_cast<uint32_t>(strtoul(row[0], nullptr, 10))};
+            uint32_t maxId {static_cast<uint32_t>(strtoul(row[1], nullptr, 10))};
+
+            // The chunks are aligned on the chunk size so that they stay the
+            // same across the resumed runs.
+            for (uint64_t firstId {minId - minId % m_chunkKeys}; firstId <= maxId; firstId += m_chunkKeys)
+            {
+                if (m_committed.count({node.name, static_cast<uint32_t>(firstId)}) == 0)
+                    m_chunks.push_back({i, static_cast<uint32_t>(firstId), static_cast<uint32_t>(firstId + m_chunkKeys - 1)});
+            }
+        }
+
+        mysql_free_result(result);
+        mysql_close(con);
+    }
+
+    m_plannedChunks = m_chunks.size();
+    printf("Planned %zu chunks of %u secret keys, %zu already committed\n",
+        m_plannedChunks, m_chunkKeys, m_committed.size());
+    return true;
+}
+
+bool Migration::run(int threads)
+{
+    std::vector<std::thread> workers;
+    for (int i {0}; i < threads; ++i)
+        workers.emplace_back(&Migration::work, this);
+
+    auto started {std::chrono::steady_clock::now()};
+    for (int seconds {1}; doneChunks + failedChunks < m_plannedChunks; ++seconds)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (seconds % Settings::PROGRESS_INTERVAL_SEC == 0)
+        {
+            printf("%llu/%zu chunks, %llu rows scanned, %llu updated\n", (unsigned long long)doneChunks.load(),
+                m_plannedChunks, (unsigned long long)scannedRows.load(), (unsigned long long)updatedRows.load());
+            fflush(stdout);
+        }
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    double elapsed {std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count()};
+    printf("Done in %.1f s: %llu chunks, %llu failed, %llu rows scanned, %llu updated\n", elapsed,
+        (unsigned long long)doneChunks.load(), (unsigned long long)failedChunks.load(),
+        (unsigned long long)scannedRows.load(), (unsigned long long)updatedRows.load());
+    return failedChunks == 0;
+}
+
+void Migration::work()
+{
+    mysql_thread_init();
+
+    // A connection per node is opened on first use and kept till the end.
+    std::vector<MYSQL*> connections(m_config.nodes.size(), nullptr);
+    for (;;)
+    {
+        Chunk chunk;
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            if (m_chunks.empty())
+                break;
+            chunk = m_chunks.front();
+            m_chunks.pop_front();
+        }
+
+        MYSQL*& con {connections[chunk.node]};
+        if (con == nullptr)
+            con = connect(m_config.nodes[chunk.node]);
+
+        if (con != nullptr && migrateChunk(con, chunk))
+        {
+            journal(chunk);
+            ++doneChunks;
+            continue;
+        }
+
+        fprintf(stderr, "%s: chunk %u-%u failed: %s\n", m_config.nodes[chunk.node].name.c_str(),
+            chunk.firstId, chunk.lastId, con ? mysql_error(con) : "not connected");
+        ++failedChunks;
+
+        // The connection is reopened for the next chunk.
+        if (con != nullptr)
+            mysql_close(con);
+        con = nullptr;
+    }
+
+    for (MYSQL* con : connections)
+        if (con != nullptr)
+            mysql_close(con);
+
+    mysql_thread_end();
+}
+
+bool Migration::migrateChunk(MYSQL* con, const Chunk& chunk)
+{
+    // Rows are streamed rather than buffered, the chunk's rolling passwords
+    // are grouped by card so the defaults are derived once per card.
+    char query[320];
+    snprintf(query, sizeof(query), "SELECT r.id, s.hashed_tag_uid, r.hashed_blockdata, r.rolling_pass "
+        "FROM `secretKeysTable` AS s JOIN `rollingPasswordTable` AS r ON r.secret_key_id = s.id "
+        "WHERE s.id BETWEEN %u AND %u ORDER BY s.id", chunk.firstId, chunk.lastId);
+    if (mysql_query(con, query) != 0)
+        return false;
+
+    MYSQL_RES* result {mysql_use_result(con)};
+    if (result == nullptr)
+        return false;
+
+    bool isBlock2DataRekeyed {m_config.oldBlock2DataSalt != m_config.newBlock2DataSalt};
+    bool isTrustKeyRekeyed {m_config.oldTrustKeySalt != m_config.newTrustKeySalt};
+
+    std::vector<std::string> updates;
+    std::string hashedTagUid;
+    Defaults oldDefaults;
+    Defaults newDefaults;
+    uint64_t rows {0};
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result)) != nullptr)
+    {
+        unsigned long* sizes {mysql_fetch_lengths(result)};
+        ++rows;
+
+        std::string uid(row[1], sizes[1]);
+        if (uid != hashedTagUid)
+        {
+            hashedTagUid = uid;
+            oldDefaults = deriveDefaults(m_config.oldBlock2DataSalt, m_config.oldTrustKeySalt, uid);
+            newDefaults = deriveDefaults(m_config.newBlock2DataSalt, m_config.newTrustKeySalt, uid);
+        }
+
+        bool isDefaultBlock2Data {isBlock2DataRekeyed && row[2] != nullptr &&
+            oldDefaults.block2Data.compare(0, std::string::npos, row[2], sizes[2]) == 0};
+        bool isDefaultTrustKey {isTrustKeyRekeyed && row[3] != nullptr &&
+            oldDefaults.trustKey.compare(0, std::string::npos, row[3], sizes[3]) == 0};
+        if (!isDefaultBlock2Data && !isDefaultTrustKey)
+            continue;
+
+        // The row is only updated if it still holds the values read.
+        std::string update {"UPDATE `rollingPasswordTable` SET "};
+        if (isDefaultBlock2Data)
+            update += "hashed_blockdata=X'" + toHex(newDefaults.block2Data) + "'";
+        if (isDefaultTrustKey)
+            update += std::string(isDefaultBlock2Data ? ", " : "") + "rolling_pass=X'" + toHex(newDefaults.trustKey) + "'";
+        update += std::string(" WHERE id=") + row[0] + " AND hashed_blockdata <=> " + sqlValue(row[2], sizes[2]) +
+            " AND rolling_pass <=> " + sqlValue(row[3], sizes[3]);
+        updates.push_back(update);
+    }
+
+    bool isComplete {mysql_errno(con) == 0};
+    mysql_free_result(result);
+    if (!isComplete)
+        return false;
+
+    scannedRows += rows;
+    if (updates.empty())
+        return true;
+
+    if (mysql_query(con, "START TRANSACTION") != 0)
+        return false;
+
+    for (const std::string& update : updates)
+    {
+        if (mysql_query(con, update.c_str()) != 0)
+        {
+            mysql_query(con, "ROLLBACK");
+            return false;
+        }
+    }
+
+    if (mysql_query(con, "COMMIT") != 0)
+        return false;
+
+    updatedRows += updates.size();
+    return true;
+}
+
+void Migration::journal(const Chunk& chunk)
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+    fprintf(m_checkpoint, "%s %u\n", m_config.nodes[chunk.node].name.c_str(), chunk.firstId);
+    fflush(m_checkpoint);
+}
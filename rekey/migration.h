@@ -0,0 +1,153 @@
+/*!
+ * @file migration.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rekey package files. It migrates the trust organization
+ * shard nodes to new default block 2 data and trust key salts while they
+ * keep serving. Only the rolling passwords still holding the defaults of a
+ * never rotated card are derived from the salts, see TOrg/digests.php. The
+ * cards are split into chunks of secret key ids that are streamed, rederived
+ * on all cores and written back a transaction per chunk. Every committed
+ * chunk is journaled into the checkpoint file thus an interrupted run picks
+ * up where it stopped.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_REKEY_MIGRATION__
+#define __RFID_REKEY_MIGRATION__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mysql.h>
+
+namespace Settings
+{
+    // DEFAULT_CHUNK_KEYS defines the number of secret key ids migrated in a
+    // single transaction.
+    constexpr uint32_t DEFAULT_CHUNK_KEYS {5000};
+
+    // PROGRESS_INTERVAL_SEC defines the interval at which progress is printed.
+    constexpr int PROGRESS_INTERVAL_SEC {5};
+
+    // CHECKPOINT_HEADER starts the checkpoint file, followed by the chunk size.
+    constexpr const char* CHECKPOINT_HEADER {"# rekey checkpoint, chunk keys"};
+};
+
+// ShardNode holds the connection of a node as listed in $shardNodes.
+struct ShardNode
+{
+    std::string name;
+    std::string host;
+    std::string user;
+    std::string password;
+    std::string database;
+};
+
+// RekeyConfig holds the shard nodes and the salts read from the config file.
+// Each line holds a key followed by a single space and its value:
+//      node <name> <host> <user> <password> <database>
+//      old_block2data_salt <salt>
+//      old_trustkey_salt <salt>
+//      new_block2data_salt <salt>
+//      new_trustkey_salt <salt>
+// A node line is repeated per shard node. Lines starting with # are skipped.
+struct RekeyConfig
+{
+    std::vector<ShardNode> nodes;
+    std::string oldBlock2DataSalt;
+    std::string oldTrustKeySalt;
+    std::string newBlock2DataSalt;
+    std::string newTrustKeySalt;
+
+    // parse reads the config file. Returns false and prints the reason if it
+    // is incomplete.
+    bool parse(const std::string& path);
+};
+
+// Defaults holds the raw default hashed block 2 data and trust key of a card.
+struct Defaults
+{
+    std::string block2Data;
+    std::string trustKey;
+};
+
+// deriveDefaults returns the defaults of the card derived from the salts the
+// same way as defaultBlock2Data and defaultTrustKey in TOrg/digests.php. A
+// new hash scheme is introduced here.
+Defaults deriveDefaults(const std::string& block2DataSalt, const std::string& trustKeySalt,
+    const std::string& hashedTagUid);
+
+// Migration rekeys the shard nodes.
+class Migration
+{
+    public:
+        Migration(const RekeyConfig& config, uint32_t chunkKeys);
+        ~Migration();
+
+        // openCheckpoint loads the chunks already committed and opens the file
+        // for appending. Returns false if it can't be used.
+        bool openCheckpoint(const std::string& path);
+
+        // plan splits the secret key ids of every node into chunks skipping
+        // the checkpointed ones. Returns false if a node is unreachable.
+        bool plan();
+
+        // run migrates the planned chunks on the given number of threads.
+        // Returns false if any chunk failed, running it again retries them.
+        bool run(int threads);
+
+        std::atomic<uint64_t> scannedRows {0};
+        std::atomic<uint64_t> updatedRows {0};
+        std::atomic<uint64_t> doneChunks {0};
+        std::atomic<uint64_t> failedChunks {0};
+
+    private:
+        // Chunk holds the inclusive secret key ids range of a node.
+        struct Chunk
+        {
+            size_t node;
+            uint32_t firstId;
+            uint32_t lastId;
+        };
+
+        // connect opens a connection to the node, returns nullptr on failure.
+        MYSQL* connect(const ShardNode& node);
+
+        // work migrates the queued chunks till none is left.
+        void work();
+
+        // migrateChunk rederives the defaults of the chunk's cards and writes
+        // back the changed rolling passwords in a single transaction.
+        bool migrateChunk(MYSQL* con, const Chunk& chunk);
+
+        // journal appends the committed chunk to the checkpoint file.
+        void journal(const Chunk& chunk);
+
+        const RekeyConfig& m_config;
+        uint32_t m_chunkKeys;
+        size_t m_plannedChunks {0};
+
+        std::mutex m_mutex;
+        std::deque<Chunk> m_chunks;
+        std::set<std::pair<std::string, uint32_t>> m_committed;
+        FILE* m_checkpoint {nullptr};
+};
+
+#endif
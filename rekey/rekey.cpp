@@ -0,0 +1,87 @@
+/*!
+ * @file rekey.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rekey package files. It parses the command line options
+ * and migrates the shard nodes to the new salts.
+ *
+ *  Usage: rekey -c config [-k checkpoint] [-j threads] [-n keys]
+ *      -c  config file holding the shard nodes and the salts, see migration.h.
+ *      -k  checkpoint file, defaults to rekey.checkpoint.
+ *      -j  number of threads, defaults to the number of cores.
+ *      -n  number of secret keys migrated per transaction.
+ *  Exits with 1 if a chunk failed, running it again retries only the chunks
+ *  missing from the checkpoint.
+ *
+ *  The migration runs online:
+ *      1. Set $previous_block2data_salt and $previous_trustkey_salt in
+ *         TOrg/index.php to the old salts and the default salts to the new
+ *         ones. The cards are then served with either.
+ *      2. Run rekey till it completes.
+ *      3. Empty the previous salts and delete the checkpoint file.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "migration.h"
+
+#include <cstdlib>
+#include <thread>
+
+#include <unistd.h>
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    std::string configPath;
+    std::string checkpointPath {"rekey.checkpoint"};
+    int threads {static_cast<int>(std::thread::hardware_concurrency())};
+    long chunkKeys {Settings::DEFAULT_CHUNK_KEYS};
+
+    int option;
+    while ((option = getopt(argc, argv, "c:k:j:n:")) != -1)
+    {
+        switch (option)
+        {
+            case 'c': configPath = optarg; break;
+            case 'k': checkpointPath = optarg; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'n': chunkKeys = atol(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s -c config [-k checkpoint] [-j threads] [-n keys]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (configPath.empty() || chunkKeys <= 0)
+    {
+        fprintf(stderr, "Usage: %s -c config [-k checkpoint] [-j threads] [-n keys]\n", argv[0]);
+        return 1;
+    }
+
+    RekeyConfig config;
+    if (!config.parse(configPath))
+        return 1;
+
+    // The client library must be initialized before the threads use it.
+    if (mysql_library_init(0, nullptr, nullptr) != 0)
+    {
+        fprintf(stderr, "Unable to initialize the MySQL client library.\n");
+        return 1;
+    }
+
+    Migration migration {config, static_cast<uint32_t>(chunkKeys)};
+    bool isDone {migration.openCheckpoint(checkpointPath) && migration.plan() &&
+        migration.run(threads > 0 ? threads : 1)};
+
+    mysql_library_end();
+    return isDone ? 0 : 1;
+}
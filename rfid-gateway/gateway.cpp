@@ -0,0 +1,610 @@
+/*!
+ * @file gateway.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rfid-gateway package files. It is a Linux alternative to
+ * the wifi-module uplink where several PCDs are cabled over USB to a single
+ * host. It speaks the same serial protocol as the WiFi module on each of the
+ * TTYs and multiplexes all the PCDs onto a pool of keep-alive connections to
+ * the trust organization.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "gateway.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////
+// General Purpose Functions
+//////////////////////////////////////////////////
+
+// elapsedUs returns the microseconds elapsed since the provided time point.
+static uint64_t elapsedUs(Clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count();
+}
+
+// configureRawMode sets the TTY to raw 8N1 mode at the common baud rate.
+static bool configureRawMode(int fd)
+{
+    termios tty {};
+    if (tcgetattr(fd, &tty) != 0)
+        return false;
+
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B115200); // Settings::SERIAL_BAUD_RATE
+    cfsetospeed(&tty, B115200);
+    tty.c_cflag |= (CLOCAL | CREAD);
+
+    // The port is non blocking thus a drained read fails with EAGAIN instead
+    // of returning 0, which would look like a hang up.
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+
+    return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+///////////////////////////////////////////////////
+// LatencyStats Members
+//////////////////////////////////////////////////
+
+// record adds a single request latency measured in microseconds.
+void LatencyStats::record(uint64_t latencyUs, bool isSuccessful)
+{
+    ++requests;
+    if (!isSuccessful)
+        ++failures;
+
+    totalUs += latencyUs;
+    minUs = std::min(minUs, latencyUs);
+    maxUs = std::max(maxUs, latencyUs);
+
+    // Bucket 0 holds latencies below 1ms, bucket n below 2^n ms.
+    int bucket {0};
+    for (uint64_t ms {latencyUs / 1000}; ms > 0 && bucket < Settings::latencyBuckets - 1; ms >>= 1)
+        ++bucket;
+    ++buckets[bucket];
+}
+
+///////////////////////////////////////////////////
+// BackendPool Members
+//////////////////////////////////////////////////
+
+// BackendPool constructor starts the workers. Each worker lazily opens its
+// keep-alive connection on the first job. A batchRecords of 1 forwards every
+// PCD request on its own.
+BackendPool::BackendPool(const HttpEndpoint& endpoint, int connections, int batchRecords, int notifyFd)
+    : m_endpoint {endpoint}, m_batchRecords {batchRecords}, m_notifyFd {notifyFd}
+{
+    for (int i {0}; i < connections; ++i)
+        m_workers.emplace_back(&BackendPool::worker, this);
+}
+
+BackendPool::~BackendPool()
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_isStopping = true;
+    }
+    m_hasJobs.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+// submit queues a job to be sent on the next free connection.
+void BackendPool::submit(std::unique_ptr<Job> job)
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_pending.push_back(std::move(job));
+    }
+    m_hasJobs.notify_one();
+}
+
+// completed moves the jobs done so far into the provided list.
+void BackendPool::completed(std::vector<std::unique_ptr<Job>>& done)
+{
+    std::lock_guard<std::mutex> lock {m_mutex};
+    for (auto& job : m_done)
+        done.push_back(std::move(job));
+    m_done.clear();
+}
+
+// worker serves jobs on a single keep-alive connection.
+void BackendPool::worker()
+{
+    HttpConnection connection {m_endpoint, Settings::CONNECTION_TIMEOUT_MS};
+
+    for (;;)
+    {
+        std::vector<std::unique_ptr<Job>> jobs;
+        {
+            std::unique_lock<std::mutex> lock {m_mutex};
+            m_hasJobs.wait(lock, [this]{ return m_isStopping || !m_pending.empty(); });
+            if (m_pending.empty())
+                break; // Stopping with no pending jobs.
+
+            jobs.push_back(std::move(m_pending.front()));
+            m_pending.pop_front();
+
+            // The PCD requests queued behind it join the batch in their order.
+            for (auto it {m_pending.begin()}; jobs.front()->expectsReply && it != m_pending.end() &&
+                static_cast<int>(jobs.size()) < m_batchRecords;)
+            {
+                if ((*it)->expectsReply)
+                {
+                    jobs.push_back(std::move(*it));
+                    it = m_pending.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+
+        if (jobs.size() > 1)
+            postBatch(connection, jobs);
+        else
+        {
+            Job& job {*jobs.front()};
+            const char* contentType {job.expectsReply ? "application/x-www-form-urlencoded"
+                                                      : "application/octet-stream"};
+            job.status = connection.post(job.path, contentType, job.body, job.reply);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            for (auto& job : jobs)
+                m_done.push_back(std::move(job));
+        }
+
+        // Wake up the event loop to write back the response.
+        uint64_t count {1};
+        if (write(m_notifyFd, &count, sizeof(count)) < 0)
+            perror("eventfd write");
+    }
+}
+
+// postBatch forwards the PCD requests in a single batch request. Each record
+// and each result is prefixed by its 1 byte length. The results are handed
+// back to the jobs in order as if they were sent on their own.
+void BackendPool::postBatch(HttpConnection& connection, std::vector<std::unique_ptr<Job>>& jobs)
+{
+    std::string body;
+    for (auto& job : jobs)
+    {
+        body += static_cast<char>(job->body.size());
+        body += job->body;
+    }
+
+    std::string reply;
+    int status {connection.post(m_endpoint.path + Settings::BATCH_API_QUERY, "application/octet-stream", body, reply)};
+
+    size_t offset {0};
+    for (auto& job : jobs)
+    {
+        job->status = status;
+        if (status != 200)
+            continue;
+
+        if (offset >= reply.size() || offset + 1 + static_cast<byte>(reply[offset]) > reply.size())
+        {
+            job->status = HttpConnection::HTTPC_ERROR_CONNECTION_FAILED; // Truncated batch response.
+            continue;
+        }
+
+        size_t size {static_cast<byte>(reply[offset])};
+        job->reply = reply.substr(offset + 1, size);
+        offset += 1 + size;
+    }
+}
+
+///////////////////////////////////////////////////
+// Gateway Members
+//////////////////////////////////////////////////
+
+// Gateway constructor sets up the event loop and the backend pool.
+Gateway::Gateway(const HttpEndpoint& endpoint, int connections, int batchRecords)
+    : m_endpoint {endpoint}
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = UINT64_MAX; // Identifies the pool completion events.
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &event);
+
+    m_pool.reset(new BackendPool(endpoint, connections, batchRecords, m_eventFd));
+}
+
+Gateway::~Gateway()
+{
+    m_pool.reset(); // Join the workers before closing their notification fd.
+
+    for (auto& port : m_ports)
+        if (port->fd >= 0)
+            close(port->fd);
+
+    close(m_eventFd);
+    close(m_epollFd);
+    if (m_signalFd >= 0)
+        close(m_signalFd);
+}
+
+// addPort opens and configures a TTY. Returns false on failure.
+bool Gateway::addPort(const std::string& path)
+{
+    int fd {open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)};
+    if (fd < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+
+    if (!configureRawMode(fd))
+    {
+        perror(path.c_str());
+        close(fd);
+        return false;
+    }
+
+    return registerPort(fd, path);
+}
+
+// addPseudoTerminal creates a pty whose slave side acts as the PCD. This
+// allows the gateway to be tested without any attached PCD hardware.
+std::string Gateway::addPseudoTerminal()
+{
+    int fd {posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)};
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || !configureRawMode(fd))
+    {
+        perror("posix_openpt");
+        if (fd >= 0)
+            close(fd);
+        return "";
+    }
+
+    std::string name {ptsname(fd)};
+
+    // Holding the slave side open prevents hang ups on the master side while
+    // no test PCD is attached. It is never read from.
+    if (open(name.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC) < 0)
+        perror(name.c_str());
+
+    return registerPort(fd, name) ? name : "";
+}
+
+// registerPort adds the opened port fd to the event loop.
+bool Gateway::registerPort(int fd, const std::string& name)
+{
+    std::unique_ptr<ReaderPort> port {new ReaderPort()};
+    port->name = name;
+    port->fd = fd;
+    port->lastUpload = Clock::now();
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = m_ports.size();
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        perror("epoll_ctl");
+        close(fd);
+        return false;
+    }
+
+    m_ports.push_back(std::move(port));
+    return true;
+}
+
+// run handles events till SIGINT or SIGTERM is received. SIGUSR1 prints the
+// metrics collected so far. The signals must be blocked by the caller before
+// the gateway is created so that the pool workers inherit the mask.
+void Gateway::run(int statsIntervalSec)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    m_signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = UINT64_MAX - 1; // Identifies the signal events.
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_signalFd, &event);
+
+    Clock::time_point lastStats {Clock::now()};
+    const auto frameGap = std::chrono::milliseconds(Settings::FRAME_GAP_MS);
+
+    for (;;)
+    {
+        // Wake up in time to close the earliest pending frame.
+        int timeoutMs {1000};
+        Clock::time_point now {Clock::now()};
+        for (auto& port : m_ports)
+            if (port->frameSize > 0)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    port->lastByte + frameGap - now).count();
+                timeoutMs = std::min<int>(timeoutMs, std::max<int>(0, left + 1));
+            }
+
+        epoll_event events[32];
+        int count {epoll_wait(m_epollFd, events, 32, timeoutMs)};
+        if (count < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i {0}; i < count; ++i)
+        {
+            uint64_t id {events[i].data.u64};
+            if (id == UINT64_MAX)
+            {
+                uint64_t value;
+                while (read(m_eventFd, &value, sizeof(value)) > 0)
+                    ;
+                handleCompleted();
+            }
+            else if (id == UINT64_MAX - 1)
+            {
+                signalfd_siginfo info;
+                while (read(m_signalFd, &info, sizeof(info)) == sizeof(info))
+                {
+                    if (info.ssi_signo == SIGUSR1)
+                        printStats();
+                    else
+                        return;
+                }
+            }
+            else
+                handleInput(static_cast<int>(id), events[i].events);
+        }
+
+        // Complete the frames whose inter-byte gap has expired.
+        now = Clock::now();
+        for (size_t i {0}; i < m_ports.size(); ++i)
+        {
+            if (m_ports[i]->frameSize > 0 && now - m_ports[i]->lastByte >= frameGap)
+                dispatchFrame(static_cast<int>(i));
+
+            uploadTelemetry(static_cast<int>(i), false);
+        }
+
+        if (statsIntervalSec > 0 && now - lastStats >= std::chrono::seconds(statsIntervalSec))
+        {
+            printStats();
+            lastStats = now;
+        }
+    }
+}
+
+// handleInput reads the available bytes on a port. Bytes beyond the maximum
+// request size are dropped similar to the WiFi module serial reads. The port
+// is closed once the TTY is hung up i.e. EPOLLHUP, EPOLLERR or EIO.
+void Gateway::handleInput(int portIndex, uint32_t events)
+{
+    ReaderPort& port {*m_ports[portIndex]};
+    bool isHungUp {(events & (EPOLLHUP | EPOLLERR)) != 0};
+
+    byte buffer[256];
+    while (!isHungUp)
+    {
+        ssize_t n {read(port.fd, buffer, sizeof(buffer))};
+        if (n > 0)
+        {
+            int space {Settings::MaxReqSize - port.frameSize};
+            int toCopy {std::min<int>(space, static_cast<int>(n))};
+            memcpy(port.frame + port.frameSize, buffer, toCopy);
+            port.frameSize += toCopy;
+            port.lastByte = Clock::now();
+            continue;
+        }
+
+        // A drained TTY may return 0 or EAGAIN, neither means it was hung up.
+        if (n == 0 || errno == EAGAIN || errno == EINTR)
+            return;
+
+        isHungUp = true;
+    }
+
+    // The TTY was hung up, e.g. the PCD was unplugged.
+    fprintf(stderr, "[%s] port closed\n", port.name.c_str());
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, port.fd, nullptr);
+    close(port.fd);
+    port.fd = -1;
+    port.frameSize = 0;
+}
+
+// dispatchFrame handles a complete request frame the same way the WiFi
+// module's handleEvents does.
+void Gateway::dispatchFrame(int portIndex)
+{
+    ReaderPort& port {*m_ports[portIndex]};
+    int size {port.frameSize};
+    port.frameSize = 0;
+
+    // The PCD sends the ACK signal repeatedly on boot up till READY is received.
+    // It is also answered after the handshake in case the PCD restarted.
+    const int ackSize {Settings::ACK_SIGNAL_SIZE - 1};
+    if (size >= ackSize && memcmp(port.frame, Settings::ACK_SIGNAL, ackSize) == 0)
+    {
+        writeAll(port.fd, Settings::READY_SIGNAL, Settings::READY_SIGNAL_SIZE - 1);
+        port.isReady = true;
+        return;
+    }
+
+    if (!port.isReady)
+        return;
+
+    if (size == Settings::TelemetryDataSize && port.frame[0] == Settings::TELEMETRY_MARKER)
+    {
+        // Telemetry records expect no response thus are only buffered.
+        const size_t maxBuffered {8 * Settings::TELEMETRY_BATCH_RECORDS * Settings::TelemetryDataSize};
+        if (port.telemetry.size() < maxBuffered)
+            port.telemetry.append(reinterpret_cast<char*>(port.frame), size);
+        return;
+    }
+
+    if (port.isBusy)
+    {
+        fprintf(stderr, "[%s] frame dropped, a request is in progress\n", port.name.c_str());
+        return;
+    }
+
+    if (size != Settings::SecretKeyAuthDataSize && size != Settings::TrustKeyAuthDataSize &&
+        size != Settings::TrustKeyTokenAuthDataSize)
+    {
+        // Invalid data size found.
+        port.stats.record(0, false);
+        writeAll(port.fd, &Settings::HTTP_CLIENT_ERROR, 1);
+        return;
+    }
+
+    const Settings::RequestHeader& header {*reinterpret_cast<const Settings::RequestHeader*>(port.frame)};
+    memcpy(port.deviceId, header.deviceId, sizeof(port.deviceId));
+    port.hasDeviceId = true;
+
+    std::unique_ptr<Job> job {new Job()};
+    job->portIndex = portIndex;
+    job->expectsReply = true;
+    job->path = m_endpoint.path;
+    job->body.assign(reinterpret_cast<char*>(port.frame), size);
+    job->received = port.lastByte;
+
+    port.isBusy = true;
+    m_pool->submit(std::move(job));
+}
+
+// handleCompleted writes back responses of the completed jobs.
+void Gateway::handleCompleted()
+{
+    std::vector<std::unique_ptr<Job>> done;
+    m_pool->completed(done);
+
+    for (auto& job : done)
+    {
+        ReaderPort& port {*m_ports[job->portIndex]};
+        bool isSuccessful {job->status == 200};
+
+        if (!job->expectsReply)
+        {
+            // Failed telemetry uploads are retried on the next interval.
+            if (!isSuccessful)
+                port.telemetry.insert(0, job->body.substr(sizeof(port.deviceId)));
+            continue;
+        }
+
+        port.isBusy = false;
+        if (port.fd < 0)
+            continue;
+
+        if (isSuccessful)
+            writeAll(port.fd, job->reply.data(), job->reply.size());
+        else
+        {
+            byte errorCode {job->status < 0 ? Settings::HTTP_CLIENT_ERROR : Settings::HTTP_SERVER_ERROR};
+            writeAll(port.fd, &errorCode, 1);
+        }
+
+        port.stats.record(elapsedUs(job->received), isSuccessful);
+    }
+}
+
+// uploadTelemetry submits the buffered telemetry records of a port in batches
+// once the upload interval expires or a full batch is buffered.
+void Gateway::uploadTelemetry(int portIndex, bool isForced)
+{
+    ReaderPort& port {*m_ports[portIndex]};
+    const size_t batchSize {Settings::TELEMETRY_BATCH_RECORDS * Settings::TelemetryDataSize};
+
+    if (port.telemetry.empty() || !port.hasDeviceId)
+        return;
+
+    bool isDue {Clock::now() - port.lastUpload >= std::chrono::milliseconds(Settings::TELEMETRY_UPLOAD_INTERVAL_MS)};
+    if (!isForced && !isDue && port.telemetry.size() < batchSize)
+        return;
+
+    port.lastUpload = Clock::now();
+
+    std::unique_ptr<Job> job {new Job()};
+    job->portIndex = portIndex;
+    job->expectsReply = false;
+    job->path = m_endpoint.path + Settings::TELEMETRY_API_QUERY;
+    job->body.assign(reinterpret_cast<char*>(port.deviceId), sizeof(port.deviceId));
+    job->body += port.telemetry.substr(0, batchSize);
+    job->received = port.lastUpload;
+    port.telemetry.erase(0, batchSize);
+
+    m_pool->submit(std::move(job));
+}
+
+// writeAll writes the whole buffer to a non-blocking port.
+void Gateway::writeAll(int fd, const void* data, size_t size)
+{
+    const byte* bytes {static_cast<const byte*>(data)};
+    while (size > 0)
+    {
+        ssize_t n {write(fd, bytes, size)};
+        if (n > 0)
+        {
+            bytes += n;
+            size -= static_cast<size_t>(n);
+        }
+        else if (n < 0 && errno == EAGAIN)
+        {
+            pollfd pfd {fd, POLLOUT, 0};
+            poll(&pfd, 1, Settings::FRAME_GAP_MS);
+        }
+        else if (n < 0 && errno != EINTR)
+            return;
+    }
+}
+
+// printStats writes the per PCD latency metrics to the stdout. The histogram
+// lists the request counts per power of two millisecond bucket.
+void Gateway::printStats() const
+{
+    printf("%-24s %8s %8s %10s %10s %10s  histogram(<1ms,<2ms,<4ms...)\n",
+        "port", "requests", "failures", "avg(ms)", "min(ms)", "max(ms)");
+
+    for (auto& port : m_ports)
+    {
+        const LatencyStats& stats {port->stats};
+        double avgMs {stats.requests ? stats.totalUs / 1000.0 / stats.requests : 0.0};
+        double minMs {stats.requests ? stats.minUs / 1000.0 : 0.0};
+
+        printf("%-24s %8llu %8llu %10.2f %10.2f %10.2f ", port->name.c_str(),
+            static_cast<unsigned long long>(stats.requests),
+            static_cast<unsigned long long>(stats.failures),
+            avgMs, minMs, stats.maxUs / 1000.0);
+
+        for (int i {0}; i < Settings::latencyBuckets; ++i)
+            printf("%c%llu", i ? ',' : ' ', static_cast<unsigned long long>(stats.buckets[i]));
+        printf("\n");
+    }
+    fflush(stdout);
+}
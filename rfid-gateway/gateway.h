@@ -0,0 +1,228 @@
+/*!
+ * @file gateway.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rfid-gateway package files. It is a Linux alternative to
+ * the wifi-module uplink where several PCDs are cabled over USB to a single
+ * host. It speaks the same serial protocol as the WiFi module on each of the
+ * TTYs and multiplexes all the PCDs onto a pool of keep-alive connections to
+ * the trust organization.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_GATEWAY__
+#define __RFID_GATEWAY__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "commonRFID.h"
+#include "httpClient.h"
+
+namespace Settings
+{
+    // Import the common settings configurations here.
+    using namespace CommonRFID;
+
+    // FRAME_GAP_MS defines the serial inter-byte gap in ms that marks the end
+    // of a request frame. It matches the WiFi module's serial read timeout.
+    constexpr int FRAME_GAP_MS {30};
+
+    // DEFAULT_CONNECTIONS defines the default number of keep-alive connections
+    // held open to the trust organization.
+    constexpr int DEFAULT_CONNECTIONS {4};
+
+    // CONNECTION_TIMEOUT_MS defines the send and receive timeout in ms on the
+    // trust organization connections.
+    constexpr int CONNECTION_TIMEOUT_MS {AUTH_DELAY};
+
+    // TELEMETRY_BATCH_RECORDS defines the maximum number of telemetry records
+    // uploaded in a single request.
+    constexpr int TELEMETRY_BATCH_RECORDS {64};
+
+    // TELEMETRY_UPLOAD_INTERVAL_MS defines the interval between telemetry
+    // uploads unless a full batch is already buffered.
+    constexpr int TELEMETRY_UPLOAD_INTERVAL_MS {60000};
+
+    // TELEMETRY_API_QUERY is appended to the API path to identify the
+    // telemetry ingestion endpoint.
+    constexpr const char* TELEMETRY_API_QUERY {"?telemetry"};
+
+    // DEFAULT_BATCH_RECORDS defines the default maximum number of queued PCD
+    // requests a connection forwards together in a single batch request.
+    constexpr int DEFAULT_BATCH_RECORDS {32};
+
+    // BATCH_MAX_RECORDS defines the most PCD requests a batch request can
+    // hold, it matches BATCH_MAX_RECORDS in TOrg/batch.php.
+    constexpr int BATCH_MAX_RECORDS {64};
+
+    // BATCH_API_QUERY is appended to the API path to identify the batch
+    // verification endpoint.
+    constexpr const char* BATCH_API_QUERY {"?batch"};
+
+    // HTTP_CLIENT_ERROR and HTTP_SERVER_ERROR are the single byte failure
+    // responses the WiFi module sends back to the PCD.
+    constexpr byte HTTP_CLIENT_ERROR {1};
+    constexpr byte HTTP_SERVER_ERROR {2};
+
+    // latencyBuckets defines the number of power of two latency histogram
+    // buckets from 1ms to 2^(latencyBuckets-1)ms and above.
+    constexpr int latencyBuckets {14};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// LatencyStats holds the per PCD request latency metrics.
+struct LatencyStats
+{
+    uint64_t requests {0};
+    uint64_t failures {0};
+    uint64_t totalUs {0};
+    uint64_t minUs {UINT64_MAX};
+    uint64_t maxUs {0};
+    uint64_t buckets[Settings::latencyBuckets] {};
+
+    // record adds a single request latency measured in microseconds.
+    void record(uint64_t latencyUs, bool isSuccessful);
+};
+
+// Job defines a single request forwarded to the trust organization.
+struct Job
+{
+    int portIndex;              // Index of the PCD port the request came from.
+    bool expectsReply;          // False for telemetry uploads.
+    std::string path;           // Request path and query.
+    std::string body;           // Binary request body.
+    Clock::time_point received; // Time the request frame was completed.
+
+    int status {0};             // HTTP status code, negative on client errors.
+    std::string reply;          // Response body.
+};
+
+// BackendPool holds a pool of workers each with a keep-alive connection to
+// the trust organization. Jobs are served in the order they are submitted.
+// While all the connections are busy the PCD requests queued up are
+// forwarded together in a single batch request by the next free worker.
+class BackendPool
+{
+    public:
+        BackendPool(const HttpEndpoint& endpoint, int connections, int batchRecords, int notifyFd);
+        ~BackendPool();
+
+        // submit queues a job to be sent on the next free connection.
+        void submit(std::unique_ptr<Job> job);
+
+        // completed moves the jobs done so far into the provided list.
+        void completed(std::vector<std::unique_ptr<Job>>& done);
+
+    private:
+        // worker serves jobs on a single keep-alive connection.
+        void worker();
+
+        // postBatch forwards the PCD requests in a single batch request.
+        void postBatch(HttpConnection& connection, std::vector<std::unique_ptr<Job>>& jobs);
+
+        HttpEndpoint m_endpoint;
+        int m_batchRecords;
+        int m_notifyFd;
+        bool m_isStopping {false};
+
+        std::mutex m_mutex;
+        std::condition_variable m_hasJobs;
+        std::deque<std::unique_ptr<Job>> m_pending;
+        std::vector<std::unique_ptr<Job>> m_done;
+        std::vector<std::thread> m_workers;
+};
+
+// ReaderPort manages a single PCD attached on a TTY.
+struct ReaderPort
+{
+    std::string name;           // TTY path or pty slave name.
+    int fd {-1};
+
+    // isReady is set once the ACK signal has been answered with READY.
+    bool isReady {false};
+
+    // isBusy is set while a request is waiting on the trust organization.
+    // The PCD never pipelines requests thus frames received are dropped.
+    bool isBusy {false};
+
+    byte frame[Settings::MaxReqSize];
+    int frameSize {0};
+    Clock::time_point lastByte;
+
+    // deviceId is learnt from the request frames and is required to upload
+    // the telemetry records sent by the PCD.
+    byte deviceId[sizeof(Settings::DEVICE_ID)] {};
+    bool hasDeviceId {false};
+
+    std::string telemetry;
+    Clock::time_point lastUpload;
+
+    LatencyStats stats;
+};
+
+// Gateway runs the epoll event loop over all the PCD ports.
+class Gateway
+{
+    public:
+        Gateway(const HttpEndpoint& endpoint, int connections, int batchRecords);
+        ~Gateway();
+
+        // addPort opens and configures a TTY. Returns false on failure.
+        bool addPort(const std::string& path);
+
+        // addPseudoTerminal creates a pty whose slave side acts as the PCD.
+        // Returns the slave name or an empty string on failure.
+        std::string addPseudoTerminal();
+
+        // run handles events till SIGINT or SIGTERM is received.
+        void run(int statsIntervalSec);
+
+        // printStats writes the per PCD latency metrics to the stdout.
+        void printStats() const;
+
+    private:
+        // registerPort adds the opened port fd to the event loop.
+        bool registerPort(int fd, const std::string& name);
+
+        // handleInput reads the available bytes on a port given its epoll events.
+        void handleInput(int portIndex, uint32_t events);
+
+        // dispatchFrame handles a complete request frame.
+        void dispatchFrame(int portIndex);
+
+        // handleCompleted writes back responses of the completed jobs.
+        void handleCompleted();
+
+        // uploadTelemetry submits the buffered telemetry records of a port.
+        void uploadTelemetry(int portIndex, bool isForced);
+
+        // writeAll writes the whole buffer to a non-blocking port.
+        void writeAll(int fd, const void* data, size_t size);
+
+        HttpEndpoint m_endpoint;
+        int m_epollFd {-1};
+        int m_eventFd {-1};
+        int m_signalFd {-1};
+        std::vector<std::unique_ptr<ReaderPort>> m_ports;
+        std::unique_ptr<BackendPool> m_pool;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*!
+ * @file rfid-gateway.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part rfid-gateway package files. It parses the command line
+ * options and runs the gateway event loop.
+ *
+ *  Usage: rfid-gateway [-u url] [-c connections] [-b records] [-p ptys] [-s seconds] [tty...]
+ *      -u  trust organization API url, defaults to SERVER_API_URL.
+ *      -c  number of keep-alive connections to the trust organization.
+ *      -b  maximum number of queued PCD requests forwarded in a single batch
+ *          request while all the connections are busy, 1 disables batching.
+ *          Clamped to BATCH_MAX_RECORDS (64), the most the trust organization
+ *          accepts in a batch.
+ *      -p  number of pseudo-terminals to create. Their slave names are printed
+ *          and can be opened by a test script acting as the PCD.
+ *      -s  interval in seconds at which the latency metrics are printed.
+ *  Sending SIGUSR1 to the process prints the latency metrics at any time.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "gateway.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    std::string url {Settings::SERVER_API_URL};
+    int connections {Settings::DEFAULT_CONNECTIONS};
+    int batchRecords {Settings::DEFAULT_BATCH_RECORDS};
+    int ptys {0};
+    int statsInterval {0};
+
+    int option;
+    while ((option = getopt(argc, argv, "u:c:b:p:s:")) != -1)
+    {
+        switch (option)
+        {
+            case 'u': url = optarg; break;
+            case 'c': connections = std::max(1, atoi(optarg)); break;
+            case 'b': batchRecords = std::clamp(atoi(optarg), 1, Settings::BATCH_MAX_RECORDS); break;
+            case 'p': ptys = atoi(optarg); break;
+            case 's': statsInterval = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-u url] [-c connections] [-b records] [-p ptys] [-s seconds] [tty...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    HttpEndpoint endpoint;
+    if (!endpoint.parse(url))
+    {
+        fprintf(stderr, "Unsupported trust organization url: %s\n", url.c_str());
+        return 1;
+    }
+
+    // Block the handled signals before the pool workers are created so that
+    // they are only delivered to the event loop.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    Gateway gateway {endpoint, connections, batchRecords};
+
+    int portsCount {0};
+    for (int i {optind}; i < argc; ++i)
+        portsCount += gateway.addPort(argv[i]) ? 1 : 0;
+
+    for (int i {0}; i < ptys; ++i)
+    {
+        std::string name {gateway.addPseudoTerminal()};
+        if (!name.empty())
+        {
+            printf("pty: %s\n", name.c_str());
+            ++portsCount;
+        }
+    }
+    fflush(stdout);
+
+    if (portsCount == 0)
+    {
+        fprintf(stderr, "No PCD ports to serve.\n");
+        return 1;
+    }
+
+    gateway.run(statsInterval);
+    gateway.printStats();
+
+    return 0;
+}
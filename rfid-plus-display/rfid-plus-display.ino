@@ -23,6 +23,32 @@
 // responded to immediately.
 void handleInterrupt() {  onInterrupt = true; }
 
+#ifndef UPLINK_OVER_USB
+// handleMaintenanceCommand runs the maintenance command received over the USB
+// Serial i.e. "BENCH [N]" runs the self benchmark and "UPLINK" prints the
+// uplink traffic class stats. Any other input is ignored.
+void handleMaintenanceCommand(Transmitter& rfid)
+{
+    char command[16] {};
+    Serial.readBytesUntil('\n', command, sizeof(command) - 1);
+
+    if (strncmp(command, Settings::UPLINK_STATS_COMMAND, strlen(Settings::UPLINK_STATS_COMMAND)) == 0)
+    {
+        rfid.dumpUplinkStats();
+        return;
+    }
+
+    size_t size {strlen(Settings::BENCH_COMMAND)};
+    if (strncmp(command, Settings::BENCH_COMMAND, size) != 0)
+        return;
+
+    long iterations {atol(command + size)};
+    if (iterations <= 0)
+        iterations = Settings::BENCH_DEFAULT_ITERATIONS;
+    rfid.runSelfBenchmark((iterations > Settings::BENCH_MAX_ITERATIONS) ? Settings::BENCH_MAX_ITERATIONS : iterations);
+}
+#endif
+
 // Main function.
 int main(void)
 {
@@ -33,10 +59,10 @@ int main(void)
 #endif
 
     Serial.begin(Settings::SERIAL_BAUD_RATE);
-    Serial1.begin(Settings::SERIAL_BAUD_RATE);
+    UPLINK_SERIAL.begin(Settings::SERIAL_BAUD_RATE);
 
     // Wait for refresh delay before timing out a serial1 readbytes operation.
-    Serial1.setTimeout(Settings::REFRESH_DELAY);
+    UPLINK_SERIAL.setTimeout(Settings::REFRESH_DELAY);
 
     // LCD Pins Configuration
     const uint8_t LCD_RST {12};
@@ -67,13 +93,13 @@ int main(void)
 
     char buffer[Settings::READY_SIGNAL_SIZE];
     // Delay further initialization progress until the WiFi is configured.
-    // Waits until the READY signal is received. Serial1.readBytes() takes
+    // Waits until the READY signal is received. UPLINK_SERIAL.readBytes() takes
     // about 1 secs to timeout thus no delay function is neccesary here.
     for(;;)
     {
-        Serial1.write(Settings::ACK_SIGNAL); // Send ACK signal.
+        UPLINK_SERIAL.write(Settings::ACK_SIGNAL); // Send ACK signal.
 
-        Serial1.readBytes(buffer, Settings::READY_SIGNAL_SIZE);
+        UPLINK_SERIAL.readBytes(buffer, Settings::READY_SIGNAL_SIZE);
         // readByte() doesn't return a none-null terminated string thus -1 is used.
         if (memcmp(Settings::READY_SIGNAL, buffer, Settings::READY_SIGNAL_SIZE-1) == 0)
             break; // exit the loop
@@ -88,7 +114,7 @@ int main(void)
     Transmitter rfid {RFID_SS, RFID_RST, view};
 
     // Wait for at least 5 secs before timing out a serial1 readbytes operation.
-    Serial1.setTimeout(Settings::AUTH_DELAY);
+    UPLINK_SERIAL.setTimeout(Settings::AUTH_DELAY);
 
     // setup the IRQ pin
     pinMode(RFID_IRQ, INPUT_PULLUP);
@@ -109,6 +135,13 @@ int main(void)
     rfid.setDetailsMsg((char*)"The weather today is too cold for me (:!  ", true);
 
 	for(;;) {
+#ifndef UPLINK_OVER_USB
+        // The maintenance commands are received over the USB Serial thus they
+        // are unavailable when the USB Serial is the uplink.
+        if (Serial.available() > 0)
+            handleMaintenanceCommand(rfid);
+#endif
+
         if (onInterrupt)
             // Handle the interrupt if it has been detected.
             rfid.handleDetectedCard();
@@ -117,6 +150,10 @@ int main(void)
             // can confirm if there is an interrupt to be handled.
             rfid.activateTransmission();
 
+        // Queued bulk frames e.g. the telemetry records are only written while
+        // no card is waiting.
+        rfid.pollUplink();
+
         // Timer delay also prints the contents to the display.
         rfid.timerDelay(Settings::REFRESH_DELAY);
 	}
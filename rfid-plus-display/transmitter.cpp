@@ -39,16 +39,224 @@ volatile bool onInterrupt {false};
 //         Serial.println();
 // }
 
-// sendSerialData emptys the Serial1 buffer before writting new content to it.
+// sendSerialData emptys the uplink serial buffer before writting new content to it.
 // The data written is serially accessible to the Wi-Fi Module.
 void sendSerialData(byte* data, byte dataSize)
 {
     // Make the serial transfer of the complete data.
-    // Before writing into Serial1 cleanup its buffer first.
-    while(Serial1.available() > 0)
-        Serial1.read(); // reads till the buffer is empty.
+    // Before writing into the uplink serial cleanup its buffer first.
+    while(UPLINK_SERIAL.available() > 0)
+        UPLINK_SERIAL.read(); // reads till the buffer is empty.
 
-    Serial1.write(data, dataSize); // Write the data into the serial transmission.
+    UPLINK_SERIAL.write(data, dataSize); // Write the data into the serial transmission.
+}
+
+///////////////////////////////////////////////////
+// UplinkScheduler Class Members
+//////////////////////////////////////////////////
+
+// sendTap writes the tap frame once the frame gap has passed. A tap only waits
+// if a bulk frame was written right before it.
+void UplinkScheduler::sendTap(byte* data, byte dataSize)
+{
+    // The WiFi module must see the end of the previous frame.
+    unsigned long queuedAt {millis()};
+    if (m_lastWrite != 0 && queuedAt - m_lastWrite < Settings::UPLINK_FRAME_GAP)
+        delay(Settings::UPLINK_FRAME_GAP - (queuedAt - m_lastWrite));
+
+    sendSerialData(data, dataSize);
+    recordSent(TapClass, queuedAt);
+}
+
+// queueBulk queues a copy of the bulk frame. Returns false if the frame was
+// dropped as the queue is full or the frame is too large.
+bool UplinkScheduler::queueBulk(const byte* data, byte dataSize)
+{
+    ClassStats& stats {m_stats[BulkClass]};
+    if (stats.depth == Settings::UPLINK_BULK_SLOTS || dataSize > Settings::TelemetryDataSize)
+    {
+        ++stats.dropped;
+        return false;
+    }
+
+    byte slot {static_cast<byte>((m_bulkHead + stats.depth) % Settings::UPLINK_BULK_SLOTS)};
+    memcpy(m_bulk[slot], data, dataSize);
+    m_bulkSizes[slot] = dataSize;
+    m_bulkQueuedAt[slot] = millis();
+
+    ++stats.depth;
+    stats.maxDepth = max(stats.maxDepth, stats.depth);
+    return true;
+}
+
+// poll writes the oldest queued bulk frame if the uplink has been idle long
+// enough and no card is waiting to be handled.
+void UplinkScheduler::poll()
+{
+    if (m_stats[BulkClass].depth == 0 || onInterrupt ||
+        millis() - m_lastWrite < Settings::UPLINK_BULK_IDLE)
+        return;
+
+    sendSerialData(m_bulk[m_bulkHead], m_bulkSizes[m_bulkHead]);
+    recordSent(BulkClass, m_bulkQueuedAt[m_bulkHead]);
+
+    m_bulkHead = (m_bulkHead + 1) % Settings::UPLINK_BULK_SLOTS;
+    --m_stats[BulkClass].depth;
+}
+
+// recordSent adds a written frame to the traffic class stats.
+void UplinkScheduler::recordSent(TrafficClass trafficClass, unsigned long queuedAt)
+{
+    m_lastWrite = millis();
+
+    ClassStats& stats {m_stats[trafficClass]};
+    uint16_t waitMs {static_cast<uint16_t>(min(m_lastWrite - queuedAt, 0xFFFFUL))};
+    stats.maxWaitMs = max(stats.maxWaitMs, waitMs);
+    stats.totalWaitMs += waitMs;
+    ++stats.sent;
+}
+
+// dumpStats writes the stats of each traffic class over the USB Serial e.g.
+// "tap depth=0 max_depth=0 dropped=0 sent=12 avg_wait_ms=0 max_wait_ms=0".
+void UplinkScheduler::dumpStats() const
+{
+    static const char* const classNames[classesCount] {"tap", "bulk"};
+
+    for (byte i {0}; i < classesCount; ++i)
+    {
+        const ClassStats& stats {m_stats[i]};
+        Serial.print(classNames[i]);
+        Serial.print(F(" depth="));
+        Serial.print(stats.depth);
+        Serial.print(F(" max_depth="));
+        Serial.print(stats.maxDepth);
+        Serial.print(F(" dropped="));
+        Serial.print(stats.dropped);
+        Serial.print(F(" sent="));
+        Serial.print(stats.sent);
+        Serial.print(F(" avg_wait_ms="));
+        Serial.print(stats.sent ? stats.totalWaitMs / stats.sent : 0);
+        Serial.print(F(" max_wait_ms="));
+        Serial.println(stats.maxWaitMs);
+    }
+}
+
+///////////////////////////////////////////////////
+// Reader Class Members
+//////////////////////////////////////////////////
+
+// crcAEntry returns the CRC_A table entry of the byte value i.e. the ISO 14443A
+// polynomial x^16 + x^12 + x^5 + 1 reflected, shifted over its 8 bits.
+constexpr uint16_t crcAEntry(uint16_t crc, byte bits = 8)
+{
+    return (bits == 0) ? crc : crcAEntry((crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1), bits - 1);
+}
+
+static_assert(crcAEntry(0x01) == 0x1189 && crcAEntry(0x80) == 0x8408, "CRC_A table entries are wrong");
+
+#define CRC_A_ENTRIES_4(n) crcAEntry(n), crcAEntry(n + 1), crcAEntry(n + 2), crcAEntry(n + 3)
+#define CRC_A_ENTRIES_16(n) CRC_A_ENTRIES_4(n), CRC_A_ENTRIES_4(n + 4), CRC_A_ENTRIES_4(n + 8), CRC_A_ENTRIES_4(n + 12)
+#define CRC_A_ENTRIES_64(n) CRC_A_ENTRIES_16(n), CRC_A_ENTRIES_16(n + 16), CRC_A_ENTRIES_16(n + 32), CRC_A_ENTRIES_16(n + 48)
+
+// CRC_A_TABLE is generated at compile time and kept in flash, it would take up
+// a fifth of the SRAM otherwise.
+constexpr uint16_t CRC_A_TABLE[256] PROGMEM {
+    CRC_A_ENTRIES_64(0), CRC_A_ENTRIES_64(64), CRC_A_ENTRIES_64(128), CRC_A_ENTRIES_64(192)
+};
+
+// calculateCrc writes the CRC_A of the data into result, low byte first.
+void Reader::calculateCrc(const byte* data, byte length, byte* result)
+{
+    uint16_t crc {0x6363}; // ISO 14443A preset.
+    for (byte i {0}; i < length; ++i)
+        crc = (crc >> 8) ^ pgm_read_word(&CRC_A_TABLE[(crc ^ data[i]) & 0xFF]);
+
+    result[0] = crc & 0xFF;
+    result[1] = crc >> 8;
+}
+
+// MIFARE_Read reads the 16 bytes of the block and checks their CRC_A. It
+// follows the MFRC522 library's MIFARE_Read.
+MFRC522::StatusCode Reader::MIFARE_Read(byte blockAddr, byte* buffer, byte* bufferSize)
+{
+    if (buffer == nullptr || *bufferSize < 18)
+        return STATUS_NO_ROOM;
+
+    buffer[0] = PICC_CMD_MF_READ;
+    buffer[1] = blockAddr;
+    calculateCrc(buffer, 2, &buffer[2]);
+
+    byte validBits {0};
+    StatusCode status {PCD_TransceiveData(buffer, 4, buffer, bufferSize, &validBits)};
+    if (status != STATUS_OK)
+        return status;
+
+    // A 4 bits response is a NAK e.g. the block isn't readable with the key.
+    if (*bufferSize == 1 && validBits == 4)
+        return STATUS_MIFARE_NACK;
+    if (*bufferSize < 2 || validBits != 0)
+        return STATUS_CRC_WRONG;
+
+    byte crc[2];
+    calculateCrc(buffer, *bufferSize - 2, crc);
+    if (buffer[*bufferSize - 2] != crc[0] || buffer[*bufferSize - 1] != crc[1])
+        return STATUS_CRC_WRONG;
+
+    return STATUS_OK;
+}
+
+// MIFARE_Write writes the 16 bytes of the block in the two steps of the MIFARE
+// write command.
+MFRC522::StatusCode Reader::MIFARE_Write(byte blockAddr, byte* buffer, byte bufferSize)
+{
+    if (buffer == nullptr || bufferSize < 16)
+        return STATUS_INVALID;
+
+    byte command[2] {PICC_CMD_MF_WRITE, blockAddr};
+    StatusCode status {mifareTransceive(command, sizeof(command))};
+    if (status != STATUS_OK)
+        return status;
+
+    return mifareTransceive(buffer, 16);
+}
+
+// PICC_HaltA puts the selected card into the HALT state. The card doesn't
+// answer a successful HLTA thus the timeout is the expected result.
+MFRC522::StatusCode Reader::PICC_HaltA()
+{
+    byte buffer[4] {PICC_CMD_HLTA, 0};
+    calculateCrc(buffer, 2, &buffer[2]);
+
+    StatusCode status {PCD_TransceiveData(buffer, sizeof(buffer), nullptr, 0)};
+    if (status == STATUS_TIMEOUT)
+        return STATUS_OK;
+
+    return (status == STATUS_OK) ? STATUS_ERROR : status;
+}
+
+// mifareTransceive appends the CRC_A to the data, sends it and checks that the
+// card acknowledged it.
+MFRC522::StatusCode Reader::mifareTransceive(const byte* sendData, byte sendLen)
+{
+    byte buffer[18];
+    if (sendData == nullptr || sendLen > 16)
+        return STATUS_INVALID;
+
+    memcpy(buffer, sendData, sendLen);
+    calculateCrc(buffer, sendLen, &buffer[sendLen]);
+
+    byte bufferSize {sizeof(buffer)};
+    byte validBits {0};
+    StatusCode status {PCD_CommunicateWithPICC(PCD_Transceive, 0x30, buffer, sendLen + 2,
+        buffer, &bufferSize, &validBits)}; // waits for RxIRq or IdleIRq.
+    if (status != STATUS_OK)
+        return status;
+
+    // The card acknowledges with a 4 bits ACK.
+    if (bufferSize != 1 || validBits != 4)
+        return STATUS_ERROR;
+
+    return (buffer[0] == MF_ACK) ? STATUS_OK : STATUS_MIFARE_NACK;
 }
 
 ///////////////////////////////////////////////////
@@ -92,6 +300,8 @@ char* Display::stateToStatus(MachineState& state) const
             return (char*)"WiFi Commun...  "; // Network Connection. (16 chars + \0)
         case WriteTag:
             return (char*)"Tag Writing...  "; // Writing the tag. (16 chars + \0)
+        case Benchmark:
+            return (char*)"Self Benchmark  "; // Maintenance mode. (16 chars + \0)
         default:
             return (char*)"  --Unknown!--  "; // (16 chars + \0)
     }
@@ -273,8 +483,9 @@ void Transmitter::attemptBlock2Auth(Transmitter::BlockAuth& auth, MFRC522::MIFAR
             auth.status = m_rc522.MIFARE_Read(block2Addr, buffer, &byteCount);
             if (auth.status == MFRC522::STATUS_OK)
                 break;
-            else
-                isNewCardDetected(); // reactivate the tag after previous op failure.
+
+            isNewCardDetected(); // reactivate the tag after previous op failure.
+            ++m_telemetry.retries;
 
             byteCount = sizeof(buffer); // reset the buffer counter.
         }
@@ -282,6 +493,7 @@ void Transmitter::attemptBlock2Auth(Transmitter::BlockAuth& auth, MFRC522::MIFAR
         {
             // Must reselect and activate the card again so that we can try more
             // sector blocks according to: http://arduino.stackexchange.com/a/14316
+            ++m_telemetry.retries;
             if (!isNewCardDetected())
                 break; // If false, the card reactivation failed.
         }
@@ -298,9 +510,24 @@ void Transmitter::attemptBlock2Auth(Transmitter::BlockAuth& auth, MFRC522::MIFAR
 
         // copy the read data without the 2 bytes of CRC_A.
         memcpy(auth.block2Data, buffer, Settings::blockSize);
+
+        // A compact credential starts its reference block with the magic.
+        const Settings::CredentialReference& reference {*reinterpret_cast<Settings::CredentialReference*>(auth.block2Data)};
+        auth.isCompact = (reference.magic == Settings::CREDENTIAL_MAGIC &&
+            reference.version == Settings::CompactCredentialVersion);
     }
 }
 
+// setRequestHeader fills in the header that starts every request frame. The
+// whole UID field is copied, the bytes after the UID size are ignored.
+void Transmitter::setRequestHeader(Settings::RequestHeader& header)
+{
+    header.uidSize = m_rc522.uid.size | Settings::COMPACT_CREDENTIAL_FLAG |
+        Settings::SKIP_ROTATION_FLAG;                                           // copy card uid size.
+    memcpy(header.uid, m_rc522.uid.uidByte, Settings::UidFieldSize);            // copy card uid.
+    memcpy(header.deviceId, Settings::DEVICE_ID, sizeof(Settings::DEVICE_ID));  // copy the current PCD ID
+}
+
 // readPICC reads the contents of a given Proximity Inductive Coupling Card (PICC/NFC Card)
 void Transmitter::readPICC()
 {
@@ -341,27 +568,26 @@ void Transmitter::readPICC()
         return;
     }
 
-    // This order of packaging should never be altered!
-    const int expectedBytesCount {Settings::SecretKeyAuthDataSize};
-    byte txData[expectedBytesCount];
-    txData[0] = m_rc522.uid.size;                                           // copy card uid size
-    memcpy(txData+1, m_rc522.uid.uidByte, 10);                              // copy card uid.
-    memcpy(txData+11, Settings::DEVICE_ID, sizeof(Settings::DEVICE_ID));    // copy the current PCD ID
-    memcpy(txData+19, m_blockAuth.block2Data, Settings::blockSize);         // copy block 2 data
+    m_hasSessionToken = false; // session tokens are only valid for the current tap.
+
+    // The frame layout is defined by Settings::SecretKeyRequest.
+    Settings::SecretKeyRequest request;
+    setRequestHeader(request.header);
+    memcpy(request.block2Data, m_blockAuth.block2Data, Settings::blockSize);  // copy block 2 data
 
     // Stage 3: Send the block 2 Contents to the trust organization for validation.
     // - Use Serial transmission to send the block 2 data to the WIFI module.
-    sendSerialData(txData, expectedBytesCount);
+    m_uplink.sendTap(reinterpret_cast<byte*>(&request), Settings::SecretKeyAuthDataSize);
 
     // Serial.println(F(" SecretKey Auth contents! "));
-    // Serial.println(expectedBytesCount);
-    // dumpBytes(txData, expectedBytesCount);
+    // Serial.println(Settings::SecretKeyAuthDataSize);
+    // dumpBytes(reinterpret_cast<byte*>(&request), Settings::SecretKeyAuthDataSize);
 
     // Request the secret key sent from the trust organization.
     byte secretKey[MFRC522::MF_KEY_SIZE] = {0, 0, 0, 0, 0, 0};
 
     // Handle narrowing conversion
-    byte bytesRead { static_cast<byte>(Serial1.readBytes(secretKey, MFRC522::MF_KEY_SIZE))};
+    byte bytesRead { static_cast<byte>(UPLINK_SERIAL.readBytes(secretKey, MFRC522::MF_KEY_SIZE))};
     // Serial.println(F(" Returned SecretKey contents! "));
     // dumpBytes(secretKey, bytesRead);
 
@@ -371,6 +597,13 @@ void Transmitter::readPICC()
         return;
     }
 
+    // The session token follows the secret key in the same response. Older
+    // trust organizations and cached relay responses don't have it thus it is
+    // read with a short timeout.
+    UPLINK_SERIAL.setTimeout(Settings::SESSION_TOKEN_TIMEOUT);
+    m_hasSessionToken = (UPLINK_SERIAL.readBytes(m_sessionToken, Settings::SessionTokenSize) == Settings::SessionTokenSize);
+    UPLINK_SERIAL.setTimeout(Settings::AUTH_DELAY);
+
     // KeyB needs to be computed using the successfully read secret key.
     // KeyA only has read-only permissions to block 2 address while KeyB has both
     // read and write permissions to the whole sector.
@@ -378,8 +611,11 @@ void Transmitter::readPICC()
 
     // Stage 4: Read the Card block contents.
     // - The data to be read is supposed to of size TrustKeySize.
-    byte blocksToRead {Settings::TrustKeySize/Settings::blockSize};
-    byte lastValidBlock {(byte)(m_blockAuth.block0Addr + blocksToRead)};
+    // - Block 2 was read while authenticating thus only the blocks before it
+    //   are read i.e. blocks 0 and 1 of a 48 bytes credential or block 1 of a
+    //   compact credential.
+    byte blocksToRead {(byte)(m_blockAuth.isCompact ? 1 : 2)};
+    byte lastValidBlock {(byte)(m_blockAuth.block0Addr + Settings::TrustKeySize/Settings::blockSize)};
 
     if (lastValidBlock <= Settings::maxBlockNo)
         setDetailsMsg((char*)"Initiating data extraction from the tag!  ");
@@ -394,7 +630,7 @@ void Transmitter::readPICC()
     byte byteCount = sizeof(buffer);
 
     byte startBlock {0};
-    byte addr {m_blockAuth.block0Addr};
+    byte addr {(byte)(m_blockAuth.block0Addr + (m_blockAuth.isCompact ? 1 : 0))};
 
     for (;startBlock < blocksToRead && addr < Settings::maxBlockNo; ++addr)
     {
@@ -424,6 +660,12 @@ void Transmitter::readPICC()
         ++startBlock; // Only increment if a data block is read.
     }
 
+    // The trust key is sent in the 48 bytes layout whatever the credential
+    // format, the rolling key of a compact credential is zero padded.
+    if (m_blockAuth.isCompact)
+        memset(m_cardData.readData+Settings::blockSize, 0, Settings::blockSize);
+    memcpy(m_cardData.readData+(2* Settings::blockSize), m_blockAuth.block2Data, Settings::blockSize);
+
     if (m_cardData.status == MFRC522::STATUS_OK)
         setDetailsMsg((char*)"Tag reading was successful!  ");
     else
@@ -441,48 +683,60 @@ void Transmitter::networkConn()
     setStatusMsg(Network);
     setDetailsMsg((char*)"Initiating network connection!  ");
 
-    // In total 68 bytes should be transmitted via the serial communication.
-    const int sizeOfDeviceID {sizeof(Settings::DEVICE_ID)};
+    // The frame layout is defined by Settings::TrustKeyRequest.
+    Settings::TrustKeyRequest request;
+    setRequestHeader(request.header);
+    memcpy(request.trustKey, m_cardData.readData, Settings::TrustKeySize);  // copy Trust Key data.
 
-    // This order of packaging should never be altered!
-    byte txData[Settings::TrustKeyAuthDataSize];
-    txData[0] = m_rc522.uid.size;                                       // copy card uid size.
-    memcpy(txData+1, m_rc522.uid.uidByte, 10);                          // copy card uid.
-    memcpy(txData+11, Settings::DEVICE_ID, sizeOfDeviceID);             // copy the current PCD ID
-    memcpy(txData+19, m_cardData.readData, Settings::TrustKeySize);     // copy Trust Key data.
+    // Echo back the session token received with the secret key if any.
+    byte txSize {Settings::TrustKeyAuthDataSize};
+    if (m_hasSessionToken)
+    {
+        memcpy(request.sessionToken, m_sessionToken, Settings::SessionTokenSize);
+        txSize = Settings::TrustKeyTokenAuthDataSize;
+    }
 
     // Send the Trust Key data to the Wi-Fi Module via Serial transmission.
-    sendSerialData(txData, Settings::TrustKeyAuthDataSize);
+    m_uplink.sendTap(reinterpret_cast<byte*>(&request), txSize);
 
     // Serial.println(F(" TrustKey validation contents! "));
-    // Serial.println(Settings::TrustKeyAuthDataSize);
-    // dumpBytes(txData, Settings::TrustKeyAuthDataSize);
+    // Serial.println(txSize);
+    // dumpBytes(reinterpret_cast<byte*>(&request), txSize);
 
-    // read the bytes sent back from the WIFI module.
+    // read the bytes sent back from the WIFI module. The response is read in
+    // place of the request that is no longer needed.
+    Settings::TrustKeyReply& reply {*reinterpret_cast<Settings::TrustKeyReply*>(&request)};
     const int expectedBytesCount {Settings::TrustKeySize};
-    size_t bytesRead {Serial1.readBytes(txData, expectedBytesCount)};
+    size_t bytesRead {UPLINK_SERIAL.readBytes(reinterpret_cast<byte*>(&reply), expectedBytesCount)};
 
     // Serial.println(F(" TrustKey returned contents! "));
     // Serial.println(bytesRead);
-    // dumpBytes(txData, bytesRead);
+    // dumpBytes(reinterpret_cast<byte*>(&reply), bytesRead);
 
     // For a successful Network Data read:
     // 1. Bytes read must match the match the size of a trust key.
     // 2. Device ID uid returned must match the existing one.
     if (bytesRead == expectedBytesCount)
     {
-        byte returnedDeviceID[sizeOfDeviceID];
-        // The last 8 bytes of the expectedBytesCount holds the deviceUiD bytes.
-        // Thus Starting byte is obtained by subtracting 8 from expectedBytesCount;
-        memcpy(returnedDeviceID, txData+(expectedBytesCount-sizeOfDeviceID), sizeOfDeviceID); // copy device uid.
+        // Serial.println(F(" Returned Device ID contents! "));
+        // dumpBytes(reply.deviceId, sizeof(reply.deviceId));
 
-        // Serial.println(F(" Copied Device ID contents! "));
-        // dumpBytes(returnedDeviceID, sizeOfDeviceID);
-
-        if (memcmp(returnedDeviceID, Settings::DEVICE_ID, sizeOfDeviceID) == 0)
+        if (memcmp(reply.deviceId, Settings::DEVICE_ID, sizeof(reply.deviceId)) == 0)
         {
-            m_cardData.status = MFRC522::STATUS_OK;                      // update status
-            memcpy(m_cardData.readData, txData, Settings::TrustKeySize); // update trust key
+            m_cardData.status = MFRC522::STATUS_OK;                       // update status
+            memcpy(m_cardData.readData, &reply, Settings::TrustKeySize);  // update trust key
+
+            // A VerifiedReply keeps the card's trust key, the tag isn't written.
+            const Settings::VerifiedReply& verified {*reinterpret_cast<Settings::VerifiedReply*>(&request)};
+            m_cardData.isRotated = false;
+            for (byte i {0}; i < Settings::blockSize && !m_cardData.isRotated; ++i)
+                m_cardData.isRotated = (verified.marker[i] != Settings::NO_ROTATION_MARKER);
+
+            if (!m_cardData.isRotated)
+            {
+                setDetailsMsg((char*)"Tag verified, no rotation is due!  ");
+                return;
+            }
 
             setDetailsMsg((char*)"Network connection was successful!  ");
             return;
@@ -498,16 +752,25 @@ void Transmitter::writePICC()
     setStatusMsg(WriteTag);
     setDetailsMsg((char*)"Initiating tag writing operation!  ");
 
-    byte blocksToRead {Settings::TrustKeySize/Settings::blockSize};
+    // The trust organization returns a compact credential as the PCD sets the
+    // COMPACT_CREDENTIAL_FLAG, see Settings::CompactTrustKeyReply. It is
+    // written in blocks 1 and 2, block 0 is no longer used. A reply without
+    // the reference block e.g. from an older trust organization holds the
+    // 48 bytes credential written in blocks 0, 1 and 2.
+    const Settings::CompactTrustKeyReply& reply {*reinterpret_cast<Settings::CompactTrustKeyReply*>(m_cardData.readData)};
+    bool isCompact {reply.reference.magic == Settings::CREDENTIAL_MAGIC &&
+        reply.reference.version == Settings::CompactCredentialVersion};
+
+    byte blocksToWrite {(byte)((isCompact ? Settings::CompactCredentialSize : Settings::TrustKeySize)/Settings::blockSize)};
     byte buffer[Settings::blockSize];
 
     byte startBlock {0};
-    byte addr {m_blockAuth.block0Addr};
+    byte addr {(byte)(m_blockAuth.block0Addr + (isCompact ? 1 : 0))};
 
     // Serial.println(F(" TrustKey contents writing! "));
-    // dumpBytes(m_cardData.readData, Settings::TrustKeySize);
+    // dumpBytes(m_cardData.readData, Settings::CompactCredentialSize);
 
-    for (;startBlock < blocksToRead && addr < Settings::maxBlockNo; ++addr)
+    for (;startBlock < blocksToWrite && addr < Settings::maxBlockNo; ++addr)
     {
         if ((addr + 1) % Settings::sectorBlocks == 0)
             continue; // Ignore access bit configuration block.
@@ -555,15 +818,39 @@ void Transmitter::handleDetectedCard()
 {
     if (isNewCardDetected())
     {
+        // Reset the telemetry record while retaining the tap sequence number.
+        uint16_t sequence {static_cast<uint16_t>(m_telemetry.sequence + 1)};
+        m_telemetry = {};
+        m_telemetry.sequence = sequence;
+        m_telemetry.outcome = Settings::TapReadFailed;
+
+        unsigned long tapStart {millis()};
+        unsigned long stageStart {tapStart};
+
         readPICC();
+        m_telemetry.readMs = static_cast<uint16_t>(millis() - stageStart);
 
         // Only send the cards data in the reading operation was successful.
         if (m_cardData.status == MFRC522::STATUS_OK)
+        {
+            m_telemetry.outcome = Settings::TapNetworkFailed;
+            stageStart = millis();
             networkConn();
+            m_telemetry.networkMs = static_cast<uint16_t>(millis() - stageStart);
+        }
 
-        // Only write the card data if the network operation was successful.
-        if (m_cardData.status == MFRC522::STATUS_OK)
+        // Only write the card data if the network operation was successful
+        // and the trust organization rotated the trust key.
+        if (m_cardData.status == MFRC522::STATUS_OK && m_cardData.isRotated)
+        {
+            m_telemetry.outcome = Settings::TapWriteFailed;
+            stageStart = millis();
             writePICC();
+            m_telemetry.writeMs = static_cast<uint16_t>(millis() - stageStart);
+        }
+
+        if (m_cardData.status == MFRC522::STATUS_OK)
+            m_telemetry.outcome = m_cardData.isRotated ? Settings::TapSuccess : Settings::TapVerified;
 
         #ifdef IS_TRUST_ORG
         if (m_cardData.status == MFRC522::STATUS_OK)
@@ -575,12 +862,217 @@ void Transmitter::handleDetectedCard()
 
         // Stop encryption on PCD allowing new communication to be initiated with other PICCs.
         m_rc522.PCD_StopCrypto1();
+
+        m_telemetry.status = static_cast<byte>(m_cardData.status);
+        m_telemetry.totalMs = static_cast<uint16_t>(millis() - tapStart);
+
+        // The tap decision is already made, the telemetry record is sent last so
+        // that it adds no latency to the tap path.
+        sendTelemetry();
     }
 
     // Handle clean up after the card operations.
     cleanUpAfterCardOps();
 }
 
+// sendTelemetry queues the per-tap telemetry record collected for the WiFi
+// module as bulk traffic. It is written once the uplink is idle and no
+// response is expected back. The WiFi module buffers it till it can be uploaded.
+void Transmitter::sendTelemetry()
+{
+    m_telemetry.marker = Settings::TELEMETRY_MARKER;
+    m_uplink.queueBulk(reinterpret_cast<byte*>(&m_telemetry), Settings::TelemetryDataSize);
+}
+
+// runSelfBenchmark is the maintenance mode that loops on a test card held to
+// the PCD. Each iteration wakes up and selects the halted card, authenticates
+// and reads its block 2 with KeyA, writes the same contents back and sends a
+// secret key request of the card i.e. the serial round trip through the uplink
+// to the trust organization. No trust key is rotated thus the test card stays
+// valid. It is only started over the USB Serial, see rfid-plus-display.ino.
+void Transmitter::runSelfBenchmark(uint16_t iterations)
+{
+    setStatusMsg(Benchmark);
+    setDetailsMsg((char*)"Hold the test card to the reader!  ");
+
+    bool isPresent {false};
+    for (int waited {0}; !isPresent && waited <= Settings::AUTH_DELAY; waited += Settings::REFRESH_DELAY)
+    {
+        isPresent = isNewCardDetected();
+        if (!isPresent)
+            timerDelay(0); // a single display refresh and delay.
+    }
+
+    if (isPresent)
+        attemptBlock2Auth(m_blockAuth, Settings::KeyA);
+
+    if (!isPresent || m_blockAuth.status != MFRC522::STATUS_OK)
+    {
+        setDetailsMsg((char*)"No valid test card, benchmark aborted!  ");
+        cleanUpAfterCardOps();
+        return;
+    }
+
+    enum Stage { Select, Auth, Read, Write, Uplink, stagesCount };
+    static const char* const stageNames[stagesCount] {"select", "auth", "read", "write", "serial"};
+    StageStats stages[stagesCount] {};
+
+    byte block2Addr {(byte)(m_blockAuth.block0Addr + 2)};
+    byte buffer[Settings::blockSize + 2];
+    byte byteCount;
+    byte atqa[2];
+    byte atqaSize;
+    byte secretKey[MFRC522::MF_KEY_SIZE];
+
+    // The secret key request of the test card is sent on every iteration.
+    Settings::SecretKeyRequest request;
+    setRequestHeader(request.header);
+    memcpy(request.block2Data, m_blockAuth.block2Data, Settings::blockSize);
+
+    char text[40];
+    for (uint16_t i {0}; i < iterations; ++i)
+    {
+        if (i % 10 == 0)
+        {
+            snprintf(text, sizeof(text), "Iteration %u of %u  ", i + 1, iterations);
+            setDetailsMsg(text, true);
+        }
+
+        // The secret key is fetched first since KeyB, derived from it, is
+        // needed to write block 2. KeyA only has read-only permissions to it.
+        unsigned long start {micros()};
+        m_uplink.sendTap(reinterpret_cast<byte*>(&request), Settings::SecretKeyAuthDataSize);
+        bool hasSecretKey {UPLINK_SERIAL.readBytes(secretKey, MFRC522::MF_KEY_SIZE) == MFRC522::MF_KEY_SIZE};
+        recordStage(stages[Uplink], start, hasSecretKey);
+
+        // The session token isn't timed, it is read so that it isn't taken
+        // for the next secret key.
+        UPLINK_SERIAL.setTimeout(Settings::SESSION_TOKEN_TIMEOUT);
+        UPLINK_SERIAL.readBytes(m_sessionToken, Settings::SessionTokenSize);
+        UPLINK_SERIAL.setTimeout(Settings::AUTH_DELAY);
+
+        // The card is halted at the end of every iteration thus it has to be
+        // woken up and selected again.
+        m_rc522.PICC_HaltA();
+        m_rc522.PCD_StopCrypto1();
+
+        atqaSize = sizeof(atqa);
+        start = micros();
+        bool isOk {m_rc522.PICC_WakeupA(atqa, &atqaSize) == MFRC522::STATUS_OK && m_rc522.PICC_ReadCardSerial()};
+        recordStage(stages[Select], start, isOk);
+
+        // As in the normal write path, a new card still has the transport
+        // KeyB matching its KeyA otherwise the tag specific KeyB is used.
+        if (isOk && !m_blockAuth.isCardNew)
+        {
+            isOk = hasSecretKey;
+            if (isOk)
+                setPICCAuthKeyB(secretKey);
+        }
+
+        if (isOk)
+        {
+            start = micros();
+            isOk = (m_rc522.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_B, block2Addr,
+                (m_blockAuth.isCardNew ? &m_blockAuth.authKeyA : &m_PiccKeyB), &(m_rc522.uid)) == MFRC522::STATUS_OK);
+            recordStage(stages[Auth], start, isOk);
+        }
+
+        if (isOk)
+        {
+            byteCount = sizeof(buffer);
+            start = micros();
+            isOk = (m_rc522.MIFARE_Read(block2Addr, buffer, &byteCount) == MFRC522::STATUS_OK);
+            recordStage(stages[Read], start, isOk);
+        }
+
+        if (isOk)
+        {
+            start = micros();
+            isOk = (m_rc522.MIFARE_Write(block2Addr, buffer, Settings::blockSize) == MFRC522::STATUS_OK);
+            recordStage(stages[Write], start, isOk);
+        }
+    }
+
+    m_rc522.PICC_HaltA();
+    m_rc522.PCD_StopCrypto1();
+    m_hasSessionToken = false;
+
+    Serial.print(Settings::BENCH_COMMAND);
+    Serial.print(F(" iterations="));
+    Serial.println(iterations);
+    for (byte stage {0}; stage < stagesCount; ++stage)
+        dumpStage(stageNames[stage], stages[stage]);
+
+    // Each stage's min/avg/max in ms is shown in turn.
+    for (byte stage {0}; stage < stagesCount; ++stage)
+    {
+        const StageStats& stats {stages[stage]};
+        unsigned long avgUs {stats.runs ? stats.totalUs / stats.runs : 0};
+        if (stats.runs == 0)
+            snprintf(text, sizeof(text), "%s failed  ", stageNames[stage]);
+        else
+            snprintf(text, sizeof(text), "%s %lu.%lu/%lu.%lu/%lu.%lums  ", stageNames[stage],
+                (unsigned long)stats.minUs / 1000, ((unsigned long)stats.minUs / 100) % 10,
+                avgUs / 1000, (avgUs / 100) % 10,
+                (unsigned long)stats.maxUs / 1000, ((unsigned long)stats.maxUs / 100) % 10);
+
+        setDetailsMsg(text, true);
+        timerDelay(4 * Settings::REFRESH_DELAY);
+    }
+
+    cleanUpAfterCardOps();
+}
+
+// recordStage adds a single stage timing to its stats. Failed stages are only
+// counted.
+void Transmitter::recordStage(StageStats& stats, unsigned long startUs, bool isSuccessful)
+{
+    uint32_t elapsedUs {static_cast<uint32_t>(micros() - startUs)};
+    if (!isSuccessful)
+    {
+        ++stats.failures;
+        return;
+    }
+
+    stats.minUs = (stats.runs == 0 || elapsedUs < stats.minUs) ? elapsedUs : stats.minUs;
+    stats.maxUs = (elapsedUs > stats.maxUs) ? elapsedUs : stats.maxUs;
+    stats.totalUs += elapsedUs;
+    ++stats.runs;
+
+    byte bucket {0};
+    for (uint32_t limit {256}; elapsedUs >= limit && bucket < Settings::benchBuckets - 1; limit <<= 1)
+        ++bucket;
+    ++stats.buckets[bucket];
+}
+
+// dumpStage writes the stage stats followed by a line per histogram bucket
+// over the USB Serial e.g. "  <512us 17".
+void Transmitter::dumpStage(const char* name, const StageStats& stats)
+{
+    Serial.print(name);
+    Serial.print(F(" runs="));
+    Serial.print(stats.runs);
+    Serial.print(F(" failures="));
+    Serial.print(stats.failures);
+    Serial.print(F(" min_us="));
+    Serial.print(stats.runs ? stats.minUs : 0);
+    Serial.print(F(" avg_us="));
+    Serial.print(stats.runs ? stats.totalUs / stats.runs : 0);
+    Serial.print(F(" max_us="));
+    Serial.println(stats.maxUs);
+
+    uint32_t limit {256};
+    for (byte bucket {0}; bucket < Settings::benchBuckets; ++bucket, limit <<= 1)
+    {
+        bool isLast {bucket == Settings::benchBuckets - 1};
+        Serial.print(isLast ? F("  >=") : F("  <"));
+        Serial.print(isLast ? limit / 2 : limit);
+        Serial.print(F("us "));
+        Serial.println(stats.buckets[bucket]);
+    }
+}
+
 // setUidBasedKey replaces the non-uid base key with a Uid based which is
 // quicker and safer to use. This is done on the cards detected as new.
 // NB: Feature only works in the Trust Organization Mode.
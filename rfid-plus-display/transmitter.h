@@ -28,6 +28,17 @@
 
 #include "commonRFID.h"
 
+// UPLINK_OVER_USB flag routes the trust organization traffic over the USB Serial
+// instead of Serial1. It is used when the PCD is cabled to a rfid-gateway host
+// rather than to the WiFi module.
+// #define UPLINK_OVER_USB
+
+#ifdef UPLINK_OVER_USB
+#define UPLINK_SERIAL Serial
+#else
+#define UPLINK_SERIAL Serial1
+#endif
+
 // onInterrupt is declared as a global variable that is set to true once an
 // interrupt by the RFID module is recorded.
 extern volatile bool onInterrupt;
@@ -105,6 +116,120 @@ namespace Settings
     //          block 62 – data block
     //          block 63 – sector trailer
     constexpr byte sectorBlocks {4};
+
+    // SESSION_TOKEN_TIMEOUT defines how long in ms to wait for the session
+    // token after the secret key has been read. Both arrive in one response.
+    constexpr int SESSION_TOKEN_TIMEOUT {30};
+
+    // BENCH_COMMAND starts the self benchmark maintenance mode when received
+    // on the USB Serial followed by the number of iterations e.g. "BENCH 200".
+    constexpr const char* BENCH_COMMAND {"BENCH"};
+
+    // BENCH_DEFAULT_ITERATIONS and BENCH_MAX_ITERATIONS define the number of
+    // self benchmark iterations when none or too many are requested.
+    constexpr uint16_t BENCH_DEFAULT_ITERATIONS {100};
+    constexpr uint16_t BENCH_MAX_ITERATIONS {1000};
+
+    // benchBuckets defines the number of power of two histogram buckets of
+    // each self benchmark stage, from below 256us to 2^(benchBuckets+6)us and
+    // above.
+    constexpr byte benchBuckets {12};
+
+    // UPLINK_BULK_SLOTS defines the number of bulk frames i.e. the telemetry
+    // records queued for the uplink. New ones are dropped once it is full.
+    constexpr byte UPLINK_BULK_SLOTS {4};
+
+    // UPLINK_BULK_IDLE defines how long in ms the uplink must be idle before
+    // a queued bulk frame is written.
+    constexpr unsigned long UPLINK_BULK_IDLE {REFRESH_DELAY};
+
+    // UPLINK_FRAME_GAP defines the minimum time in ms between two frames
+    // written to the uplink.
+    constexpr unsigned long UPLINK_FRAME_GAP {2 * FRAME_READ_TIMEOUT};
+
+    // UPLINK_STATS_COMMAND prints the uplink scheduler stats when received on
+    // the USB Serial.
+    constexpr const char* UPLINK_STATS_COMMAND {"UPLINK"};
+};
+
+// UplinkScheduler orders the frames written to the uplink serial by traffic
+// class. Tap frames have strict priority and are written at once as a door
+// decision waits on their response. Bulk frames i.e. the telemetry records
+// are queued and written one at a time once the uplink has been idle for
+// UPLINK_BULK_IDLE ms and no card is waiting, thus a bulk frame never sits
+// ahead of a tap request on the WiFi module. The frames are kept at least
+// UPLINK_FRAME_GAP ms apart so that the WiFi module never reads two as one.
+class UplinkScheduler
+{
+    public:
+        enum TrafficClass { TapClass, BulkClass, classesCount };
+
+        // ClassStats holds the queue depth and the latency in ms i.e. the time
+        // from queueing to writing, of a traffic class.
+        typedef struct
+        {
+            byte depth;
+            byte maxDepth;
+            uint16_t dropped;
+            uint16_t sent;
+            uint32_t totalWaitMs;
+            uint16_t maxWaitMs;
+        } ClassStats;
+
+        // sendTap writes the tap frame once the frame gap has passed.
+        void sendTap(byte* data, byte dataSize);
+
+        // queueBulk queues a copy of the bulk frame. Returns false if the frame
+        // was dropped.
+        bool queueBulk(const byte* data, byte dataSize);
+
+        // poll writes the oldest queued bulk frame if the uplink is idle.
+        void poll();
+
+        // dumpStats writes the stats of each traffic class over the USB Serial.
+        void dumpStats() const;
+
+        const ClassStats& stats(TrafficClass trafficClass) const { return m_stats[trafficClass]; }
+
+    private:
+        // recordSent adds a written frame to the traffic class stats.
+        void recordSent(TrafficClass trafficClass, unsigned long queuedAt);
+
+        byte m_bulk[Settings::UPLINK_BULK_SLOTS][Settings::TelemetryDataSize];
+        byte m_bulkSizes[Settings::UPLINK_BULK_SLOTS];
+        unsigned long m_bulkQueuedAt[Settings::UPLINK_BULK_SLOTS];
+        byte m_bulkHead {0};
+
+        unsigned long m_lastWrite {0};
+        ClassStats m_stats[classesCount] {};
+};
+
+// Reader is the MFRC522 driver of the PCD. The block reads and writes and the
+// HLTA frame compute and check their CRC_A in software from a flash table
+// instead of the MFRC522 CRC coprocessor. Each coprocessor CRC costs upto 21
+// register writes, a FIFO load and a CRCIRq polling loop over SPI.
+class Reader: public MFRC522
+{
+    public:
+        using MFRC522::MFRC522;
+
+        // calculateCrc writes the CRC_A of the data into result, low byte first.
+        static void calculateCrc(const byte* data, byte length, byte* result);
+
+        // MIFARE_Read reads the 16 bytes of the block and checks their CRC_A.
+        // bufferSize must be at least 18 bytes.
+        StatusCode MIFARE_Read(byte blockAddr, byte* buffer, byte* bufferSize);
+
+        // MIFARE_Write writes the 16 bytes of the block.
+        StatusCode MIFARE_Write(byte blockAddr, byte* buffer, byte bufferSize);
+
+        // PICC_HaltA puts the selected card into the HALT state.
+        StatusCode PICC_HaltA();
+
+    private:
+        // mifareTransceive appends the CRC_A to the data, sends it and checks
+        // that the card acknowledged it.
+        StatusCode mifareTransceive(const byte* sendData, byte sendLen);
 };
 
 // Display manages the relaying the status of the internal workings to the
@@ -130,6 +255,9 @@ class Display
             // WriteTag State is set when the validation server sends data to be
             // written into the tag.
             WriteTag,
+            // Benchmark State is set while the self benchmark maintenance mode
+            // loops on a test card.
+            Benchmark,
 
             // Unknown State is set to indicate the undefined state the machine is
             // currently in.
@@ -201,6 +329,7 @@ class Transmitter: public Display
         {
             byte block0Addr;  // Holds the first data block address in each sector.
             bool isCardNew; // True only if the Uid based key is not set as the default.
+            bool isCompact; // True if the card holds a compact credential.
             MFRC522::StatusCode status;
             MFRC522::MIFARE_Key authKeyA;
             byte block2Data[Settings::blockSize]; // After auth, block2 contents are read.
@@ -211,9 +340,21 @@ class Transmitter: public Display
         typedef struct
         {
             MFRC522::StatusCode status;
+            bool isRotated; // False if the trust organization kept the trust key.
             byte readData[Settings::TrustKeySize];
         } UserData;
 
+        // StageStats holds the timings in us of a self benchmark stage.
+        typedef struct
+        {
+            uint32_t minUs;
+            uint32_t maxUs;
+            uint32_t totalUs;
+            uint16_t runs;
+            uint16_t failures;
+            uint16_t buckets[Settings::benchBuckets];
+        } StageStats;
+
 
         Transmitter( byte RFID_SS, byte RFID_RST, // RFID control pins
             Display& view
@@ -241,6 +382,9 @@ class Transmitter: public Display
         // it is replaced with a Uid based which is quicker and safer to use.
         void setUidBasedKey();
 
+        // setRequestHeader fills in the header that starts every request frame.
+        void setRequestHeader(Settings::RequestHeader& header);
+
         // readPICC reads the contents of a given Proximity Inductive Coupling Card (PICC/NFC Card)
         void readPICC();
 
@@ -262,6 +406,23 @@ class Transmitter: public Display
         // the card to be done as a matter of urgency.
         void handleDetectedCard();
 
+        // sendTelemetry queues the per-tap telemetry record collected for the
+        // WiFi module. It is written once the uplink is idle and no response
+        // is expected back.
+        void sendTelemetry();
+
+        // pollUplink writes the queued bulk frames once the uplink is idle.
+        void pollUplink() { m_uplink.poll(); }
+
+        // dumpUplinkStats writes the uplink traffic class stats over the USB Serial.
+        void dumpUplinkStats() const { m_uplink.dumpStats(); }
+
+        // runSelfBenchmark is the maintenance mode that loops on a test card
+        // held to the PCD timing the select, auth, read, write and the serial
+        // round trip of each iteration. The min/avg/max are shown on the LCD
+        // and the histograms are dumped over the USB Serial.
+        void runSelfBenchmark(uint16_t iterations);
+
         // resetInterrupt clears the pending interrupt bits after being resolved.
         // Enables the module to detect new interrupts.
         void resetInterrupt()
@@ -285,12 +446,29 @@ class Transmitter: public Display
         }
 
     private:
-        MFRC522 m_rc522;
+        // recordStage adds a single stage timing to its stats.
+        static void recordStage(StageStats& stats, unsigned long startUs, bool isSuccessful);
+
+        // dumpStage writes the stage stats and histogram over the USB Serial.
+        static void dumpStage(const char* name, const StageStats& stats);
+
+        Reader m_rc522;
+
+        UplinkScheduler m_uplink;
 
         BlockAuth m_blockAuth{};
 
         UserData m_cardData{};
 
+        // m_telemetry holds the stage timings, outcome and RF retries recorded
+        // during the current tap.
+        Settings::TelemetryRecord m_telemetry{};
+
+        // m_sessionToken holds the session token returned with the secret key.
+        // It is echoed back in the trust key request of the same tap.
+        byte m_sessionToken[Settings::SessionTokenSize];
+        bool m_hasSessionToken {false};
+
         // m_PiccKeyB defines the key that is generated from the card's uid.
         // It is more safer and easier to use than that the other default keys
         // it is unique for every tag and cannot be computed the trust organization's
@@ -0,0 +1,698 @@
+/*!
+ * @file impairment.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part wan-proxy package files. The WAN proxy sits between a
+ * host built client i.e. the rfid-gateway or the edge-relay and a local trust
+ * organization stand-in. It forwards the TCP connections or UDP datagrams
+ * while adding the delay, loss, bandwidth cap and connection resets of a
+ * remote site link read from an impairment profile. Keep-alive, retries and
+ * timeouts can then be measured on a fast office network as they would
+ * behave behind a 300 ms RTT lossy link.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "impairment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////
+// General Purpose Functions
+//////////////////////////////////////////////////
+
+// sendAll writes the whole buffer into the socket.
+static bool sendAll(int fd, const std::string& data)
+{
+    size_t sent {0};
+    while (sent < data.size())
+    {
+        ssize_t n {send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)};
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////
+// Profile Members
+//////////////////////////////////////////////////
+
+// parse reads the profile file. Returns false and prints the reason if it is
+// malformed.
+bool Profile::parse(const std::string& path)
+{
+    std::ifstream file {path};
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open the profile file: %s\n", path.c_str());
+        return false;
+    }
+
+    m_phases.assign(1, Phase {});
+    bool hasPhaseLine {false};
+
+    std::string line;
+    for (int lineNo {1}; std::getline(file, line); ++lineNo)
+    {
+        std::istringstream values {line};
+        std::string key;
+        if (!(values >> key) || key[0] == '#')
+            continue;
+
+        Phase& phase {m_phases.back()};
+        bool isValid {true};
+
+        if (key == "phase")
+        {
+            int seconds {-1};
+            isValid = (values >> seconds) && seconds >= 0;
+
+            // The first phase line names the values listed before it.
+            if (hasPhaseLine)
+                m_phases.push_back(phase);
+            m_phases.back().seconds = seconds;
+            hasPhaseLine = true;
+        }
+        else if (key == "delay")
+        {
+            std::string distribution {"constant"};
+            isValid = (values >> phase.delayMs) && phase.delayMs >= 0;
+            if (values >> phase.jitterMs)
+                values >> distribution;
+            else
+                phase.jitterMs = 0;
+
+            if (distribution == "constant")
+                phase.distribution = Phase::Constant;
+            else if (distribution == "uniform")
+                phase.distribution = Phase::Uniform;
+            else if (distribution == "normal")
+                phase.distribution = Phase::Normal;
+            else if (distribution == "pareto")
+                phase.distribution = Phase::Pareto;
+            else
+                isValid = false;
+            isValid = isValid && phase.jitterMs >= 0;
+        }
+        else if (key == "loss")
+            isValid = (values >> phase.lossPercent) && phase.lossPercent >= 0 && phase.lossPercent <= 100;
+        else if (key == "bandwidth")
+            isValid = (values >> phase.bandwidthKbps) && phase.bandwidthKbps >= 0;
+        else if (key == "reset")
+            isValid = (values >> phase.resetPercent) && phase.resetPercent >= 0 && phase.resetPercent <= 100;
+        else
+            isValid = false;
+
+        if (!isValid)
+        {
+            fprintf(stderr, "%s:%d: invalid line: %s\n", path.c_str(), lineNo, line.c_str());
+            return false;
+        }
+    }
+
+    // An endless phase stops the cycle.
+    m_cycleSec = 0;
+    for (const Phase& phase : m_phases)
+    {
+        if (phase.seconds == 0)
+        {
+            m_cycleSec = 0;
+            break;
+        }
+        m_cycleSec += phase.seconds;
+    }
+
+    m_start = Clock::now();
+    return true;
+}
+
+// current returns the phase active now.
+const Phase& Profile::current() const
+{
+    double elapsed {std::chrono::duration<double>(Clock::now() - m_start).count()};
+    if (m_cycleSec > 0)
+        elapsed = std::fmod(elapsed, m_cycleSec);
+
+    for (const Phase& phase : m_phases)
+    {
+        if (phase.seconds == 0 || elapsed < phase.seconds)
+            return phase;
+        elapsed -= phase.seconds;
+    }
+    return m_phases.back();
+}
+
+///////////////////////////////////////////////////
+// ProxyStats Members
+//////////////////////////////////////////////////
+
+// print writes the metrics to the stdout.
+void ProxyStats::print() const
+{
+    uint64_t count {chunks};
+    double averageMs {count ? totalDelayUs / 1000.0 / count : 0.0};
+
+    printf("connections: %llu, chunks: %llu, bytes: %llu, lost: %llu, resets: %llu, "
+        "avg delay: %.1f ms, max delay: %.1f ms\n",
+        static_cast<unsigned long long>(connections.load()),
+        static_cast<unsigned long long>(count),
+        static_cast<unsigned long long>(bytes.load()),
+        static_cast<unsigned long long>(lost.load()),
+        static_cast<unsigned long long>(resets.load()),
+        averageMs, maxDelayUs / 1000.0);
+    fflush(stdout);
+}
+
+///////////////////////////////////////////////////
+// Link Members
+//////////////////////////////////////////////////
+
+Link::Link(const Profile& profile, ProxyStats& stats, bool isStream)
+    : m_profile {profile}, m_stats {stats}, m_isStream {isStream}, m_random {std::random_device {}()}
+{
+}
+
+// shape returns when the chunk of the given size read now is delivered or if
+// it is lost or resets the connection instead. The chunk is put on the link
+// once the previous ones were serialized at the bandwidth cap, then it takes
+// the sampled delay to arrive. A stream delivers its chunks in order.
+Verdict Link::shape(size_t size)
+{
+    const Phase& phase {m_profile.current()};
+    Clock::time_point now {Clock::now()};
+
+    m_idleAt = std::max(m_idleAt, now);
+    if (phase.bandwidthKbps > 0)
+        m_idleAt += std::chrono::microseconds(static_cast<int64_t>(size * 8000.0 / phase.bandwidthKbps));
+
+    std::uniform_real_distribution<double> percent {0.0, 100.0};
+    Verdict verdict;
+    verdict.isLost = percent(m_random) < phase.lossPercent;
+    verdict.isReset = m_isStream && percent(m_random) < phase.resetPercent;
+
+    // A lost TCP chunk is sent again once the sender's retransmission timeout,
+    // at least a round trip, expires.
+    double delayMs {sampleDelayMs(phase)};
+    if (verdict.isLost && m_isStream)
+        delayMs += std::max<double>(Settings::TCP_RTO_MIN_MS, 2 * delayMs);
+
+    verdict.deliverAt = m_idleAt + std::chrono::microseconds(static_cast<int64_t>(delayMs * 1000));
+    if (m_isStream)
+    {
+        verdict.deliverAt = std::max(verdict.deliverAt, m_lastDelivery);
+        m_lastDelivery = verdict.deliverAt;
+    }
+
+    uint64_t delayUs {static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(verdict.deliverAt - now).count())};
+    uint64_t maxDelayUs {m_stats.maxDelayUs};
+    while (delayUs > maxDelayUs && !m_stats.maxDelayUs.compare_exchange_weak(maxDelayUs, delayUs))
+        ;
+
+    ++m_stats.chunks;
+    m_stats.bytes += size;
+    m_stats.totalDelayUs += delayUs;
+    m_stats.lost += verdict.isLost;
+    m_stats.resets += verdict.isReset;
+    return verdict;
+}
+
+// sampleDelayMs returns the one way delay of a chunk drawn from the phase's
+// distribution. It is never negative.
+double Link::sampleDelayMs(const Phase& phase)
+{
+    if (phase.jitterMs <= 0)
+        return phase.delayMs;
+
+    switch (phase.distribution)
+    {
+        case Phase::Uniform:
+        {
+            std::uniform_real_distribution<double> delay {phase.delayMs - phase.jitterMs,
+                phase.delayMs + phase.jitterMs};
+            return std::max(0.0, delay(m_random));
+        }
+
+        case Phase::Normal:
+        {
+            std::normal_distribution<double> delay {phase.delayMs, phase.jitterMs};
+            return std::max(0.0, delay(m_random));
+        }
+
+        case Phase::Pareto:
+        {
+            // The tail starts at the delay and scales with the jitter.
+            std::uniform_real_distribution<double> uniform {0.0, 1.0};
+            double u {1.0 - uniform(m_random)};
+            return phase.delayMs + phase.jitterMs * (std::pow(u, -1.0 / Settings::PARETO_SHAPE) - 1.0);
+        }
+
+        default:
+            return phase.delayMs;
+    }
+}
+
+///////////////////////////////////////////////////
+// WanProxy Connection Members
+//////////////////////////////////////////////////
+
+// Connection holds a proxied TCP connection. Each direction, from the client
+// to the upstream and back, is read and written by its own thread so that
+// the delayed chunks don't hold up the reading of the next ones.
+struct WanProxy::Connection
+{
+    // Chunk holds the bytes read and their fate, an empty end chunk forwards
+    // the end of the stream.
+    struct Chunk
+    {
+        std::string data;
+        Verdict verdict;
+        bool isEnd {false};
+    };
+
+    Connection(int clientFd, const Profile& profile, ProxyStats& stats)
+        : fds {clientFd, -1}, links {Link {profile, stats, true}, Link {profile, stats, true}}
+    {
+    }
+
+    ~Connection()
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    // read queues the chunks read from the fds[from] socket.
+    void read(int from)
+    {
+        char buffer[Settings::CHUNK_SIZE];
+        for (;;)
+        {
+            ssize_t n {recv(fds[from], buffer, sizeof(buffer), 0)};
+
+            Chunk chunk;
+            chunk.isEnd = n <= 0;
+            if (!chunk.isEnd)
+            {
+                chunk.data.assign(buffer, static_cast<size_t>(n));
+                chunk.verdict = links[from].shape(chunk.data.size());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock {mutex};
+                if (isAborted)
+                    return;
+                pending[from].push_back(std::move(chunk));
+            }
+            wakeUp.notify_all();
+
+            if (n <= 0)
+                return;
+        }
+    }
+
+    // write forwards the chunks read from the fds[from] socket to the other
+    // one once due.
+    void write(int from)
+    {
+        int to {1 - from};
+
+        std::unique_lock<std::mutex> lock {mutex};
+        for (;;)
+        {
+            wakeUp.wait(lock, [&] { return isAborted || !pending[from].empty(); });
+            if (isAborted)
+                return;
+
+            Chunk chunk {std::move(pending[from].front())};
+            pending[from].pop_front();
+
+            if (chunk.isEnd)
+            {
+                shutdown(fds[to], SHUT_WR);
+                return;
+            }
+
+            if (wakeUp.wait_until(lock, chunk.verdict.deliverAt, [&] { return isAborted; }))
+                return;
+
+            if (chunk.verdict.isReset)
+            {
+                abort(true);
+                return;
+            }
+
+            lock.unlock();
+            bool isSent {sendAll(fds[to], chunk.data)};
+            lock.lock();
+
+            if (!isSent)
+            {
+                abort(false);
+                return;
+            }
+        }
+    }
+
+    // abort stops both directions with the mutex held. A reset closes both
+    // sockets with a RST instead of a FIN.
+    void abort(bool isReset)
+    {
+        if (isAborted)
+            return;
+        isAborted = true;
+
+        for (int fd : fds)
+        {
+            if (isReset)
+            {
+                linger immediately {1, 0};
+                setsockopt(fd, SOL_SOCKET, SO_LINGER, &immediately, sizeof(immediately));
+            }
+
+            // Wakes up the blocked reads, the sockets are closed once the last
+            // thread is done with them.
+            shutdown(fd, SHUT_RD);
+        }
+        wakeUp.notify_all();
+    }
+
+    int fds[2];
+    Link links[2];
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<Chunk> pending[2];
+    bool isAborted {false};
+};
+
+///////////////////////////////////////////////////
+// WanProxy Datagram Members
+//////////////////////////////////////////////////
+
+// Flow holds the upstream socket of a UDP client and its two directions.
+struct WanProxy::Flow
+{
+    Flow(const Profile& profile, ProxyStats& stats)
+        : up {profile, stats, false}, down {profile, stats, false}
+    {
+    }
+
+    ~Flow()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    int fd {-1};
+    sockaddr_storage client {};
+    socklen_t clientSize {0};
+    Link up;
+    Link down;
+    Clock::time_point lastSeen;
+};
+
+// Datagram holds a UDP datagram waiting for its delivery. The flow is kept
+// open till its last datagram is sent.
+struct WanProxy::Datagram
+{
+    Clock::time_point deliverAt;
+    std::shared_ptr<Flow> flow;
+    bool isUpstream;
+    std::string payload;
+};
+
+///////////////////////////////////////////////////
+// WanProxy Members
+//////////////////////////////////////////////////
+
+WanProxy::WanProxy(const HttpEndpoint& upstream, const Profile& profile)
+    : m_upstream {upstream}, m_profile {profile},
+      // The earliest due datagram is kept on top.
+      m_datagrams {[](const std::shared_ptr<Datagram>& a, const std::shared_ptr<Datagram>& b) {
+          return a->deliverAt > b->deliverAt;
+      }}
+{
+}
+
+// listen resolves the upstream endpoint and binds the listening socket.
+// Returns false on failure.
+bool WanProxy::listen(int port, bool isDatagram)
+{
+    m_isDatagram = isDatagram;
+    int type {isDatagram ? SOCK_DGRAM : SOCK_STREAM};
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+
+    addrinfo* results {nullptr};
+    if (getaddrinfo(m_upstream.host.c_str(), m_upstream.port.c_str(), &hints, &results) != 0)
+    {
+        fprintf(stderr, "Unable to resolve the upstream host: %s\n", m_upstream.host.c_str());
+        return false;
+    }
+    memcpy(&m_upstreamAddr, results->ai_addr, results->ai_addrlen);
+    m_upstreamAddrSize = results->ai_addrlen;
+    freeaddrinfo(results);
+
+    m_listenFd = socket(AF_INET6, type | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+    {
+        perror("socket");
+        return false;
+    }
+
+    int isEnabled {1};
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &isEnabled, sizeof(isEnabled));
+
+    // Accept both IPv4 and IPv6 clients.
+    int isV6Only {0};
+    setsockopt(m_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &isV6Only, sizeof(isV6Only));
+
+    sockaddr_in6 addr {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(static_cast<uint16_t>(port));
+
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        (!isDatagram && ::listen(m_listenFd, SOMAXCONN) != 0))
+    {
+        perror("bind");
+        return false;
+    }
+    return true;
+}
+
+// run relays the TCP connections on their own threads or the UDP datagrams.
+void WanProxy::run()
+{
+    if (m_isDatagram)
+    {
+        std::thread(&WanProxy::deliverDatagrams, this).detach();
+        runDatagrams();
+        return;
+    }
+
+    for (;;)
+    {
+        int fd {accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)};
+        if (fd < 0)
+        {
+            perror("accept");
+            continue;
+        }
+
+        std::thread(&WanProxy::serveConnection, this, fd).detach();
+    }
+}
+
+// serveConnection relays a TCP client connection. The client's handshake
+// completed locally thus its round trip is spent before the upstream is
+// connected, the first request then arrives as late as behind the WAN.
+void WanProxy::serveConnection(int clientFd)
+{
+    ++stats.connections;
+    auto connection = std::make_shared<Connection>(clientFd, m_profile, stats);
+
+    int isEnabled {1};
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &isEnabled, sizeof(isEnabled));
+
+    Verdict syn {connection->links[0].shape(0)};
+    std::this_thread::sleep_until(syn.deliverAt);
+
+    int upstreamFd {socket(m_upstreamAddr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    connection->fds[1] = upstreamFd;
+    if (upstreamFd < 0 || connect(upstreamFd, reinterpret_cast<sockaddr*>(&m_upstreamAddr),
+        m_upstreamAddrSize) != 0)
+    {
+        perror("connect");
+        return;
+    }
+    setsockopt(upstreamFd, IPPROTO_TCP, TCP_NODELAY, &isEnabled, sizeof(isEnabled));
+
+    Verdict synAck {connection->links[1].shape(0)};
+    std::this_thread::sleep_until(synAck.deliverAt);
+
+    if (syn.isReset || synAck.isReset)
+    {
+        std::lock_guard<std::mutex> lock {connection->mutex};
+        connection->abort(true);
+        return;
+    }
+
+    std::thread(&Connection::read, connection, 1).detach();
+    std::thread(&Connection::write, connection, 0).detach();
+    std::thread(&Connection::write, connection, 1).detach();
+    connection->read(0);
+}
+
+// runDatagrams relays the UDP datagrams of all the clients. Each client is
+// given its own upstream socket so that the replies can be told apart.
+void WanProxy::runDatagrams()
+{
+    std::map<std::string, std::shared_ptr<Flow>> flows;
+    std::vector<char> buffer(Settings::MAX_DATAGRAM_SIZE);
+
+    for (;;)
+    {
+        std::vector<pollfd> fds {{m_listenFd, POLLIN, 0}};
+        std::vector<std::shared_ptr<Flow>> polled;
+        for (auto& flow : flows)
+        {
+            fds.push_back({flow.second->fd, POLLIN, 0});
+            polled.push_back(flow.second);
+        }
+
+        if (poll(fds.data(), fds.size(), 1000) < 0)
+            continue;
+
+        std::vector<std::shared_ptr<Datagram>> received;
+
+        if (fds[0].revents & POLLIN)
+        {
+            sockaddr_storage client {};
+            socklen_t clientSize {sizeof(client)};
+            ssize_t n {recvfrom(m_listenFd, buffer.data(), buffer.size(), 0,
+                reinterpret_cast<sockaddr*>(&client), &clientSize)};
+
+            std::string key {reinterpret_cast<char*>(&client), clientSize};
+            std::shared_ptr<Flow>& flow {flows[key]};
+            if (n >= 0 && !flow)
+            {
+                flow = std::make_shared<Flow>(m_profile, stats);
+                flow->client = client;
+                flow->clientSize = clientSize;
+                flow->fd = socket(m_upstreamAddr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+                if (flow->fd < 0 || connect(flow->fd, reinterpret_cast<sockaddr*>(&m_upstreamAddr),
+                    m_upstreamAddrSize) != 0)
+                    perror("connect");
+                ++stats.connections;
+            }
+
+            if (n >= 0 && flow && flow->fd >= 0)
+            {
+                flow->lastSeen = Clock::now();
+                Verdict verdict {flow->up.shape(static_cast<size_t>(n))};
+                if (!verdict.isLost)
+                    received.push_back(std::make_shared<Datagram>(
+                        Datagram {verdict.deliverAt, flow, true, std::string(buffer.data(), n)}));
+            }
+        }
+
+        for (size_t i {1}; i < fds.size(); ++i)
+        {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            std::shared_ptr<Flow>& flow {polled[i - 1]};
+            ssize_t n {recv(flow->fd, buffer.data(), buffer.size(), 0)};
+            if (n < 0)
+                continue;
+
+            Verdict verdict {flow->down.shape(static_cast<size_t>(n))};
+            if (!verdict.isLost)
+                received.push_back(std::make_shared<Datagram>(
+                    Datagram {verdict.deliverAt, flow, false, std::string(buffer.data(), n)}));
+        }
+
+        if (!received.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                for (auto& datagram : received)
+                    m_datagrams.push(std::move(datagram));
+            }
+            m_wakeUp.notify_one();
+        }
+
+        // Drop the clients gone quiet, their sockets close with their last
+        // queued datagram.
+        Clock::time_point idleSince {Clock::now() - std::chrono::seconds(Settings::UDP_FLOW_IDLE_SEC)};
+        for (auto flow = flows.begin(); flow != flows.end();)
+        {
+            if (!flow->second || flow->second->fd < 0 || flow->second->lastSeen < idleSince)
+                flow = flows.erase(flow);
+            else
+                ++flow;
+        }
+    }
+}
+
+// deliverDatagrams sends the queued datagrams once due, the upstream ones on
+// the client's flow and the replies from the listening socket.
+void WanProxy::deliverDatagrams()
+{
+    std::unique_lock<std::mutex> lock {m_mutex};
+    for (;;)
+    {
+        if (m_datagrams.empty())
+        {
+            m_wakeUp.wait(lock);
+            continue;
+        }
+
+        // Wakes up early if an earlier datagram is queued meanwhile.
+        Clock::time_point deliverAt {m_datagrams.top()->deliverAt};
+        if (Clock::now() < deliverAt)
+        {
+            m_wakeUp.wait_until(lock, deliverAt);
+            continue;
+        }
+
+        std::shared_ptr<Datagram> datagram {m_datagrams.top()};
+        m_datagrams.pop();
+        lock.unlock();
+
+        const Flow& flow {*datagram->flow};
+        if (datagram->isUpstream)
+            send(flow.fd, datagram->payload.data(), datagram->payload.size(), 0);
+        else
+            sendto(m_listenFd, datagram->payload.data(), datagram->payload.size(), 0,
+                reinterpret_cast<const sockaddr*>(&flow.client), flow.clientSize);
+
+        lock.lock();
+    }
+}
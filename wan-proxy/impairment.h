@@ -0,0 +1,215 @@
+/*!
+ * @file impairment.h
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part wan-proxy package files. The WAN proxy sits between a
+ * host built client i.e. the rfid-gateway or the edge-relay and a local trust
+ * organization stand-in. It forwards the TCP connections or UDP datagrams
+ * while adding the delay, loss, bandwidth cap and connection resets of a
+ * remote site link read from an impairment profile. Keep-alive, retries and
+ * timeouts can then be measured on a fast office network as they would
+ * behave behind a 300 ms RTT lossy link.
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#ifndef __RFID_WAN_PROXY_IMPAIRMENT__
+#define __RFID_WAN_PROXY_IMPAIRMENT__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "commonRFID.h"
+#include "httpClient.h"
+
+namespace Settings
+{
+    // Import the common settings configurations here.
+    using namespace CommonRFID;
+
+    // DEFAULT_PORT defines the port the proxy listens on.
+    constexpr int DEFAULT_PORT {8081};
+
+    // CHUNK_SIZE defines the most bytes read at once from a TCP connection
+    // i.e. an Ethernet segment. The impairments are applied per chunk.
+    constexpr size_t CHUNK_SIZE {1460};
+
+    // MAX_DATAGRAM_SIZE defines the largest UDP datagram relayed.
+    constexpr size_t MAX_DATAGRAM_SIZE {65507};
+
+    // TCP_RTO_MIN_MS defines the delay added to a lost TCP chunk i.e. the
+    // minimum retransmission timeout of the Linux TCP stack. A TCP stream
+    // can't lose bytes, its chunks are only delivered late.
+    constexpr int TCP_RTO_MIN_MS {200};
+
+    // UDP_FLOW_IDLE_SEC defines how long the upstream socket of a UDP client
+    // is kept after its last datagram.
+    constexpr int UDP_FLOW_IDLE_SEC {60};
+
+    // PARETO_SHAPE defines the shape of the pareto delay distribution. With
+    // 2 its mean sits a jitter above the delay, with a long tail.
+    constexpr double PARETO_SHAPE {2.0};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Phase holds the impairments applied in each direction for a while.
+struct Phase
+{
+    enum Distribution { Constant, Uniform, Normal, Pareto };
+
+    int seconds {0};
+    double delayMs {0};
+    double jitterMs {0};
+    Distribution distribution {Constant};
+    double lossPercent {0};
+    double bandwidthKbps {0};
+    double resetPercent {0};
+};
+
+// Profile holds the phases read from an impairment profile file. Each line
+// holds a key followed by its values, lines starting with # are skipped:
+//      phase <seconds>
+//      delay <ms> [jitter ms] [constant|uniform|normal|pareto]
+//      loss <percent>
+//      bandwidth <kbit/s>
+//      reset <percent>
+// The delay is one way thus a 300 ms RTT is a 150 ms delay. With uniform the
+// delay varies by up to the jitter either way, with normal the jitter is the
+// standard deviation. The loss and reset percentages apply per forwarded
+// chunk or datagram, resets only on TCP. A zero bandwidth isn't capped.
+// A phase line starts a new phase holding the values of the previous one,
+// the values listed before the first phase line start the first one. The
+// phases repeat in order, one lasting zero seconds lasts forever. Without a
+// phase line the profile holds a single endless phase.
+class Profile
+{
+    public:
+        // parse reads the profile file. Returns false and prints the reason if
+        // it is malformed.
+        bool parse(const std::string& path);
+
+        // current returns the phase active now.
+        const Phase& current() const;
+
+    private:
+        std::vector<Phase> m_phases;
+        int m_cycleSec {0};
+        Clock::time_point m_start;
+};
+
+// ProxyStats holds the proxy metrics.
+struct ProxyStats
+{
+    std::atomic<uint64_t> connections {0};
+    std::atomic<uint64_t> chunks {0};
+    std::atomic<uint64_t> bytes {0};
+    std::atomic<uint64_t> lost {0};
+    std::atomic<uint64_t> resets {0};
+    std::atomic<uint64_t> totalDelayUs {0};
+    std::atomic<uint64_t> maxDelayUs {0};
+
+    // print writes the metrics to the stdout.
+    void print() const;
+};
+
+// Verdict holds the fate of a forwarded chunk or datagram.
+struct Verdict
+{
+    Clock::time_point deliverAt;
+    bool isLost {false};
+    bool isReset {false};
+};
+
+// Link shapes the traffic of a single direction. It isn't thread safe, a
+// direction is read by a single thread.
+class Link
+{
+    public:
+        Link(const Profile& profile, ProxyStats& stats, bool isStream);
+
+        // shape returns when the chunk of the given size read now is delivered
+        // or if it is lost or resets the connection instead.
+        Verdict shape(size_t size);
+
+    private:
+        // sampleDelayMs returns the one way delay of a chunk.
+        double sampleDelayMs(const Phase& phase);
+
+        const Profile& m_profile;
+        ProxyStats& m_stats;
+        bool m_isStream;
+
+        std::mt19937 m_random;
+        Clock::time_point m_idleAt;
+        Clock::time_point m_lastDelivery;
+};
+
+// WanProxy forwards the client traffic to the upstream endpoint.
+class WanProxy
+{
+    public:
+        WanProxy(const HttpEndpoint& upstream, const Profile& profile);
+
+        // listen binds the listening socket. Returns false on failure.
+        bool listen(int port, bool isDatagram);
+
+        // run relays the TCP connections or the UDP datagrams.
+        void run();
+
+        ProxyStats stats;
+
+    private:
+        // Connection holds a proxied TCP connection and its two directions.
+        struct Connection;
+
+        // Datagram holds a UDP datagram waiting for its delivery.
+        struct Datagram;
+
+        // Flow holds the upstream socket of a UDP client.
+        struct Flow;
+
+        // serveConnection relays a TCP client connection.
+        void serveConnection(int clientFd);
+
+        // runDatagrams relays the UDP datagrams of all the clients.
+        void runDatagrams();
+
+        // deliverDatagrams sends the queued datagrams once due.
+        void deliverDatagrams();
+
+        HttpEndpoint m_upstream;
+        const Profile& m_profile;
+        bool m_isDatagram {false};
+        int m_listenFd {-1};
+
+        sockaddr_storage m_upstreamAddr {};
+        socklen_t m_upstreamAddrSize {0};
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::priority_queue<std::shared_ptr<Datagram>, std::vector<std::shared_ptr<Datagram>>,
+            bool (*)(const std::shared_ptr<Datagram>&, const std::shared_ptr<Datagram>&)> m_datagrams;
+};
+
+#endif
@@ -0,0 +1,18 @@
+# Remote site whose uplink degrades every few minutes, repeated forever.
+delay 150 40 pareto
+loss 0.5
+bandwidth 512
+
+# Two minutes of the usual link.
+phase 120
+
+# Half a minute of congestion with heavy loss and a slower link.
+phase 30
+delay 400 200 pareto
+loss 10
+bandwidth 64
+
+# Ten seconds of the link flapping, resetting the connections.
+phase 10
+loss 30
+reset 20
@@ -0,0 +1,4 @@
+# Remote site behind a 300 ms RTT cellular link with some loss.
+delay 150 25 normal
+loss 1
+bandwidth 512
@@ -0,0 +1,109 @@
+/*!
+ * @file wan-proxy.cpp
+ *
+ * @section intro_sec Introduction
+ *
+ * This file is part wan-proxy package files. It parses the command line
+ * options and runs the proxy.
+ *
+ *  Usage: wan-proxy -p profile [-l port] [-u url] [-d]
+ *      -p  impairment profile file, see impairment.h and the profiles folder.
+ *      -l  port to listen on for the clients.
+ *      -u  url of the trust organization stand-in, only its host and port
+ *          are used. Defaults to SERVER_API_URL.
+ *      -d  relay UDP datagrams instead of TCP connections.
+ *  Sending SIGUSR1 to the process prints the proxy metrics at any time.
+ *
+ *  For instance to run the edge-relay behind a remote site link:
+ *      wan-proxy -p profiles/remote-site.profile -u http://localhost:80/
+ *      edge-relay -u http://localhost:8081/rfid-based-auth/
+ *
+ * @section author Author
+ *
+ * Written by dmigwi (Migwi Ndung'u)  @2024
+ * LinkedIn: https://www.linkedin.com/in/migwi-ndungu/
+ *
+ *  @section license License
+ *
+ * BSD license, all text here must be included in any redistribution.
+ */
+
+#include "impairment.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <unistd.h>
+
+// Main function.
+int main(int argc, char* argv[])
+{
+    std::string profilePath;
+    std::string url {Settings::SERVER_API_URL};
+    int port {Settings::DEFAULT_PORT};
+    bool isDatagram {false};
+
+    int option;
+    while ((option = getopt(argc, argv, "p:l:u:d")) != -1)
+    {
+        switch (option)
+        {
+            case 'p': profilePath = optarg; break;
+            case 'l': port = atoi(optarg); break;
+            case 'u': url = optarg; break;
+            case 'd': isDatagram = true; break;
+            default:
+                fprintf(stderr, "Usage: %s -p profile [-l port] [-u url] [-d]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (profilePath.empty())
+    {
+        fprintf(stderr, "Usage: %s -p profile [-l port] [-u url] [-d]\n", argv[0]);
+        return 1;
+    }
+
+    HttpEndpoint upstream;
+    if (!upstream.parse(url))
+    {
+        fprintf(stderr, "Unsupported trust organization url: %s\n", url.c_str());
+        return 1;
+    }
+
+    Profile profile;
+    if (!profile.parse(profilePath))
+        return 1;
+
+    // Block the handled signals before any thread is created so that they
+    // are only delivered to the main thread.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    WanProxy proxy {upstream, profile};
+    if (!proxy.listen(port, isDatagram))
+        return 1;
+
+    std::thread(&WanProxy::run, &proxy).detach();
+    printf("wan-proxy listening on %s port %d, upstream %s:%s\n", isDatagram ? "udp" : "tcp",
+        port, upstream.host.c_str(), upstream.port.c_str());
+    fflush(stdout);
+
+    for (;;)
+    {
+        int signal {0};
+        sigwait(&signals, &signal);
+
+        proxy.stats.print();
+        if (signal != SIGUSR1)
+            break;
+    }
+
+    return 0;
+}
@@ -32,6 +32,7 @@
 #include <ESP8266WebServer.h>
 #include <ESP8266mDNS.h>
 #include <ESP8266HTTPClient.h>
+#include <LittleFS.h>
 #include <SoftwareSerial.h>
 
 // The text of builtin files are in this header file
@@ -87,6 +88,12 @@ namespace Settings
     // connection attempts are aborted.
     const int CONNECTION_TIMEOUT {60000};
 
+    // HTTP_TIMEOUT defines the connect and read timeout in ms of a tap
+    // request. It is kept under half of the PCD's AUTH_DELAY so that a relay
+    // that couldn't be reached and the trust organization fallback both fit
+    // before the PCD stops waiting for the reply.
+    const uint16_t HTTP_TIMEOUT {AUTH_DELAY / 2 - 500};
+
     // ESP-01 and ESP-01S are both programmed using the Generic ESP8266
     // settings but have different pins for the builtin LED. Select Builtin
     // Led:1 for the ESP-01 and Builtin Led:2 for the ESP-01S
@@ -96,6 +103,44 @@ namespace Settings
     // led that are used to indicate status change.
     const byte blinksCount {10};
 
+    // TELEMETRY_FILE defines the flash file where the telemetry records received
+    // from the PCD are buffered till they are uploaded.
+    const char* TELEMETRY_FILE {"/telemetry.bin"};
+
+    // TELEMETRY_API_QUERY is appended to the trust organization API url to
+    // identify the telemetry ingestion endpoint.
+    const char* TELEMETRY_API_QUERY {"?telemetry"};
+
+    // TELEMETRY_MAX_RECORDS defines the maximum number of telemetry records that
+    // can be buffered in flash. New records are dropped once it is reached.
+    const int TELEMETRY_MAX_RECORDS {512};
+
+    // TELEMETRY_BATCH_RECORDS defines the maximum number of telemetry records
+    // uploaded in a single request.
+    const int TELEMETRY_BATCH_RECORDS {64};
+
+    // TELEMETRY_IDLE_TIME defines how long in ms the serial link must be idle
+    // before a telemetry upload is attempted. It ensures that uploads happen
+    // between taps and never delay a tap in progress.
+    const unsigned long TELEMETRY_IDLE_TIME {AUTH_DELAY};
+
+    // TELEMETRY_UPLOAD_INTERVAL defines the interval in ms between telemetry
+    // uploads unless a full batch is already buffered.
+    const unsigned long TELEMETRY_UPLOAD_INTERVAL {60000};
+
+    // RELAY_SERVICE defines the mDNS service name advertised by an edge-relay
+    // running on the LAN. i.e. _rfid-relay._tcp
+    const char* RELAY_SERVICE {"rfid-relay"};
+
+    // RELAY_DISCOVERY_INTERVAL defines the interval in ms at which the edge-relay
+    // is looked up again. The mDNS query blocks for about a second thus it is
+    // only made while the serial link is idle.
+    const unsigned long RELAY_DISCOVERY_INTERVAL {300000};
+
+    // BULK_CHUNK_SIZE defines the size in bytes of the pieces a telemetry upload
+    // is written in. The upload gives way to a tap frame between the pieces.
+    const size_t BULK_CHUNK_SIZE {128};
+
      // AuthInfo defines parameters needed to connect to a WiFi channel.
     typedef struct
     {
@@ -288,8 +333,28 @@ class WiFiConfig
         enum httpClientErr {
             INVALID_TRUST_ORG = -12,
             INVALID_BUFFER_SIZE = -13,
+            // UPLOAD_PREEMPTED is returned when a bulk upload gave way to a tap.
+            UPLOAD_PREEMPTED = -14,
         };
 
+        // TrafficClass identifies the traffic sharing the serial link and the
+        // single connection. Tap requests have strict priority over the bulk
+        // telemetry uploads which are preempted by them.
+        enum TrafficClass { TapClass, BulkClass, classesCount };
+
+        // TrafficStats holds the queue depth and the latency in ms of a traffic
+        // class. The depth of the taps counts the bytes waiting on the serial
+        // link once a frame is read, the one of bulk the records buffered in flash.
+        typedef struct
+        {
+            uint32_t handled;
+            uint32_t preempted;
+            uint32_t depth;
+            uint32_t maxDepth;
+            uint32_t totalMs;
+            uint32_t maxMs;
+        } TrafficStats;
+
         // WifiConfig Constructor.
         WiFiConfig() = default;
 
@@ -316,6 +381,13 @@ class WiFiConfig
 
             // Extract Memory Contents.
             EEPROM.get(Settings::STORAGE_ADDRESS, m_settings);
+
+            // Mount the flash filesystem used to buffer the telemetry records.
+            m_hasTelemetryFS = LittleFS.begin();
+            #ifdef DEBUG
+            if (!m_hasTelemetryFS)
+                Serial.println(F("Mounting the telemetry filesystem failed!"));
+            #endif
         }
 
         // establishConnection turns the Station Mode on and allows the chip to
@@ -379,6 +451,10 @@ class WiFiConfig
             Serial.println("Station WiFi Mode Active");
             #endif
 
+            // The mDNS responder is required to discover an edge-relay on the LAN.
+            if (MDNS.begin(WiFi.hostname()))
+                discoverRelay();
+
             // blink several times to indicate that WiFi connectivity is working as expected.
             for (byte i{0}; i < Settings::blinksCount; i++)
                 blinkBuiltinLED(Settings::REFRESH_DELAY);
@@ -449,8 +525,10 @@ class WiFiConfig
                 Serial.println("[HTTP] Identifying the respective Trust Organization");
                 #endif
 
-                // configure the Trust Organization API URL
-                http.begin(client, Settings::SERVER_API_URL);  // HTTP
+                // configure the Trust Organization API URL, the edge-relay is
+                // preferred if one was discovered.
+                http.begin(client, m_apiUrl);  // HTTP
+                http.setTimeout(Settings::HTTP_TIMEOUT);
                 http.addHeader("Content-Type", "application/x-www-form-urlencoded");
 
                 #ifdef DEBUG
@@ -459,6 +537,22 @@ class WiFiConfig
 
                 // start connection and send HTTP header and body
                 httpCode = http.POST(m_requestBuffer, size);
+
+                // The edge-relay is unreachable, fall back to the trust
+                // organization API url till the next relay discovery. Only a
+                // request that was never sent is sent again, once the relay has
+                // it the trust key may already be rotated and a second rotation
+                // would lock the card out.
+                if (httpCode == HTTPC_ERROR_CONNECTION_FAILED && m_isRelay)
+                {
+                    http.end();
+                    useCloudUrl();
+
+                    http.begin(client, m_apiUrl);  // HTTP
+                    http.setTimeout(Settings::HTTP_TIMEOUT);
+                    http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+                    httpCode = http.POST(m_requestBuffer, size);
+                }
             }
 
             if (httpCode < 0) // client error detected.
@@ -477,8 +571,13 @@ class WiFiConfig
             }
 
             // Successful response from the server returned
+            // The response is binary, it is written with its length as it may
+            // hold null bytes e.g. in the session token.
             if (httpCode == HTTP_CODE_OK)
-                Serial.write(http.getString().c_str());
+            {
+                String payload {http.getString()};
+                Serial.write(reinterpret_cast<const uint8_t*>(payload.c_str()), payload.length());
+            }
             else
                 Serial.write(httpErrorCode);
 
@@ -500,13 +599,27 @@ class WiFiConfig
 
                 int readBytes = Serial.readBytes(m_requestBuffer, Settings::MaxReqSize);
 
+                m_lastActivity = millis();
+                recordDepth(TapClass, Serial.available());
+
                 // Handle the request based on the data size sent.
                 switch(readBytes)
                 {
                     case Settings::SecretKeyAuthDataSize:
                     case Settings::TrustKeyAuthDataSize:
+                    case Settings::TrustKeyTokenAuthDataSize:
                         // Ensure the read bytes and expected bytes match otherwise data read is invalid
                         handleHttpEvents(readBytes, true);
+                        recordLatency(TapClass, m_lastActivity);
+                        break;
+                    case Settings::TelemetryDataSize:
+                        // Telemetry records expect no response thus are only buffered.
+                        if (m_requestBuffer[0] == Settings::TELEMETRY_MARKER)
+                        {
+                            bufferTelemetry();
+                            break;
+                        }
+                        handleHttpEvents(readBytes, false);  // Invalid data found.
                         break;
                     default:
                         handleHttpEvents(readBytes, false);  // Invalid data size found.
@@ -514,6 +627,253 @@ class WiFiConfig
             }
         }
 
+        // discoverRelay looks up an edge-relay advertised over mDNS on the LAN.
+        // If found, it is preferred over the trust organization API url.
+        void discoverRelay()
+        {
+            m_lastDiscovery = millis();
+
+            int found {MDNS.queryService(Settings::RELAY_SERVICE, "tcp")};
+            if (found > 0)
+            {
+                m_apiUrl = "http://" + MDNS.IP(0).toString() + ":" + String(MDNS.port(0)) + "/";
+                m_isRelay = true;
+            }
+            else
+                useCloudUrl();
+
+            #ifdef DEBUG
+            Serial.printf("[mDNS] Trust Organization API url: %s\n", m_apiUrl.c_str());
+            #endif
+        }
+
+        // useCloudUrl sets the trust organization API url as the one in use.
+        void useCloudUrl()
+        {
+            m_apiUrl = Settings::SERVER_API_URL;
+            m_isRelay = false;
+        }
+
+        // refreshRelay repeats the edge-relay discovery on its interval while the
+        // serial link is idle. It also keeps the mDNS responder running.
+        void refreshRelay()
+        {
+            MDNS.update();
+
+            unsigned long now {millis()};
+            if (WiFi.status() == WL_CONNECTED &&
+                now - m_lastActivity >= Settings::TELEMETRY_IDLE_TIME &&
+                now - m_lastDiscovery >= Settings::RELAY_DISCOVERY_INTERVAL)
+                discoverRelay();
+        }
+
+        // bufferTelemetry appends the telemetry record in the request buffer
+        // into the flash file. The record is dropped if the file is full.
+        void bufferTelemetry()
+        {
+            if (!m_hasTelemetryFS)
+                return;
+
+            File file = LittleFS.open(Settings::TELEMETRY_FILE, "a");
+            if (!file)
+                return;
+
+            if (file.size() < Settings::TELEMETRY_MAX_RECORDS * Settings::TelemetryDataSize)
+                file.write(m_requestBuffer, Settings::TelemetryDataSize);
+            #ifdef DEBUG
+            else
+                Serial.println(F("[Telemetry] Buffer is full, record dropped!"));
+            #endif
+
+            file.close();
+        }
+
+        // uploadTelemetry uploads the buffered telemetry records in batches to
+        // the trust organization once the serial link has been idle long enough.
+        // The request body holds the PCD's ID followed by the records. Uploaded
+        // records are only removed from flash after a successful response. The
+        // upload is bulk traffic, it is preempted by a tap frame.
+        void uploadTelemetry()
+        {
+            unsigned long now {millis()};
+            if (!m_hasTelemetryFS || WiFi.status() != WL_CONNECTED ||
+                now - m_lastActivity < Settings::TELEMETRY_IDLE_TIME)
+                return;
+
+            File file = LittleFS.open(Settings::TELEMETRY_FILE, "r");
+            if (!file)
+                return;
+
+            const size_t batchSize {Settings::TELEMETRY_BATCH_RECORDS * Settings::TelemetryDataSize};
+            size_t fileSize {file.size()};
+
+            // Uploads happen on the upload interval unless a full batch is ready.
+            if (fileSize < Settings::TelemetryDataSize ||
+                (fileSize < batchSize && now - m_lastUpload < Settings::TELEMETRY_UPLOAD_INTERVAL))
+            {
+                file.close();
+                return;
+            }
+
+            m_lastUpload = now;
+
+            const size_t idSize {sizeof(Settings::DEVICE_ID)};
+            byte *body = new byte[idSize + batchSize];
+            memcpy(body, Settings::DEVICE_ID, idSize);
+
+            size_t recordsSize {file.read(body+idSize, batchSize)};
+            recordsSize -= recordsSize % Settings::TelemetryDataSize; // Whole records only.
+
+            String url {m_apiUrl};
+            url += Settings::TELEMETRY_API_QUERY;
+
+            recordDepth(BulkClass, fileSize / Settings::TelemetryDataSize);
+            int httpCode {postPreemptible(url, body, idSize + recordsSize)};
+
+            delete[] body;
+
+            #ifdef DEBUG
+            Serial.printf("[Telemetry] Uploaded %d bytes, status: %d\n", recordsSize, httpCode);
+            printTrafficStats();
+            #endif
+
+            if (httpCode == UPLOAD_PREEMPTED)
+            {
+                // The records stay buffered, they are uploaded once the link is idle again.
+                ++m_stats[BulkClass].preempted;
+                file.close();
+                return;
+            }
+
+            recordLatency(BulkClass, now);
+            if (httpCode != HTTP_CODE_OK)
+            {
+                file.close();
+                return;
+            }
+
+            // Move the records not uploaded yet to the start of the file.
+            File pending = LittleFS.open("/telemetry.tmp", "w");
+            bool isMoved {pending};
+            if (isMoved)
+            {
+                byte record[Settings::TelemetryDataSize];
+                while (file.read(record, Settings::TelemetryDataSize) == Settings::TelemetryDataSize)
+                    pending.write(record, Settings::TelemetryDataSize);
+                pending.close();
+            }
+            file.close();
+
+            LittleFS.remove(Settings::TELEMETRY_FILE);
+            if (isMoved)
+                LittleFS.rename("/telemetry.tmp", Settings::TELEMETRY_FILE);
+        }
+
+        // postPreemptible posts the bulk body to the http://host[:port]/path url
+        // giving way to the PCD. The transfer is abandoned if a frame arrives
+        // on the serial link while connecting or writing the body. Once the body
+        // is written the response is waited for as the records would otherwise
+        // be inserted twice. Returns the HTTP status code, a negative client
+        // error code or UPLOAD_PREEMPTED.
+        int postPreemptible(const String& url, const byte* body, size_t size)
+        {
+            if (!url.startsWith("http://"))
+                return INVALID_TRUST_ORG;
+
+            int pathStart {url.indexOf('/', 7)};
+            String host {url.substring(7, pathStart < 0 ? url.length() : pathStart)};
+            String path {pathStart < 0 ? String("/") : url.substring(pathStart)};
+
+            uint16_t port {80};
+            int portStart {host.indexOf(':')};
+            if (portStart >= 0)
+            {
+                port = host.substring(portStart + 1).toInt();
+                host = host.substring(0, portStart);
+            }
+
+            if (Serial.available() > 0)
+                return UPLOAD_PREEMPTED;
+
+            WiFiClient client{};
+            client.setTimeout(Settings::AUTH_DELAY);
+            if (!client.connect(host, port))
+                return HTTPC_ERROR_CONNECTION_FAILED;
+
+            String headers {"POST " + path + " HTTP/1.1\r\nHost: " + host + "\r\n"};
+            headers += "Content-Type: application/octet-stream\r\n";
+            headers += "Content-Length: " + String(size) + "\r\nConnection: close\r\n\r\n";
+            if (Serial.available() > 0 || client.print(headers) != headers.length())
+            {
+                client.stop();
+                return (Serial.available() > 0) ? UPLOAD_PREEMPTED : HTTPC_ERROR_SEND_HEADER_FAILED;
+            }
+
+            for (size_t sent {0}; sent < size;)
+            {
+                if (Serial.available() > 0)
+                {
+                    client.stop();
+                    return UPLOAD_PREEMPTED;
+                }
+
+                size_t written {client.write(body + sent, min(size - sent, Settings::BULK_CHUNK_SIZE))};
+                if (written == 0)
+                {
+                    client.stop();
+                    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+                }
+                sent += written;
+            }
+
+            // The status line e.g. "HTTP/1.1 200 OK" is all that is needed.
+            String status {client.readStringUntil('\n')};
+            client.stop();
+
+            if (status.length() == 0)
+                return HTTPC_ERROR_READ_TIMEOUT;
+            if (!status.startsWith("HTTP/1."))
+                return HTTPC_ERROR_NO_HTTP_SERVER;
+            return status.substring(9, 12).toInt();
+        }
+
+        // recordDepth records the queue depth of the traffic class.
+        void recordDepth(TrafficClass trafficClass, uint32_t depth)
+        {
+            m_stats[trafficClass].depth = depth;
+            m_stats[trafficClass].maxDepth = max(m_stats[trafficClass].maxDepth, depth);
+        }
+
+        // recordLatency records a request of the traffic class handled since
+        // the start time in ms.
+        void recordLatency(TrafficClass trafficClass, unsigned long start)
+        {
+            uint32_t latency {millis() - start};
+            TrafficStats& stats {m_stats[trafficClass]};
+            ++stats.handled;
+            stats.totalMs += latency;
+            stats.maxMs = max(stats.maxMs, latency);
+        }
+
+        // stats returns the stats of the traffic class.
+        const TrafficStats& stats(TrafficClass trafficClass) const { return m_stats[trafficClass]; }
+
+        // printTrafficStats prints the stats of each traffic class. Works only
+        // during the debugging mode.
+        void printTrafficStats()
+        {
+            #ifdef DEBUG
+            static const char* const classNames[classesCount] {"tap", "bulk"};
+            for (byte i {0}; i < classesCount; ++i)
+            {
+                const TrafficStats& stats {m_stats[i]};
+                Serial.printf("[Traffic] %s handled=%u preempted=%u depth=%u max_depth=%u avg_ms=%u max_ms=%u\n",
+                    classNames[i], stats.handled, stats.preempted, stats.depth, stats.maxDepth,
+                    stats.handled ? stats.totalMs / stats.handled : 0, stats.maxMs);
+            }
+            #endif
+        }
+
     private:
         // m_settings hold a copy of the SSID and password values recieved from
         // the WiFiConfig class.
@@ -522,6 +882,28 @@ class WiFiConfig
         // requestBuffer is a reserved contagious memory space where all request
         // from the serial communication can be read it.
         byte m_requestBuffer[Settings::MaxReqSize];
+
+        // m_hasTelemetryFS is true if the telemetry flash filesystem was mounted.
+        bool m_hasTelemetryFS {false};
+
+        // m_lastActivity holds the time in ms the last serial data was received.
+        unsigned long m_lastActivity {0};
+
+        // m_lastUpload holds the time in ms of the last telemetry upload attempt.
+        unsigned long m_lastUpload {0};
+
+        // m_apiUrl holds the url requests are sent to. It is either the edge-relay
+        // discovered on the LAN or the trust organization API url.
+        String m_apiUrl {Settings::SERVER_API_URL};
+
+        // m_isRelay is true if m_apiUrl points to an edge-relay.
+        bool m_isRelay {false};
+
+        // m_lastDiscovery holds the time in ms of the last edge-relay discovery.
+        unsigned long m_lastDiscovery {0};
+
+        // m_stats holds the queue depth and latency of each traffic class.
+        TrafficStats m_stats[classesCount] {};
 };
 
 WiFiConfig config{};
@@ -578,11 +960,17 @@ void setup()
     digitalWrite(Settings::LED, LOW); // Turn off the LED after blinking
 
     // Timeout is reduced from the default 1 seconds to 30ms because http responses
-    // recieved do not require a lot time to read the body contents.
-    Serial.setTimeout(30); // set read bytes timeout to 30ms
+    // recieved do not require a lot time to read the body contents. The PCD
+    // keeps its frames further apart than it.
+    Serial.setTimeout(Settings::FRAME_READ_TIMEOUT); // set read bytes timeout to 30ms
 }
 
 void loop()
 {
     config.handleEvents();
+
+    // Telemetry is only uploaded and the edge-relay looked up when the serial
+    // link is idle.
+    config.uploadTelemetry();
+    config.refreshRelay();
 }